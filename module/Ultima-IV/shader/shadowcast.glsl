@@ -16,7 +16,13 @@ void main() {
 uniform vec4 vport;			// Viewport pixel (x, y, width, height)
 uniform vec3 viewer;	    // World (x, y, scale)
 uniform ivec3 shape_count;	// (left, center, right)
-uniform vec3 shapes[128];	// (x, y, type) for each shape.
+#ifndef MAX_SHAPES
+#define MAX_SHAPES 128
+#endif
+
+// The (x, y, type) of each shape packed as four shapes per three vec4.
+// This keeps the uniforms within the 224 vectors that GLES 3 guarantees.
+uniform vec4 shapes[(MAX_SHAPES * 3 + 3) / 4];
 out vec4 fragColor;
 
 vec3 shapeCube = vec3(0.5, 0.5, 0.5);
@@ -31,6 +37,13 @@ float sdBox(vec3 p, vec3 b) {
 	return length(max(q,0.0)) + min(max(q.x,q.z),0.0);	// 2D test.
 }
 
+vec3 shapeAt(int i) {
+	int f = i * 3;
+	return vec3(shapes[f >> 2][f & 3],
+	            shapes[(f + 1) >> 2][(f + 1) & 3],
+	            shapes[(f + 2) >> 2][(f + 2) & 3]);
+}
+
 float sceneSDF(vec3 pnt, ivec4 group) {
 	ivec2 it;
 	float d;
@@ -42,7 +55,7 @@ float sceneSDF(vec3 pnt, ivec4 group) {
 		it = group.zw;
 
 	for ( ; it.x < it.y; it.x++) {
-		vec3 spos = shapes[it.x];
+		vec3 spos = shapeAt(it.x);
 		if (spos.z == 1.0)
 			d = sdBox(pnt - vec3(spos.x, 0.0, spos.y), shapeCube);
 		else
@@ -5,18 +5,55 @@
 #if defined(VERTEX)
 
 uniform mat4 transform;
-layout(location = 0) in vec3 position;
-layout(location = 1) in vec4 uv;
 out vec3 vertex;
 out vec4 texCoord;
 out vec2 shadowCoord;
 
+#ifdef TILE_INSTANCE
+// Map chunks are drawn as one quad instance per TileId.  The tileTable
+// has two texels for each TileId: the UV rectangle, and the animation type
+// (0 = none, 1 = scroll, 2 = fire) with its parameter.
+
+uniform int chunkDim;
+uniform sampler2D tileTable;
+layout(location = 0) in vec2 corner;
+layout(location = 2) in uint tile;
+
+vec4 tableFetch(int i) {
+	return texelFetch(tileTable, ivec2(i & 255, i >> 8), 0);
+}
+
+void main() {
+	int i = int(tile) * 2;
+	vec4 rect = tableFetch(i);
+	vec4 anim = tableFetch(i + 1);
+
+	vertex = vec3(corner.x - 0.5 + float(gl_InstanceID % chunkDim),
+	              corner.y - 0.5 - float(gl_InstanceID / chunkDim), 0.0);
+	texCoord.st = vec2(mix(rect.x, rect.z, corner.x),
+	                   mix(rect.w, rect.y, corner.y));
+	if (anim.x == 1.0)
+		texCoord.pq = vec2(1.0 - corner.y, anim.y);
+	else if (anim.x == 2.0)
+		texCoord.pq = vec2(anim.y + corner.x, corner.y);
+	else
+		texCoord.pq = vec2(0.0);
+
+	gl_Position = transform * vec4(vertex, 1.0);
+	shadowCoord = (gl_Position.xy + 1.0) * 0.5;
+}
+
+#else
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec4 uv;
+
 void main() {
 	vertex = position;
 	texCoord = uv;
 	gl_Position = transform * vec4(position, 1.0);
 	shadowCoord = (gl_Position.xy + 1.0) * 0.5;
 };
+#endif
 
 #elif defined(FRAGMENT)
 
@@ -41,6 +41,7 @@ exe %xu4 [
 				%event_allegro.cpp
 				%screen_allegro.cpp
 				%sound_allegro.cpp
+				%thread_allegro.cpp
 			]
 		]
 		sdl [
@@ -50,6 +51,7 @@ exe %xu4 [
 				%event_sdl.cpp
 				%screen_sdl.cpp
 				%sound_sdl.cpp
+				%thread_sdl.cpp
 			]
 		]
 	]
@@ -149,6 +151,7 @@ exe %xu4 [
 		%names.cpp
 		%object.cpp
 		%party.cpp
+		%pathfind.cpp
 		%person.cpp
 		%portal.cpp
 		%progress_bar.cpp
@@ -177,6 +180,7 @@ exe %xu4 [
 		%lzw/u4decode.cpp
 
 		%support/notify.c
+		%support/profiler.c
 	]
 ]
 
@@ -2,52 +2,116 @@
  * annotation.cpp
  */
 
+#include <string.h>
 #include "annotation.h"
 
+#define BUCKET(pos) \
+    ((pos.x + pos.y * 11 + pos.z * 37) & (ANNOTATION_BUCKETS - 1))
+
+AnnotationList::AnnotationList() {
+    memset(head, 0xff, sizeof(head));
+}
+
+/**
+ * Removes all annotations.
+ */
+void AnnotationList::clear() {
+    store.clear();
+    memset(head, 0xff, sizeof(head));
+}
+
+/*
+ * Rebuild the bucket chains after annotations have been removed.
+ */
+void AnnotationList::rehash() {
+    int i, b;
+    int count = store.size();
+
+    memset(head, 0xff, sizeof(head));
+    for (i = 0; i < count; ++i) {
+        Annotation& ann = store[i];
+        b = BUCKET(ann.coords);
+        ann.nextAt = head[b];
+        head[b] = i;
+    }
+}
+
 /**
  * Adds an annotation to the current map
  */
 Annotation *AnnotationList::add(const Coords& coords, const MapTile& tile,
                                 bool visual, bool isCoverUp) {
-    /* new annotations go to the front so they're handled "on top" */
+    /* new annotations go to the end so they're handled "on top" */
     Annotation ann;
+    int b = BUCKET(coords);
     ann.coords  = coords;
     ann.tile    = tile;
     ann.ttl     = -1;
     ann.visualOnly = visual;
     ann.coverUp = isCoverUp;
-    push_front(ann);
-    return &front();
+    ann.nextAt  = head[b];
+    head[b] = store.size();
+    store.push_back(ann);
+    return &store.back();
 }
 
 /**
- * Returns all annotations found at the given map coordinates
+ * Returns the newest annotation at the given map coordinates, or NULL if
+ * there are none.
  */
-AnnotationList AnnotationList::allAt(Coords coords) {
-    AnnotationList list;
-    AnnotationList::iterator i;
-
-    for (i = begin(); i != end(); i++) {
-        if (i->coords == coords)
-            list.push_back(*i);
+const Annotation* AnnotationList::firstAt(const Coords& pos) const {
+    int i = head[ BUCKET(pos) ];
+    while (i >= 0) {
+        const Annotation* ann = &store[i];
+        if (ann->coords == pos)
+            return ann;
+        i = ann->nextAt;
     }
-
-    return list;
+    return NULL;
 }
 
 /**
- * Returns pointers to all annotations found at the given map coordinates
+ * Returns the next older annotation at the same coordinates as the one
+ * given, or NULL if there are no more.
  */
-std::list<Annotation *> AnnotationList::ptrsToAllAt(const Coords& coords) {
-    std::list<Annotation *> list;
-    iterator i;
-
-    for (i = begin(); i != end(); i++) {
-        if (i->coords == coords)
-            list.push_back(&(*i));
+const Annotation* AnnotationList::nextAt(const Annotation* ann) const {
+    int i = ann->nextAt;
+    while (i >= 0) {
+        const Annotation* it = &store[i];
+        if (it->coords == ann->coords)
+            return it;
+        i = it->nextAt;
     }
+    return NULL;
+}
 
-    return list;
+/**
+ * Copies the annotations found at the given map coordinates into a list.
+ *
+ * \return Number of annotations stored in list (up to max).  Any
+ *         annotations beyond max are left out.
+ */
+int AnnotationList::allAt(const Coords& pos, Annotation* list, int max) const {
+    const Annotation* it;
+    int count = 0;
+    for (it = firstAt(pos); it && count < max; it = nextAt(it))
+        list[count++] = *it;
+    return count;
+}
+
+/**
+ * Returns pointers to the annotations found at the given map coordinates.
+ *
+ * \return Number of pointers stored in list (up to max).  Any
+ *         annotations beyond max are left out.
+ */
+int AnnotationList::ptrsToAllAt(const Coords& pos, const Annotation** list,
+                                int max) const {
+    const Annotation* it;
+    int count = 0;
+    for (it = firstAt(pos); it && count < max; it = nextAt(it))
+        list[count++] = it;
+    return count;
 }
 
 /**
@@ -55,15 +119,18 @@ std::list<Annotation *> AnnotationList::ptrsToAllAt(const Coords& coords) {
  * annotations whose TTL has expired
  */
 void AnnotationList::passTurn() {
-    iterator i = begin();
-    while (i != end()) {
-        if (i->ttl == 0) {
-            i = erase(i);
-        } else {
-            if (i->ttl > 0)
-                --i->ttl;       // Passes a turn for the annotation.
-            ++i;
-        }
+    std::vector<Annotation>::iterator it  = store.begin();
+    std::vector<Annotation>::iterator out = it;
+    for (; it != store.end(); ++it) {
+        if (it->ttl == 0)
+            continue;
+        if (it->ttl > 0)
+            --it->ttl;          // Passes a turn for the annotation.
+        *out++ = *it;
+    }
+    if (out != store.end()) {
+        store.erase(out, store.end());
+        rehash();
     }
 }
 
@@ -71,10 +138,11 @@ void AnnotationList::passTurn() {
  * Removes an annotation from the current map
  */
 void AnnotationList::remove(const Coords& coords, const MapTile& tile) {
-    iterator i;
-    for (i = begin(); i != end(); i++) {
-        if (i->coords == coords && i->tile == tile) {
-            erase(i);
+    const Annotation* it;
+    for (it = firstAt(coords); it; it = nextAt(it)) {
+        if (it->tile == tile) {
+            store.erase(store.begin() + (it - &store[0]));
+            rehash();
             break;
         }
     }
@@ -84,11 +152,15 @@ void AnnotationList::remove(const Coords& coords, const MapTile& tile) {
  * Removes all annotations at a specific position.
  */
 void AnnotationList::removeAllAt(const Coords& pos) {
-    iterator it = begin();
-    while (it != end()) {
-        if (it->coords == pos)
-            it = erase(it);
-        else
-            ++it;
+    if (! firstAt(pos))
+        return;
+
+    std::vector<Annotation>::iterator it  = store.begin();
+    std::vector<Annotation>::iterator out = it;
+    for (; it != store.end(); ++it) {
+        if (! (it->coords == pos))
+            *out++ = *it;
     }
+    store.erase(out, store.end());
+    rehash();
 }
@@ -5,7 +5,7 @@
 #ifndef ANNOTATION_H
 #define ANNOTATION_H
 
-#include <list>
+#include <vector>
 
 #include "coords.h"
 #include "types.h"
@@ -23,23 +23,51 @@ struct Annotation {
     int16_t ttl;        /**< The number of turns the annotation will live */
     bool visualOnly;    /**< True if the annotation is visual-only */
     bool coverUp;       /**< True if this hides everything underneath */
+    int16_t nextAt;     /**< Index of older annotation in same hash bucket */
 };
 
+#define ANNOTATION_BUCKETS  64
+
 /**
  * Manages annotations for the current map.  This includes
  * adding and removing annotations, as well as finding annotations
  * and managing their existence.
+ *
+ * Annotations are stored contiguously and hashed by position so that
+ * finding those at a single coordinate does not search the whole list.
+ * Iteration (and the per-position queries) visit the newest annotations
+ * first.  Any add or remove call invalidates Annotation pointers.
  */
-class AnnotationList : public std::list<Annotation> {
+class AnnotationList {
 public:
+    typedef std::vector<Annotation>::reverse_iterator iterator;
+    typedef std::vector<Annotation>::const_reverse_iterator const_iterator;
+
+    AnnotationList();
+
+    iterator begin() { return store.rbegin(); }
+    iterator end() { return store.rend(); }
+    const_iterator begin() const { return store.rbegin(); }
+    const_iterator end() const { return store.rend(); }
+    int size() const { return store.size(); }
+    void clear();
+
     Annotation* add(const Coords& coords, const MapTile& tile,
                     bool visual = false, bool isCoverUp = false);
-    AnnotationList allAt(Coords pos);
-    std::list<Annotation *> ptrsToAllAt(const Coords& pos);
+    const Annotation* firstAt(const Coords& pos) const;
+    const Annotation* nextAt(const Annotation* ann) const;
+    int allAt(const Coords& pos, Annotation* list, int max) const;
+    int ptrsToAllAt(const Coords& pos, const Annotation** list, int max) const;
     void passTurn();
     void remove(const Coords& pos, const MapTile& tile);
     void remove(const Annotation& a) { remove(a.coords, a.tile); }
     void removeAllAt(const Coords& pos);
+
+private:
+    void rehash();
+
+    std::vector<Annotation> store;      // Oldest annotation first.
+    int16_t head[ANNOTATION_BUCKETS];   // Newest annotation in each bucket.
 };
 
 #endif
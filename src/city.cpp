@@ -12,14 +12,24 @@
 
 
 City::~City() {
+    freePersons();
+}
+
+/**
+ * Deletes the people and dialogues read by the map loader.
+ */
+void City::freePersons() {
     for (PersonList::iterator i = persons.begin(); i != persons.end(); i++)
         delete *i;
+    persons.clear();
 
     std::vector<Dialogue *>::iterator k;
     for (k = dialogueStore.begin(); k != dialogueStore.end(); k++)
         delete *k;
+    dialogueStore.clear();
     for (k = extraDialogues.begin(); k != extraDialogues.end(); k++)
         delete *k;
+    extraDialogues.clear();
 }
 
 /**
@@ -43,9 +53,7 @@ Person *City::addPerson(Person *person) {
     Person *p = new Person(person);
 
     /* set the start coordinates for the person */
-    p->placeOnMap(this, p->getStart());
-
-    objects.push_back(p);
+    addObject(p, p->getStart());
     return p;
 }
 
@@ -27,6 +27,7 @@ public:
     Person *addPerson(Person *p);
     void addPeople();
     void removeAllPeople();
+    void freePersons();
     Person *personAt(const Coords &coords);
 
     // Properties
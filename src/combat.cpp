@@ -20,6 +20,7 @@
 #include "utils.h"
 #include "weapon.h"
 #include "xu4.h"
+#include "support/profiler.h"
 
 #ifdef IOS
 #include "ios_helpers.h"
@@ -445,8 +446,7 @@ void CombatController::placePartyMembers() {
         /* don't place dead party members */
         if (p->getStatus() != STAT_DEAD) {
             /* add the party member to the map */
-            p->placeOnMap(map, map->player_start[i]);
-            map->objects.push_back(p);
+            map->addObject(p, map->player_start[i]);
             party[i] = p;
         }
     }
@@ -718,6 +718,7 @@ bool CombatController::returnWeaponToOwner(const Coords &coords, int distance, i
 }
 
 void CombatController::finishTurn() {
+    PROF_ZONE("combatTurn");
     PartyMember *player = getCurrentPlayer();
     int quick;
 
@@ -1272,12 +1273,12 @@ PartyMemberVector CombatMap::getPartyMembers() {
  * NULL if otherwise.
  */
 PartyMember *CombatMap::partyMemberAt(Coords coords) {
-    PartyMemberVector party = getPartyMembers();
-    PartyMemberVector::iterator i;
+    Object* list[8];
+    int count = objectsAt(coords, list, 8);
 
-    for (i = party.begin(); i != party.end(); i++) {
-        if ((*i)->coords == coords)
-            return *i;
+    for (int i = 0; i < count; ++i) {
+        if (isPartyMember(list[i]))
+            return dynamic_cast<PartyMember*>(list[i]);
     }
     return NULL;
 }
@@ -1287,12 +1288,12 @@ PartyMember *CombatMap::partyMemberAt(Coords coords) {
  * NULL if otherwise.
  */
 Creature *CombatMap::creatureAt(Coords coords) {
-    CreatureVector creatures = getCreatures();
-    CreatureVector::iterator i;
+    Object* list[8];
+    int count = objectsAt(coords, list, 8);
 
-    for (i = creatures.begin(); i != creatures.end(); i++) {
-        if ((*i)->coords == coords)
-            return *i;
+    for (int i = 0; i < count; ++i) {
+        if (isCreature(list[i]) && !isPartyMember(list[i]))
+            return dynamic_cast<Creature*>(list[i]);
     }
     return NULL;
 }
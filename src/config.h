@@ -9,6 +9,16 @@
 
 #ifdef CONF_MODULE
 #include "cdi.h"
+
+/*
+ * A view of a file held in the module package.  The data is read-only and
+ * remains valid until the Config is deleted.
+ */
+struct FileView {
+    const uint8_t* data;
+    uint32_t bytes;
+    uint32_t cdi;       // Data format.
+};
 #endif
 
 class ImageSet;
@@ -57,9 +67,9 @@ public:
     const void* scriptEvalArg(const char* fmt, ...);
 #endif
     const char* modulePath() const;
-    const CDIEntry* fileEntry( const char* sourceFilename ) const;
-    const CDIEntry* imageFile( const char* id ) const;
-    const CDIEntry* mapFile( uint32_t id ) const;
+    bool sourceFile( const char* sourceFilename, FileView* view ) const;
+    bool imageFile( const char* id, FileView* view ) const;
+    bool mapFile( uint32_t id, FileView* view ) const;
     const CDIEntry* musicFile( uint32_t id ) const;
     const CDIEntry* soundFile( uint32_t id ) const;
     int atlasImages(StringId spec, AtlasSubImage* images, int max);
@@ -82,6 +92,8 @@ public:
     const UltimaSaveIds* usaveIds() const;
     Map* map(uint32_t id);
     Map* restoreMap(uint32_t id);
+    bool mapResident(uint32_t id) const;
+    bool prefetchMap(uint32_t id);
     const Coords* moongateCoords(int phase) const;
 
 protected:
@@ -100,8 +100,8 @@ struct ConfigBoron : public Config {
     //const UBuffer* blockBuffer(int value, uint32_t n, int dataType) const;
 
     UThread* ut;
+    CDIPak pak;             // Module package mapped into memory.
     CDIEntry* toc;
-    uint8_t* fnamBuf;
     CDIStringTable fnam;
     UIndex configN;
     UIndex itemIdN;         // item-id context!
@@ -839,7 +839,7 @@ ConfigBoron::ConfigBoron(const char* modulePath)
     UBlockIt bi;
     const char* error = NULL;
     const CDIEntry* ent;
-    FILE* fp;
+    uint8_t* fnamBuf;
 
 #define NO_PTR(ptr, msg) \
     if (! ptr) { \
@@ -871,8 +871,7 @@ ConfigBoron::ConfigBoron(const char* modulePath)
     {
     CDIEntry pakHead;
 
-    fp = cdi_openPak(modulePath, &pakHead);
-    if (! fp)
+    if (! cdi_mapPak(&pak, modulePath, &pakHead))
         errorFatal("Cannot open module %s", modulePath);
 
     if (pakHead.appId != CDI32('x','u','4', 1)) {
@@ -880,7 +879,7 @@ ConfigBoron::ConfigBoron(const char* modulePath)
         goto fail;
     }
 
-    toc = cdi_loadPakTOC(fp, &pakHead);
+    toc = cdi_mapPakTOC(&pak, &pakHead);
     NO_PTR(toc, "No module TOC");
     tocUsed = CDI_TOC_SIZE((&pakHead));
     }
@@ -889,7 +888,7 @@ ConfigBoron::ConfigBoron(const char* modulePath)
     // Load filename string table.
     ent = cdi_findAppId(toc, tocUsed, CDI32('F','N','A','M'));
     NO_PTR(ent, "Module FNAM not found");
-    fnamBuf = cdi_loadPakChunk(fp, ent);
+    fnamBuf = cdi_pakChunk(&pak, ent);
     NO_PTR(fnamBuf, "Read FNAM failed");
     cdi_initStringTable(&fnam, fnamBuf);
 
@@ -897,11 +896,11 @@ ConfigBoron::ConfigBoron(const char* modulePath)
     // Load config.
     {
     UCell* res;
-    uint8_t* confBuf;
+    const uint8_t* confBuf;
 
     ent = cdi_findAppId(toc, tocUsed, CDI32('C','O','N','F'));
     NO_PTR(ent, "Module CONF not found");
-    confBuf = cdi_loadPakChunk(fp, ent);
+    confBuf = cdi_pakChunk(&pak, ent);
     NO_PTR(confBuf, "Read CONF failed");
 
     res = ur_stackTop(ut);
@@ -914,12 +913,9 @@ ConfigBoron::ConfigBoron(const char* modulePath)
             error = "Serialized context not found";
     } else
         error = "Unserialize CONF failed";
-
-    free(confBuf);
     }
 
 fail:
-    fclose(fp);
     if (error)
         errorFatal(error);
 
@@ -995,6 +991,7 @@ fail:
             ++tile;
         }
         ts->tileCount = moduleId;
+        ts->computePassability();
     }
 
     // u4-save-ids
@@ -1069,8 +1066,7 @@ ConfigBoron::~ConfigBoron()
     ur_binFree(&evalBuf);
 
     boron_freeEnv( ut );
-    free(fnamBuf);
-    free(toc);
+    cdi_unmapPak(&pak);
     free(xcd.modulePath);
 }
 
@@ -1173,12 +1169,29 @@ static int lastChar(const char* str) {
 }
 
 /*
- * Return the CDIEntry pointer for a given source filename.
+ * Set view to the package chunk with the given application id.
+ */
+static bool chunkView(const ConfigBoron* cb, uint32_t appId, FileView* view) {
+    const CDIEntry* ent = cdi_findAppId(cb->toc, cb->tocUsed, appId);
+    if (ent) {
+        const uint8_t* data = cdi_pakChunk(&cb->pak, ent);
+        if (data) {
+            view->data  = data;
+            view->bytes = ent->bytes;
+            view->cdi   = ent->cdi;
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Get the view of a given source filename.
  */
-const CDIEntry* Config::fileEntry( const char* sourceFilename ) const {
+bool Config::sourceFile( const char* sourceFilename, FileView* view ) const {
     const CDIStringTable& st = CX->fnam;
     if (st.form != 1)
-        return NULL;
+        return false;
 
     const uint16_t* it  = st.index.f1;
     const uint16_t* end = it + st.count;
@@ -1194,28 +1207,28 @@ const CDIEntry* Config::fileEntry( const char* sourceFilename ) const {
                 b = 'M';
             }
             uint32_t appId = CDI32(a, b, (n >> 8), (n & 0xff));
-            return cdi_findAppId(CX->toc, CX->tocUsed, appId);
+            return chunkView(CX, appId, view);
         }
         ++n;
         ++it;
     }
-    return NULL;
+    return false;
 }
 
 /*
- * Return a CDIEntry pointer for the given image id (ImageInfo::filename)
+ * Get the view of the given image id (ImageInfo::filename)
  */
-const CDIEntry* Config::imageFile( const char* id ) const {
+bool Config::imageFile( const char* id, FileView* view ) const {
     uint32_t appId = CDI32(id[0], id[1], id[2], id[3]);
-    return cdi_findAppId(CX->toc, CX->tocUsed, appId);
+    return chunkView(CX, appId, view);
 }
 
 /*
- * Return a CDIEntry pointer for the given Map::id.
+ * Get the view of the given Map::id.
  */
-const CDIEntry* Config::mapFile( uint32_t id ) const {
+bool Config::mapFile( uint32_t id, FileView* view ) const {
     uint32_t appId = CDI32('M', 'A', (id >> 8), (id & 255));
-    return cdi_findAppId(CX->toc, CX->tocUsed, appId);
+    return chunkView(CX, appId, view);
 }
 
 /*
@@ -1336,6 +1349,8 @@ const UltimaSaveIds* Config::usaveIds() const {
 }
 
 extern bool loadMap(Map *map, FILE* sav);
+extern void mapResidencyUpdate(vector<Map*>& maps, Map* used);
+extern bool mapPrefetch(const vector<Map*>& maps, const Map* map);
 
 Map* Config::map(uint32_t id) {
     if (id >= CB->mapList.size())
@@ -1348,9 +1363,23 @@ Map* Config::map(uint32_t id) {
             errorFatal("loadMap failed to read \"%s\" (type %d)",
                        confString(rmap->fname), rmap->type);
     }
+    mapResidencyUpdate(CB->mapList, rmap);
     return rmap;
 }
 
+// Return true if the map data is loaded.
+bool Config::mapResident(uint32_t id) const {
+    return id < CB->mapList.size() && CB->mapList[id]->data;
+}
+
+// Begin loading map data ahead of its use.  Return true once map() can
+// be called without waiting on file I/O.  See mapPrefetch().
+bool Config::prefetchMap(uint32_t id) {
+    if (id >= CB->mapList.size())
+        return false;
+    return mapPrefetch(CB->mapList, CB->mapList[id]);
+}
+
 // Load map from saved game.
 Map* Config::restoreMap(uint32_t id) {
     if (id >= CB->mapList.size())
@@ -1372,6 +1401,7 @@ Map* Config::restoreMap(uint32_t id) {
             errorFatal("loadMap failed to read \"%s\" (type %d)",
                        confString(rmap->fname), rmap->type);
     }
+    mapResidencyUpdate(CB->mapList, rmap);
     return rmap;
 }
 
@@ -379,6 +379,7 @@ static Tileset* conf_tilesetLoad(ConfigXML* cfg, const ConfigElement& conf) {
         ++tile;
     }
     ts->tileCount = moduleId;
+    ts->computePassability();
     return ts;
 }
 
@@ -1326,6 +1327,8 @@ const UltimaSaveIds* Config::usaveIds() const {
 }
 
 extern bool loadMap(Map *map, FILE* sav);
+extern void mapResidencyUpdate(vector<Map*>& maps, Map* used);
+extern bool mapPrefetch(const vector<Map*>& maps, const Map* map);
 
 Map* Config::map(uint32_t id) {
     if (id >= CB->mapList.size())
@@ -1338,9 +1341,23 @@ Map* Config::map(uint32_t id) {
             errorFatal("loadMap failed to read \"%s\" (type %d)",
                        confString(rmap->fname), rmap->type);
     }
+    mapResidencyUpdate(CB->mapList, rmap);
     return rmap;
 }
 
+// Return true if the map data is loaded.
+bool Config::mapResident(uint32_t id) const {
+    return id < CB->mapList.size() && CB->mapList[id]->data;
+}
+
+// Begin loading map data ahead of its use.  Return true once map() can
+// be called without waiting on file I/O.  See mapPrefetch().
+bool Config::prefetchMap(uint32_t id) {
+    if (id >= CB->mapList.size())
+        return false;
+    return mapPrefetch(CB->mapList, CB->mapList[id]);
+}
+
 // Load map from saved game.
 Map* Config::restoreMap(uint32_t id) {
     if (id >= CB->mapList.size())
@@ -1362,6 +1379,7 @@ Map* Config::restoreMap(uint32_t id) {
             errorFatal("loadMap failed to read \"%s\" (type %d)",
                        confString(rmap->fname), rmap->type);
     }
+    mapResidencyUpdate(CB->mapList, rmap);
     return rmap;
 }
 
@@ -15,6 +15,13 @@
 #include "xu4.h"
 
 Dungeon::~Dungeon() {
+    freeRooms();
+}
+
+/**
+ * Deletes the rooms read by the map loader.
+ */
+void Dungeon::freeRooms() {
     if (roomMaps) {
         CombatMap** it  = roomMaps;
         CombatMap** end = it + n_rooms;
@@ -22,9 +29,11 @@ Dungeon::~Dungeon() {
             delete *it;
 
         delete[] roomMaps;
+        roomMaps = NULL;
     }
 
     delete[] rooms;
+    rooms = NULL;
 }
 
 /**
@@ -81,6 +81,7 @@ public:
 
     bool validTeleportLocation(const Coords& coords) const;
     uint8_t* fillRawMap();
+    void freeRooms();
 
     // Properties
     StringId name;
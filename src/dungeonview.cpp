@@ -37,7 +37,7 @@ DungeonView::DungeonView(int x, int y, int columns, int rows) : TileView(x, y, r
 /*
  * Sets coords relative to party and fills tiles from that location.
  */
-static void dungeonGetTiles(Coords& coords, std::vector<MapTile>& tiles,
+static void dungeonGetTiles(Coords& coords, TileStack& tiles,
                             int fwd, int side) {
     coords = c->location->coords;
 
@@ -80,7 +80,7 @@ void DungeonView::display(Context * c, TileView *view)
 {
     static const int8_t wallSides[3] = { -1, 1, 0 };
     Dungeon* dungeon = dynamic_cast<Dungeon *>(c->location->map);
-    vector<MapTile> tiles;
+    TileStack tiles;
     Coords drawLoc;
     int x, y;
 
@@ -91,7 +91,7 @@ void DungeonView::display(Context * c, TileView *view)
 
         screenEraseMapArea();
         if (c->party->getTorchDuration() > 0) {
-            vector<MapTile> distant_tiles;
+            TileStack distant_tiles;
 
             for (y = 3; y >= 0; y--) {
                 DungeonGraphicType type;
@@ -288,7 +288,7 @@ int DungeonView::graphicIndex(const Coords& loc, int xoffset, int distance,
 }
 
 DungeonGraphicType DungeonView::tilesToGraphic(const Dungeon* dungeon,
-                                        const std::vector<MapTile> &tiles) {
+                                        const TileStack &tiles) {
     MapTile tile = tiles.front();
 
     /*
@@ -41,7 +41,7 @@ private:
     int graphicIndex(const Coords& loc, int xoffset, int distance,
                      Direction orientation, DungeonGraphicType type);
     DungeonGraphicType tilesToGraphic(const Dungeon*,
-                                      const std::vector<MapTile> &tiles);
+                                      const TileStack &tiles);
     void drawWall(int graphic);
 
     struct GraphicData {
@@ -3,6 +3,7 @@
  */
 
 #include <cctype>
+#include <cmath>
 #include <cstring>
 #include <list>
 
@@ -14,31 +15,43 @@
 #include "location.h"
 #include "savegame.h"
 #include "screen.h"
+#include "settings.h"
 #include "textview.h"
 #include "xu4.h"
+#include "support/profiler.h"
+
+extern bool verbose;
 
 /**
  * Constructs the event handler object.
  */
-EventHandler::EventHandler(int gameCycleDuration, int frameDuration) :
+EventHandler::EventHandler(int gameCycleDuration, int frameDuration,
+                           int frameSync) :
     timerInterval(gameCycleDuration),
     frameInterval(frameDuration),
+    frameSync(frameSync),
     runRecursion(0),
     updateScreen(NULL)
 {
     controllerDone = ended = false;
     anim_init(&flourishAnim, 64, NULL, NULL);
     anim_init(&fxAnim, 32, NULL, NULL);
-#ifdef DEBUG
+    realTime = runTime = 0;
+    frameDeadline = frameStamp = inputStamp = 0;
+    frameDebt = 0;
+    renderDelta = float(frameDuration) * 0.001f;
+    frameTimes.clear();
+    inputLatency.clear();
     recordFP = -1;
     recordMode = 0;
-#endif
 }
 
 EventHandler::~EventHandler() {
-#ifdef DEBUG
+    if (verbose) {
+        frameTimes.report("frame time");
+        inputLatency.report("input latency");
+    }
     endRecording();
-#endif
     anim_free(&flourishAnim);
     anim_free(&fxAnim);
 }
@@ -156,6 +169,171 @@ void EventHandler::setScreenUpdate(void (*updateFunc)(void)) {
 
 #include "support/getTicks.c"
 
+// Time before a frame deadline which is spent polling rather than sleeping
+// to absorb the scheduler wakeup latency.
+#ifdef _WIN32
+#define FRAME_SPIN_USEC 2000
+#else
+#define FRAME_SPIN_USEC 500
+#endif
+
+// Limit on game frames run to catch up after a stall when the frame rate
+// is not fixed.
+#define FRAME_STEPS_MAX 4
+
+static void sleepUntil(uint64_t deadline) {
+    uint64_t now;
+    while ((now = getMicroTicks()) < deadline) {
+        uint64_t remain = deadline - now;
+        usecSleep((remain > FRAME_SPIN_USEC) ? remain - FRAME_SPIN_USEC : 0);
+    }
+}
+
+void FrameHistogram::clear() {
+    memset(this, 0, sizeof(FrameHistogram));
+}
+
+void FrameHistogram::add(uint32_t usec) {
+    uint32_t bin = usec / 1000;
+    ++bins[(bin < FRAME_HIST_BINS) ? bin : FRAME_HIST_BINS - 1];
+    ++count;
+    sum += usec;
+    sumSq += uint64_t(usec) * usec;
+    if (max < usec)
+        max = usec;
+}
+
+/*
+ * Print the distribution summary and the non-empty bins to stdout.
+ * Percentiles are given as the upper bound of the bin they fall in.
+ */
+void FrameHistogram::report(const char* name) const {
+    static const uint32_t pct[3] = { 50, 95, 99 };
+    int pbin[3] = { FRAME_HIST_BINS, FRAME_HIST_BINS, FRAME_HIST_BINS };
+    uint64_t acc = 0;
+    int i, n = 0;
+
+    if (! count)
+        return;
+    for (i = 0; i < FRAME_HIST_BINS && n < 3; ++i) {
+        acc += bins[i];
+        while (n < 3 && acc * 100 >= uint64_t(count) * pct[n])
+            pbin[n++] = i + 1;
+    }
+
+    double mean = double(sum) / count;
+    double var  = double(sumSq) / count - mean * mean;
+    printf("%s: %u frames, mean %.2f ms, stddev %.2f ms, "
+           "p50 %d ms, p95 %d ms, p99 %d ms, max %.2f ms\n  ms:",
+           name, count, mean * 0.001, sqrt(var > 0.0 ? var : 0.0) * 0.001,
+           pbin[0], pbin[1], pbin[2], max * 0.001);
+    for (i = 0; i < FRAME_HIST_BINS; ++i) {
+        if (bins[i])
+            printf(" %d%s:%u", i, (i == FRAME_HIST_BINS - 1) ? "+" : "",
+                   bins[i]);
+    }
+    printf("\n");
+}
+
+/*
+ * Reset the frame schedule at the start of the outermost run loop.
+ */
+void EventHandler::beginFrames() {
+    runTime = 0;
+    if (! xu4.headless) {
+        frameStamp = frameDeadline = getMicroTicks();
+        frameDebt = 0;
+    }
+}
+
+/*
+ * Run one game frame.  Recorded keys are delivered here so that a replay
+ * sees them on the same frame regardless of the display rate.
+ */
+void EventHandler::advanceGameFrame(Controller* waitCon,
+                                    updateScreenCallback update) {
+    int key;
+    while ((key = recordedKey())) {
+        Controller* con = waitCon ? waitCon : getController();
+        if (con->notifyKeyPressed(key) && update)
+            (*update)();
+    }
+    recordTick();
+    if (runTime >= timerInterval) {
+        runTime -= timerInterval;
+        timedEvents.tick();
+    }
+    runTime += frameInterval;
+}
+
+/*
+ * Display the rendered frame and record its timing.
+ */
+void EventHandler::presentFrame() {
+    uint64_t now, elapsed;
+
+    screenShowProfile();
+    screenSwapBuffers();
+
+    now = getMicroTicks();
+    if (inputStamp) {
+        inputLatency.add(uint32_t(now - inputStamp));
+        inputStamp = 0;
+    }
+    if (frameStamp) {
+        elapsed = now - frameStamp;
+        frameTimes.add(uint32_t(elapsed));
+        if (frameSync != FrameSync_Fixed) {
+            frameDebt += uint32_t(elapsed);
+            renderDelta = (elapsed < 250000) ? float(elapsed) * 1e-6f : 0.25f;
+        }
+    }
+    frameStamp = now;
+}
+
+/*
+ * Change the FrameSync mode, e.g. when the display is recreated.
+ */
+void EventHandler::setFrameSync(int mode) {
+    if (mode != frameSync) {
+        frameSync = mode;
+        frameDebt = 0;
+        frameDeadline = getMicroTicks();
+        renderDelta = float(frameInterval) * 0.001f;
+    }
+}
+
+/*
+ * Wait until the next frame is due.  With the fixed rate this sleeps to an
+ * absolute deadline so that frame times do not drift.  Otherwise the buffer
+ * swap has done any waiting and the elapsed time is converted to game frames.
+ *
+ * \return Number of game frames to run before the next frame is presented.
+ */
+int EventHandler::waitFrame() {
+    uint64_t period = uint64_t(frameInterval) * 1000;
+    uint64_t now;
+    uint32_t steps;
+
+    if (frameSync == FrameSync_Fixed) {
+        frameDeadline += period;
+        now = getMicroTicks();
+        if (now < frameDeadline)
+            sleepUntil(frameDeadline);
+        else if (now - frameDeadline > period)
+            frameDeadline = now;    // Fell behind; do not try to catch up.
+        return 1;
+    }
+
+    steps = frameDebt / period;
+    if (steps > FRAME_STEPS_MAX) {
+        frameDebt = 0;
+        return FRAME_STEPS_MAX;
+    }
+    frameDebt -= steps * period;
+    return steps;
+}
+
 /**
  * Delays program execution for the specified number of milliseconds.
  * This doesn't actually stop events, but it stops the user from interacting
@@ -170,32 +348,37 @@ void EventHandler::setScreenUpdate(void (*updateFunc)(void)) {
 bool EventHandler::wait_msecs(unsigned int msec) {
     Controller waitCon;     // Base controller consumes key events.
     EventHandler* eh = xu4.eventHandler;
-    uint32_t waitTime = getTicks() + msec;
-    uint32_t now, elapsed;
+    uint32_t waitTime = eh->realTime + msec;
+    uint64_t waitUsec = getMicroTicks() + uint64_t(msec) * 1000;
+    int steps = 1;
 
     while (! eh->ended) {
-        eh->handleInputEvents(&waitCon, NULL);
-#ifdef DEBUG
-        int key;
-        while ((key = eh->recordedKey()))
-            waitCon.notifyKeyPressed(key);
-        eh->recordTick();
-#endif
-        if (eh->runTime >= eh->timerInterval) {
-            eh->runTime -= eh->timerInterval;
-            eh->timedEvents.tick();
+        int frameZone = prof_begin("waitFrame");
+        if (! xu4.headless)
+            eh->handleInputEvents(&waitCon, NULL);
+        for (; steps; --steps)
+            eh->advanceGameFrame(&waitCon, NULL);
+
+        if (xu4.headless) {
+            prof_end(frameZone);
+            prof_frame();
+
+            // Advance the clock by one frame without waiting.
+            eh->replayTurnCheck();
+            eh->realTime += eh->frameInterval;
+            if (eh->realTime >= waitTime)
+                break;
+            steps = 1;
+            continue;
         }
-        eh->runTime += eh->frameInterval;
 
-        screenSwapBuffers();
+        eh->presentFrame();
+        prof_end(frameZone);
+        prof_frame();
 
-        now = getTicks();
-        elapsed = now - eh->realTime;
-        eh->realTime = now;
-        if (now >= waitTime)    // Break only after realTime is updated.
+        if (getMicroTicks() >= waitUsec)
             break;
-        if (elapsed+2 < eh->frameInterval)
-            msecSleep(eh->frameInterval - elapsed);
+        steps = eh->waitFrame();
     }
 
     return eh->ended;
@@ -208,47 +391,41 @@ bool EventHandler::wait_msecs(unsigned int msec) {
  * \return true if game should exit.
  */
 bool EventHandler::run() {
-    uint32_t now, elapsed;
+    int steps = 1;
 
     if (updateScreen)
         (*updateScreen)();
 
-    if (! runRecursion) {
-        runTime = 0;
-        realTime = getTicks();
-    }
+    if (! runRecursion)
+        beginFrames();
     ++runRecursion;
 
     while (! ended && ! controllerDone) {
-        handleInputEvents(NULL, updateScreen);
-#ifdef DEBUG
-        int key;
-        while ((key = recordedKey())) {
-            if (getController()->notifyKeyPressed(key) && updateScreen)
-                (*updateScreen)();
-        }
-        recordTick();
-#endif
-        if (runTime >= timerInterval) {
-            runTime -= timerInterval;
-            timedEvents.tick();
+        int frameZone = prof_begin("frame");
+        if (! xu4.headless)
+            handleInputEvents(NULL, updateScreen);
+        for (; steps && ! controllerDone; --steps)
+            advanceGameFrame(NULL, updateScreen);
+
+        if (xu4.headless) {
+            prof_end(frameZone);
+            prof_frame();
+            replayTurnCheck();
+            realTime += frameInterval;
+            steps = 1;
+            continue;
         }
-        runTime += frameInterval;
-
-        screenSwapBuffers();
 
-        now = getTicks();
-        elapsed = now - realTime;
-        realTime = now;
-        if (elapsed+2 < frameInterval)
-            msecSleep(frameInterval - elapsed);
+        presentFrame();
+        prof_end(frameZone);
+        prof_frame();
+        steps = waitFrame();
     }
 
     --runRecursion;
     return ended;
 }
 
-#ifdef DEBUG
 #include <fcntl.h>
 
 #ifdef _WIN32
@@ -328,6 +505,8 @@ void EventHandler::endRecording() {
 //void EventHandler::recordMouse(int x, int y, int button) {}
 
 void EventHandler::recordKey(int key) {
+    if (! inputStamp)
+        inputStamp = getMicroTicks();
     if (recordMode == MODE_RECORD) {
         RecordKey rec;
         rec.op    = (key > 0xff) ? RECORD_KEY1 : RECORD_KEY;
@@ -368,6 +547,10 @@ int EventHandler::recordedKey() {
                 recordLast = recordClock + rec.delay;
             } else {
                 endRecording();
+                if (xu4.headless) {
+                    replayReport();
+                    quitGame();
+                }
             }
         }
     }
@@ -386,6 +569,9 @@ uint32_t EventHandler::replay(const char* file) {
     recordClock = recordLast = 0;
     recordMode = MODE_DISABLED;
     replayKey = 0;
+    replayMoves = 0;
+    replayTurns = 0;
+    replayStart = replayTurnStart = getMicroTicks();
 
     if (recordFP >= 0)
         close(recordFP);
@@ -402,7 +588,57 @@ uint32_t EventHandler::replay(const char* file) {
     recordMode = MODE_REPLAY;
     return head[1];
 }
-#endif
+
+/*
+ * Return a hash of the game state for checking that a replay reaches the
+ * same result each time.
+ */
+static uint32_t replayStateHash() {
+    const uint8_t* it;
+    const uint8_t* end;
+    uint32_t hash = 2166136261u;    // FNV-1a
+
+#define HASH_BYTES(ptr, len) \
+    it  = (const uint8_t*) (ptr); \
+    end = it + (len); \
+    for (; it != end; ++it) \
+        hash = (hash ^ *it) * 16777619u
+
+    if (c && c->saveGame) {
+        HASH_BYTES(c->saveGame, sizeof(SaveGame));
+    }
+    if (c && c->location) {
+        MapId mid = c->location->map->id;
+        HASH_BYTES(&mid, sizeof(mid));
+        HASH_BYTES(&c->location->coords, sizeof(Coords));
+    }
+    return hash;
+}
+
+/*
+ * Print the time taken by the last game turn when running headless.
+ */
+void EventHandler::replayTurnCheck() {
+    if (c && c->saveGame && c->saveGame->moves != replayMoves) {
+        uint64_t now = getMicroTicks();
+        if (replayTurns)
+            printf("turn %u: %.3f ms\n", replayMoves,
+                   double(now - replayTurnStart) * 0.001);
+        replayMoves = c->saveGame->moves;
+        replayTurnStart = now;
+        ++replayTurns;
+    }
+}
+
+/*
+ * Print the replay totals and final state hash when running headless.
+ */
+void EventHandler::replayReport() {
+    double ms = double(getMicroTicks() - replayStart) * 0.001;
+    printf("replay: %u turns in %.3f ms (%.3f ms/turn), state hash %08x\n",
+           replayTurns, ms, replayTurns ? ms / replayTurns : 0.0,
+           replayStateHash());
+}
 
 
 //----------------------------------------------------------------------------
@@ -731,6 +967,9 @@ bool EventHandler::globalKeyHandler(int key) {
 #endif
         xu4.eventHandler->quitGame();
         return true;
+    case U4_ALT + 'p': /* Alt+p */
+        screenToggleProfile();
+        return true;
     default: return false;
     }
 }
@@ -183,6 +183,24 @@ private:
 
 typedef void(*updateScreenCallback)(void);
 
+#define FRAME_HIST_BINS 64
+
+/**
+ * Histogram of frame timings with one millisecond bins.  The last bin
+ * counts everything longer.
+ */
+struct FrameHistogram {
+    uint32_t bins[FRAME_HIST_BINS];
+    uint32_t count;
+    uint64_t sum;               // Microseconds.
+    uint64_t sumSq;
+    uint32_t max;
+
+    void clear();
+    void add(uint32_t usec);
+    void report(const char* name) const;
+};
+
 /**
  * A class for handling game events.
  */
@@ -192,7 +210,7 @@ public:
     typedef std::list<_MouseArea*> MouseAreaList;
 
     /* Constructors */
-    EventHandler(int gameCycleDuration, int frameDuration);
+    EventHandler(int gameCycleDuration, int frameDuration, int frameSync);
     ~EventHandler();
 
     /* Static functions */
@@ -234,37 +252,55 @@ public:
     _MouseArea* getMouseAreaSet() const;
     _MouseArea* mouseAreaForPoint(int x, int y);
 
-#ifdef DEBUG
     bool beginRecording(const char* file, uint32_t seed);
     void endRecording();
     void recordKey(int key);
     int  recordedKey();
     void recordTick() { ++recordClock; }
     uint32_t replay(const char* file);
-#endif
+    void replayTurnCheck();
+    void replayReport();
 
     void advanceFlourishAnim() {
         anim_advance(&flourishAnim, float(timerInterval) * 0.001f);
     }
 
+    /** Returns the seconds elapsed between the last two displayed frames. */
+    float frameDelta() const { return renderDelta; }
+    void setFrameSync(int mode);
+
     Animator flourishAnim;
     Animator fxAnim;
 
 protected:
     void handleInputEvents(Controller*, updateScreenCallback);
+    void beginFrames();
+    void advanceGameFrame(Controller*, updateScreenCallback);
+    void presentFrame();
+    int  waitFrame();
 
     uint32_t timerInterval;     // Milliseconds between timedEvents ticks.
-    uint32_t frameInterval;     // Milliseconds between display updates.
+    uint32_t frameInterval;     // Milliseconds between game frames.
     uint32_t realTime;
     uint32_t runTime;
+    uint64_t frameDeadline;     // Microseconds; when the next frame is due.
+    uint64_t frameStamp;        // Microseconds; when the last frame was shown.
+    uint64_t inputStamp;        // Microseconds; first unshown input event.
+    uint32_t frameDebt;         // Microseconds of game time not yet run.
+    float renderDelta;
+    int frameSync;
+    FrameHistogram frameTimes;
+    FrameHistogram inputLatency;
     int runRecursion;
-#ifdef DEBUG
     int recordFP;
     int recordMode;
     int replayKey;
     uint32_t recordClock;
     uint32_t recordLast;
-#endif
+    uint32_t replayMoves;       // Game turn seen by replayTurnCheck().
+    uint32_t replayTurns;
+    uint64_t replayStart;       // Microseconds.
+    uint64_t replayTurnStart;
     bool controllerDone;
     bool ended;
     TimedEventMgr timedEvents;
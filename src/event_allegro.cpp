@@ -91,9 +91,7 @@ static void handleKeyDownEvent(const ALLEGRO_EVENT* event,
             break;
     }
 
-#ifdef DEBUG
     xu4.eventHandler->recordKey(key);
-#endif
 
     if (verbose) {
         printf("key event: unicode = %d, sym = %d, mod = %d; translated = %d\n",
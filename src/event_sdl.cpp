@@ -91,9 +91,7 @@ static void handleKeyDownEvent(const SDL_Event &event, Controller *controller, u
         key = U4_FKEY + (event.key.keysym.sym - SDLK_F1);
 #endif
 
-#ifdef DEBUG
     xu4.eventHandler->recordKey(key);
-#endif
 
     if (verbose)
         printf("key event: unicode = %d, sym = %d, mod = %d; translated = %d\n",
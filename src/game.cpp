@@ -558,6 +558,8 @@ void GameController::finishTurn() {
         screenUpdate(&this->mapArea, true, false);
         screenWait(1);
 
+        portalPrefetch(c->location);
+
         /* Creatures cannot spawn, move or attack while the avatar is on the balloon */
         if (!c->party->isFlying()) {
 
@@ -1,14 +1,34 @@
+#ifndef GPU_H
+#define GPU_H
+
 #include <stdint.h>
+#include "image32.h"
 
 struct BlockingGroups;
 class Map;
 class TileView;
 
-const char* gpu_init(void* res, int w, int h, int scale, int filter);
+struct GpuChunkStats {
+    uint32_t hits;          // Chunk geometry found in the cache.
+    uint32_t misses;        // Chunk built on the frame it was first drawn.
+    uint32_t prefetched;    // Chunk built ahead of the view.
+    uint32_t evicted;       // Cached chunk replaced by another.
+};
+
+struct GpuStreamStats {
+    uint32_t maps;          // Draw list regions mapped for writing.
+    uint32_t unsynced;      // Mapped without waiting for the GPU.
+    uint32_t waits;         // Had to wait for the GPU to finish reading.
+};
+
+const char* gpu_init(void* res, int w, int h, int scale, int filter,
+                     int chunkCache);
 void     gpu_free(void* res);
 void     gpu_viewport(int x, int y, int w, int h);
 uint32_t gpu_makeTexture(const Image32* img);
 void     gpu_blitTexture(uint32_t tex, int x, int y, const Image32* img);
+void     gpu_blitTextureRect(uint32_t tex, const Image32* img,
+                             int x, int y, int w, int h);
 void     gpu_freeTexture(uint32_t id);
 uint32_t gpu_screenTexture(void* res);
 void     gpu_setTilesTexture(void* res, uint32_t tex, uint32_t mat, float vDim);
@@ -23,6 +43,11 @@ void     gpu_drawTris(void* res, int list);
 float*   gpu_emitQuad(float* attr, const float* drawRect, const float* uvRect);
 //void     gpu_render(void* res, const Image* screen);
 void     gpu_resetMap(void* res, const Map* map);
+void     gpu_updateMapTile(void* res, int x, int y);
 void     gpu_drawMap(void* res, const TileView* view, const float* tileUVs,
                      const BlockingGroups* blocks,
-                     int cx, int cy, float scale);
+                     int cx, int cy, float scale, int travelDir);
+const GpuChunkStats* gpu_chunkStats(void* res);
+const GpuStreamStats* gpu_streamStats(void* res);
+
+#endif
@@ -21,9 +21,11 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include "direction.h"
 #include "tileanim.h"
 #include "tileset.h"
 #include "tileview.h"
+#include "support/profiler.h"
 
 //#include "gpu_opengl.h"
 
@@ -36,6 +38,7 @@ extern uint32_t getTicks();
 
 #define LOC_POS     0
 #define LOC_UV      1
+#define LOC_TILE    2
 
 const char* solid_vertShader =
     "#version 330\n"
@@ -95,6 +98,15 @@ static const float quadAttr[] = {
    -1.0,-1.0, 0.0,   0.0, 1.0, 0.0, 0.0
 };
 
+#ifdef GPU_RENDER
+// Map tile corners drawn as a triangle strip for each TileId instance.
+static const float tileCorners[] = {
+    0.0, 0.0,  1.0, 0.0,  0.0, 1.0,  1.0, 1.0
+};
+
+#define TILE_TABLE_W    256     // Texels per row of tileTableTex.
+#endif
+
 static const uint8_t whitePixels[] = {
     0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff,
     0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff
@@ -102,6 +114,10 @@ static const uint8_t whitePixels[] = {
 
 #define SHADOW_DIM      512
 
+// Sets the size of the shadowcast.glsl shapes array.
+#define SHAPES_DEFINE_(N)   "#define MAX_SHAPES " #N "\n"
+#define SHAPES_DEFINE(N)    SHAPES_DEFINE_(N)
+
 
 #ifdef _WIN32
 #include "glad.c"
@@ -212,24 +228,16 @@ static int compileShaders(GLuint program, const char* vert, const char* frag)
 static char* readShader(const char* filename)
 {
 #ifdef CONF_MODULE
-    const CDIEntry* ent = xu4.config->fileEntry(filename);
-    if (! ent)
+    FileView view;
+    if (! xu4.config->sourceFile(filename, &view))
         return NULL;
 
-    char* buf = (char*) malloc(ent->bytes + 1);
+    // Copy to add the nul terminator expected by glShaderSource.
+    char* buf = (char*) malloc(view.bytes + 1);
     if (buf) {
-        FILE* fp = fopen(xu4.config->modulePath(), "rb");
-        if (fp) {
-            fseek(fp, ent->offset, SEEK_SET);
-
-            size_t len = fread(buf, 1, ent->bytes, fp);
-            fclose(fp);
-            if (len == ent->bytes) {
-                buf[len] = '\0';
-                return buf;
-            }
-        }
-        free(buf);
+        memcpy(buf, view.data, view.bytes);
+        buf[view.bytes] = '\0';
+        return buf;
     }
 #else
     char fnBuf[40];
@@ -257,9 +265,10 @@ static char* readShader(const char* filename)
 /*
  * Returns zero on success or 1-4 to indicate compile/link/read error.
  */
-static int compileSLFile(GLuint program, const char* filename, int scale)
+static int compileSLFile(GLuint program, const char* filename, int scale,
+                         const char* defines = "")
 {
-    const char* src[4];
+    const char* src[6];
     int res = 4;
     char* buf = readShader(filename);
 
@@ -271,11 +280,13 @@ static int compileSLFile(GLuint program, const char* filename, int scale)
         }
 
         src[0] = "#version 330\n#define VERTEX\n";
-        src[1] = buf;
-        src[2] = "#version 330\n#define FRAGMENT\n";
-        src[3] = buf;
+        src[1] = defines;
+        src[2] = buf;
+        src[3] = "#version 330\n#define FRAGMENT\n";
+        src[4] = defines;
+        src[5] = buf;
 
-        res = compileShaderParts(program, src, 2, 2);
+        res = compileShaderParts(program, src, 3, 3);
         free(buf);
     }
     return res;
@@ -293,6 +304,22 @@ static void _defineAttributeLayout(GLuint vao, GLuint vbo)
 }
 
 #ifdef GPU_RENDER
+/*
+ * Define the layout for instanced map tiles.  The corner buffer is shared
+ * by all chunks while tileVbo holds one TileId per instance.
+ */
+static void _defineTileLayout(GLuint vao, GLuint cornerVbo, GLuint tileVbo)
+{
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, cornerVbo);
+    glEnableVertexAttribArray(LOC_POS);
+    glVertexAttribPointer(LOC_POS, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, tileVbo);
+    glEnableVertexAttribArray(LOC_TILE);
+    glVertexAttribIPointer(LOC_TILE, 1, GL_UNSIGNED_SHORT, 0, 0);
+    glVertexAttribDivisor(LOC_TILE, 1);
+}
+
 static GLuint _makeFramebuffer(GLuint texId)
 {
     GLuint fbo;
@@ -337,11 +364,10 @@ extern Image* loadImage_png(U4FILE *file);
 static GLuint loadTexture(const char* file, GLuint useTex)
 {
     GLuint texId = 0;
-    const CDIEntry* ent = xu4.config->fileEntry(file);
-    if (ent) {
-        U4FILE* uf = u4fopen_stdio(xu4.config->modulePath());
+    FileView view;
+    if (xu4.config->sourceFile(file, &view)) {
+        U4FILE* uf = u4fopen_mem(view.data, view.bytes);
         if (uf) {
-            u4fseek(uf, ent->offset, SEEK_SET);
             Image* img = loadImage_png(uf);
             u4fclose(uf);
             if (img) {
@@ -372,17 +398,27 @@ static GLuint loadHQXTableImage(int scale)
 }
 
 #ifdef GPU_RENDER
-static void reserveDrawList(const GLuint* vbo, int byteSize)
+/*
+ * Allocate the stream buffer with STREAM_REGIONS regions for each draw list.
+ */
+static void reserveDrawLists(GLuint vbo, DrawList* dl, int count)
 {
-    int i;
-    for (i = 0; i < 2; ++i) {
-        glBindBuffer(GL_ARRAY_BUFFER, vbo[i]);
-        glBufferData(GL_ARRAY_BUFFER, byteSize, NULL, GL_DYNAMIC_DRAW);
+    int i, size = 0;
+    for (i = 0; i < count; ++i) {
+        dl[i].base = size;
+        size += dl[i].byteSize * STREAM_REGIONS;
     }
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
 }
 #endif
 
-const char* gpu_init(void* res, int w, int h, int scale, int filter)
+/*
+ * \param chunkCache   Number of map chunk vertex buffers to keep cached.
+ *                     This is clamped to CHUNK_CACHE_MIN - CHUNK_CACHE_MAX.
+ */
+const char* gpu_init(void* res, int w, int h, int scale, int filter,
+                     int chunkCache)
 {
     OpenGLResources* gr = (OpenGLResources*) res;
     GLuint sh;
@@ -401,12 +437,15 @@ const char* gpu_init(void* res, int w, int h, int scale, int filter)
     gr->tilesTex = 0;
     */
 #ifdef GPU_RENDER
-    gr->dl[0].buf = GLOB_DRAW_LIST0;
     gr->dl[0].byteSize = ATTR_STRIDE * 6 * 400;
-    gr->dl[1].buf = GLOB_FX_LIST0;
     gr->dl[1].byteSize = ATTR_STRIDE * 6 * 20;
-    gr->dl[2].buf = GLOB_MAPFX_LIST0;
     gr->dl[2].byteSize = ATTR_STRIDE * 6 * 8;
+
+    if (chunkCache < CHUNK_CACHE_MIN)
+        chunkCache = CHUNK_CACHE_MIN;
+    else if (chunkCache > CHUNK_CACHE_MAX)
+        chunkCache = CHUNK_CACHE_MAX;
+    gr->mapChunkCount = chunkCache;
 #endif
 
 #ifdef DEBUG_GL
@@ -510,7 +549,8 @@ const char* gpu_init(void* res, int w, int h, int scale, int filter)
 
     // Create shadowcast shader.
     gr->shadow = sh = glCreateProgram();
-    if (compileSLFile(sh, "shadowcast.glsl", 0))
+    if (compileSLFile(sh, "shadowcast.glsl", 0,
+                      SHAPES_DEFINE(BLOCKING_SHAPES_MAX)))
         return "shadowcast.glsl";
 
     gr->shadowTrans  = glGetUniformLocation(sh, "transform");
@@ -538,6 +578,29 @@ const char* gpu_init(void* res, int w, int h, int scale, int filter)
     glUniform1i(mmap, GTU_MATERIAL);
     glUniform1i(noise, GTU_NOISE);
     glUniform1i(gr->worldShadowMap, GTU_SHADOW);
+
+
+    // Create world shader variant for instanced map tiles.
+    gr->shadeTiles = sh = glCreateProgram();
+    if (compileSLFile(sh, "world.glsl", 0, "#define TILE_INSTANCE\n"))
+        return "world.glsl (tiles)";
+
+    gr->tilesTrans     = glGetUniformLocation(sh, "transform");
+    gr->tilesScroll    = glGetUniformLocation(sh, "scroll");
+    gr->tilesChunkDim  = glGetUniformLocation(sh, "chunkDim");
+
+    glUseProgram(sh);
+    glUniformMatrix4fv(gr->tilesTrans, 1, GL_FALSE, unitMatrix);
+    glUniform1i(glGetUniformLocation(sh, "cmap"), GTU_CMAP);
+    glUniform1i(glGetUniformLocation(sh, "mmap"), GTU_MATERIAL);
+    glUniform1i(glGetUniformLocation(sh, "noise2D"), GTU_NOISE);
+    glUniform1i(glGetUniformLocation(sh, "shadowMap"), GTU_SHADOW);
+    glUniform1i(glGetUniformLocation(sh, "tileTable"), GTU_TILE_TABLE);
+
+    glGenTextures(1, &gr->tileTableTex);
+    glBindTexture(GL_TEXTURE_2D, gr->tileTableTex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 #endif
 
 
@@ -545,10 +608,8 @@ const char* gpu_init(void* res, int w, int h, int scale, int filter)
     glGenBuffers(GLOB_COUNT, gr->vbo);
 
 #ifdef GPU_RENDER
-    // Reserve space in the double-buffered draw lists.
-    reserveDrawList(gr->vbo + GLOB_DRAW_LIST0, gr->dl[0].byteSize);
-    reserveDrawList(gr->vbo + GLOB_FX_LIST0,   gr->dl[1].byteSize);
-    reserveDrawList(gr->vbo + GLOB_MAPFX_LIST0,gr->dl[2].byteSize);
+    // Reserve space for the draw lists.
+    reserveDrawLists(gr->vbo[GLOB_STREAM], gr->dl, 3);
 #endif
 
     // Create quad geometry.
@@ -559,6 +620,20 @@ const char* gpu_init(void* res, int w, int h, int scale, int filter)
     glGenVertexArrays(GLOB_COUNT, gr->vao);
     for(int i = 0; i < GLOB_COUNT; ++i)
         _defineAttributeLayout(gr->vao[i], gr->vbo[i]);
+
+#ifdef GPU_RENDER
+    // Create map chunk buffers.  Storage is allocated by gpu_resetMap().
+    glGenBuffers(1, &gr->tileCornerVbo);
+    glBindBuffer(GL_ARRAY_BUFFER, gr->tileCornerVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(tileCorners), tileCorners,
+                 GL_STATIC_DRAW);
+
+    glGenBuffers(gr->mapChunkCount, gr->mapChunkVbo);
+    glGenVertexArrays(gr->mapChunkCount, gr->mapChunkVao);
+    for(int i = 0; i < gr->mapChunkCount; ++i)
+        _defineTileLayout(gr->mapChunkVao[i], gr->tileCornerVbo,
+                          gr->mapChunkVbo[i]);
+#endif
     glBindVertexArray(0);
 
     return NULL;
@@ -577,8 +652,19 @@ void gpu_free(void* res)
     glDeleteBuffers(GLOB_COUNT, gr->vbo);
     glDeleteProgram(gr->shadeColor);
 #ifdef GPU_RENDER
+    for (int i = 0; i < 3; ++i) {
+        for (int r = 0; r < STREAM_REGIONS; ++r) {
+            if (gr->dl[i].fence[r])
+                glDeleteSync(gr->dl[i].fence[r]);
+        }
+    }
+    glDeleteVertexArrays(gr->mapChunkCount, gr->mapChunkVao);
+    glDeleteBuffers(gr->mapChunkCount, gr->mapChunkVbo);
+    glDeleteBuffers(1, &gr->tileCornerVbo);
+    glDeleteTextures(1, &gr->tileTableTex);
     glDeleteProgram(gr->shadeSolid);
     glDeleteProgram(gr->shadeWorld);
+    glDeleteProgram(gr->shadeTiles);
     glDeleteProgram(gr->shadow);
     glDeleteFramebuffers(1, &gr->shadowFbo);
 #endif
@@ -605,6 +691,20 @@ void gpu_blitTexture(uint32_t tex, int x, int y, const Image32* img)
                     GL_RGBA, GL_UNSIGNED_BYTE, img->pixels);
 }
 
+/*
+ * Copy a region of an image to the same location in a texture which has the
+ * same dimensions as the image.
+ */
+void gpu_blitTextureRect(uint32_t tex, const Image32* img,
+                         int x, int y, int w, int h)
+{
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, img->w);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h,
+                    GL_RGBA, GL_UNSIGNED_BYTE, img->pixels + y*img->w + x);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+}
+
 void gpu_freeTexture(uint32_t tex)
 {
     glDeleteTextures(1, &tex);
@@ -688,7 +788,12 @@ void gpu_setScissor(int* box)
 }
 
 /*
- * Begin adding triangles to a double-buffered draw list.
+ * Begin adding triangles to a draw list.
+ *
+ * Each list cycles through STREAM_REGIONS regions of the stream buffer.
+ * A region is mapped unsynchronized once the fence placed when it was last
+ * drawn has signaled, so the driver never has to stall waiting for the GPU
+ * to finish with the whole buffer.
  *
  * Returns a pointer to the start of the attributes buffer.
  * This should be advanced and passed to gpu_endTris() when all triangles
@@ -700,11 +805,32 @@ float* gpu_beginTris(void* res, int list)
 {
     OpenGLResources* gr = (OpenGLResources*) res;
     DrawList* dl = gr->dl + list;
-
-    dl->buf ^= 1;
-    glBindBuffer(GL_ARRAY_BUFFER, gr->vbo[ dl->buf ]);
-    gr->dptr = (GLfloat*) glMapBufferRange(GL_ARRAY_BUFFER, 0, dl->byteSize,
-                                           GL_MAP_WRITE_BIT);
+    GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+                        GL_MAP_UNSYNCHRONIZED_BIT;
+    GLsync fence;
+
+    if (++dl->region == STREAM_REGIONS)
+        dl->region = 0;
+
+    ++gr->streamStats.maps;
+    fence = dl->fence[dl->region];
+    if (fence) {
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            ++gr->streamStats.waits;
+            if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                 1000000000) == GL_TIMEOUT_EXPIRED)
+                access = GL_MAP_WRITE_BIT;  // Let the driver synchronize.
+        } else
+            ++gr->streamStats.unsynced;
+        glDeleteSync(fence);
+        dl->fence[dl->region] = 0;
+    } else
+        ++gr->streamStats.unsynced;
+
+    glBindBuffer(GL_ARRAY_BUFFER, gr->vbo[ GLOB_STREAM ]);
+    gr->dptr = (GLfloat*) glMapBufferRange(GL_ARRAY_BUFFER,
+                                   dl->base + dl->region * dl->byteSize,
+                                   dl->byteSize, access);
     return gr->dptr;
 }
 
@@ -741,6 +867,7 @@ void gpu_drawTris(void* res, int list)
 {
     OpenGLResources* gr = (OpenGLResources*) res;
     DrawList* dl = gr->dl + list;
+    GLsync* fence;
 
     if (! dl->count)
         return;
@@ -751,8 +878,24 @@ void gpu_drawTris(void* res, int list)
     glBlendEquation(GL_FUNC_ADD);
 
     glUniformMatrix4fv(gr->worldTrans, 1, GL_FALSE, unitMatrix);
-    glBindVertexArray(gr->vao[ dl->buf ]);
-    glDrawArrays(GL_TRIANGLES, 0, dl->count / ATTR_COUNT);
+    glBindVertexArray(gr->vao[ GLOB_STREAM ]);
+    glDrawArrays(GL_TRIANGLES,
+                 (dl->base + dl->region * dl->byteSize) / ATTR_STRIDE,
+                 dl->count / ATTR_COUNT);
+
+    // Mark when the GPU is done reading the region.
+    fence = dl->fence + dl->region;
+    if (*fence)
+        glDeleteSync(*fence);
+    *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/*
+ * Return the draw list stream counters.
+ */
+const GpuStreamStats* gpu_streamStats(void* res)
+{
+    return &((OpenGLResources*) res)->streamStats;
 }
 
 float* gpu_emitQuad(float* attr, const float* drawRect, const float* uvRect)
@@ -930,8 +1073,6 @@ float* gpu_emitQuadFlag(float* attr, const float* drawRect)
 //--------------------------------------
 // Map Rendering
 
-#define CHUNK_CACHE_SIZE    4
-
 #ifdef MAP_ANIMATOR
 static void stopChunkAnimations(Animator* animator, MapFx* it, int count)
 {
@@ -951,43 +1092,74 @@ void gpu_resetMap(void* res, const Map* map)
 
     gr->blockCount = 0;
     gr->mapData    = map->data;
-    gr->renderData = map->tileset->render;
     gr->mapW       = map->width;
     gr->mapH       = map->height;
 
-    // Initialize map chunks.
-    assert(map->chunk_height == map->chunk_width);
-    gr->mapChunkDim = map->chunk_width;
-    gr->mapChunkVertCount = gr->mapChunkDim * gr->mapChunkDim * 6;
-
-    for (int i = 0; i < CHUNK_CACHE_SIZE; ++i) {
-        glBindBuffer(GL_ARRAY_BUFFER, gr->vbo[ GLOB_MAP_CHUNK0+i ]);
-        glBufferData(GL_ARRAY_BUFFER, gr->mapChunkVertCount * ATTR_STRIDE,
-                     NULL, GL_DYNAMIC_DRAW);
+    if (gr->renderData != map->tileset->render) {
+        gr->renderData = map->tileset->render;
+        gr->tileCount  = map->tileset->tileCount;
+        gr->tileTableUVs = NULL;    // Rebuild table on next draw.
+    }
 
 #ifdef MAP_ANIMATOR
+    for (int i = 0; i < gr->mapChunkCount; ++i) {
         int fxUsed = gr->mapChunkFxUsed[i];
         if (fxUsed)
             stopChunkAnimations(MAP_ANIMATOR,
                                 gr->mapChunkFx + i*CHUNK_FX_LIMIT, fxUsed);
+    }
 #endif
+
+    // Initialize map chunks.  Small square maps (cities, combat, etc.) are
+    // built once as a single chunk which stays resident until the next reset.
+    assert(map->chunk_height == map->chunk_width);
+    if (map->width == map->height && map->width <= WHOLE_MAP_DIM) {
+        gr->mapChunkDim = map->width;
+        gr->mapChunkActive = 1;
+    } else {
+        gr->mapChunkDim = map->chunk_width;
+        gr->mapChunkActive = gr->mapChunkCount;
+    }
+    gr->mapChunkTiles = gr->mapChunkDim * gr->mapChunkDim;
+
+    for (int i = 0; i < gr->mapChunkActive; ++i) {
+        glBindBuffer(GL_ARRAY_BUFFER, gr->mapChunkVbo[i]);
+        glBufferData(GL_ARRAY_BUFFER, gr->mapChunkTiles * sizeof(TileId),
+                     NULL, GL_DYNAMIC_DRAW);
     }
 
     // Clear chunk cache.
-    memset(gr->mapChunkId, 0xff, CHUNK_CACHE_SIZE*sizeof(uint16_t));
-    memset(gr->mapChunkFxUsed, 0, CHUNK_CACHE_SIZE*sizeof(uint16_t));
+    memset(gr->mapChunkId, 0xff, gr->mapChunkCount*sizeof(uint16_t));
+    memset(gr->mapChunkFxUsed, 0, gr->mapChunkCount*sizeof(uint16_t));
+    memset(gr->mapChunkUsed, 0, gr->mapChunkCount*sizeof(uint32_t));
+    memset(&gr->chunkStats, 0, sizeof(GpuChunkStats));
+    memset(&gr->streamStats, 0, sizeof(GpuStreamStats));
+    gr->mapFrame = 1;
+}
+
+/*
+ * Return the map chunk cache counters.  These (and the draw list stream
+ * counters) are reset by gpu_resetMap().
+ */
+const GpuChunkStats* gpu_chunkStats(void* res)
+{
+    return &((OpenGLResources*) res)->chunkStats;
 }
 
 struct ChunkLoc {
     int16_t x, y;
 };
 
+// Chunks drawn this frame; one for each corner of the view.
+#define CHUNK_DRAW_MAX  4
+
 struct ChunkInfo {
     OpenGLResources* gr;
     const float* uvs;
-    uint16_t* mapChunkId;
-    ChunkLoc* chunkLoc;
-    int geoUsedMask;
+    ChunkLoc chunkLoc[CHUNK_DRAW_MAX];  // Tile location of chunks on the map.
+    int slot[CHUNK_DRAW_MAX];           // Cache index of each drawn chunk.
+    int drawCount;
+    int built;
 };
 
 #define VIEW_TILE_SIZE  1.0f
@@ -1035,19 +1207,62 @@ static void _initFxInvert(MapFx* fx, TileId tid, float* drawRect,
 }
 
 /*
+ * Fill the tileTableTex texture with two texels for each TileId.  The first
+ * holds the UV rectangle; the second holds the animation type (0 = none,
+ * 1 = scroll, 2 = fire) and its parameter.  The world.glsl vertex shader
+ * uses these to expand each instanced tile quad.
+ */
+static void _buildTileTable(OpenGLResources* gr, const float* uvTable)
+{
+    const TileRenderData* tr = gr->renderData;
+    float* table;
+    float* tp;
+    uint32_t t;
+    int rows = (gr->tileCount * 2 + TILE_TABLE_W - 1) / TILE_TABLE_W;
+
+    if (! rows)
+        return;
+    table = (float*) calloc(rows * TILE_TABLE_W * 4, sizeof(float));
+    if (! table)
+        return;
+
+    tp = table;
+    for (t = 0; t < gr->tileCount; ++t, ++tr, tp += 8) {
+        memcpy(tp, uvTable + tr->vid*4, 4 * sizeof(float));
+        if (tr->animType == ATYPE_SCROLL) {
+            tp[4] = 1.0f;
+            tp[5] = uvTable[tr->animData.scroll*4 + 1];
+        } else if (tr->animType == ATYPE_PIXEL_COLOR) {
+            float centerX = (float) tr->animData.hot[0];
+            float tileW   = (float) tr->animData.hot[1];
+            tp[4] = 2.0f;
+            tp[5] = (tileW*0.5 - centerX) / tileW;
+        }
+    }
+
+    glActiveTexture(GL_TEXTURE0 + GTU_TILE_TABLE);
+    glBindTexture(GL_TEXTURE_2D, gr->tileTableTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, TILE_TABLE_W, rows, 0,
+                 GL_RGBA, GL_FLOAT, table);
+    free(table);
+
+    gr->tileTableUVs = uvTable;
+}
+
+/*
+ * Copy the TileIds of a chunk into its VBO and start any effects.
+ *
  * \param chunk    Map data aligned at top-left of chunk.
  */
 static void _buildChunkGeo(ChunkInfo* ci, int i, const TileId* chunk)
 {
     float drawRect[4];  // x, y, width, height
-    const float* uvCur;
-    const float* uvScroll;
-    float* attr;
+    TileId* ids;
     const TileId* ip;
     const TileRenderData* tr;
     const float* uvTable = ci->uvs;
     OpenGLResources* gr = ci->gr;
-    float startX;
+    MapFx* fx;
     int x, y;
     int stride = gr->mapW;          // Map tile width
     int cdim   = gr->mapChunkDim;   // Chunk tile dimensions
@@ -1066,50 +1281,45 @@ static void _buildChunkGeo(ChunkInfo* ci, int i, const TileId* chunk)
     fxUsed = 0;
 #endif
 
-    glBindBuffer(GL_ARRAY_BUFFER, gr->vbo[GLOB_MAP_CHUNK0 + i]);
-    attr = (float*) glMapBufferRange(GL_ARRAY_BUFFER, 0,
-                                     gr->mapChunkVertCount * ATTR_STRIDE,
-                                     GL_MAP_WRITE_BIT);
-    if (! attr) {
+    glBindBuffer(GL_ARRAY_BUFFER, gr->mapChunkVbo[i]);
+    ids = (TileId*) glMapBufferRange(GL_ARRAY_BUFFER, 0,
+                                     gr->mapChunkTiles * sizeof(TileId),
+                                     GL_MAP_WRITE_BIT |
+                                     GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (! ids) {
         fprintf(stderr, "buildChunkGeo: glMapBufferRange failed\n");
         return;
     }
 
-    // Placing center of the top left tile at the origin.
-    startX = -0.5f * VIEW_TILE_SIZE;
-    drawRect[1] = startX;
+    if (stride == cdim) {
+        memcpy(ids, chunk, gr->mapChunkTiles * sizeof(TileId));
+    } else {
+        ip = chunk;
+        for (y = 0; y < cdim; ++y, ip += stride)
+            memcpy(ids + y * cdim, ip, cdim * sizeof(TileId));
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    // Effects are placed with the center of the top left tile at the origin.
     drawRect[2] = VIEW_TILE_SIZE;
     drawRect[3] = VIEW_TILE_SIZE;
 
     for (y = 0; y < cdim; ++y) {
-        drawRect[0] = startX;
         ip = chunk;
         for (x = 0; x < cdim; ++x) {
             tr = gr->renderData + *ip++;
-            uvCur = uvTable + tr->vid*4;
-            if (tr->animType == ATYPE_SCROLL) {
-                uvScroll = uvTable + tr->animData.scroll*4;
-                attr = gpu_emitQuadScroll(attr, drawRect, uvCur, uvScroll[1]);
-            } else if (tr->animType == ATYPE_PIXEL_COLOR) {
-                float centerX = (float) tr->animData.hot[0];
-                float tileW   = (float) tr->animData.hot[1];
-                float uOff  = (tileW*0.5 - centerX) / tileW;
-                attr = gpu_emitQuadFire(attr, drawRect, uvCur, uOff);
-            } else {
-                if (tr->animType == ATYPE_INVERT && fxUsed < CHUNK_FX_LIMIT) {
-                    _initFxInvert(gr->mapChunkFx + i*CHUNK_FX_LIMIT + fxUsed,
-                                  ip[-1], drawRect, uvCur);
-                    ++fxUsed;
-                }
-                attr = gpu_emitQuad(attr, drawRect, uvCur);
+            if (tr->animType == ATYPE_INVERT && fxUsed < CHUNK_FX_LIMIT) {
+                drawRect[0] = (-0.5f + x) * VIEW_TILE_SIZE;
+                drawRect[1] = (-0.5f - y) * VIEW_TILE_SIZE;
+                fx = gr->mapChunkFx + i*CHUNK_FX_LIMIT + fxUsed;
+                _initFxInvert(fx, ip[-1], drawRect, uvTable + tr->vid*4);
+                fx->tile = y * cdim + x;
+                ++fxUsed;
             }
-            drawRect[0] += drawRect[2];
         }
-        drawRect[1] -= drawRect[3];
         chunk += stride;
     }
 
-    glUnmapBuffer(GL_ARRAY_BUFFER);
     gr->mapChunkFxUsed[i] = fxUsed;
 }
 
@@ -1127,18 +1337,52 @@ static void _buildChunkGeo(ChunkInfo* ci, int i, const TileId* chunk)
 #define CHUNK_ID(c,r)       (c<<8 | r)
 
 /*
- * Find (or create) chunk geometry in the four reserved VBO slots.
- * Return the chunk vertex buffer used (0-3), or -1 if no slot is available.
+ * Return the cache index holding the chunk or -1 if it is not present.
+ */
+static int _findChunk(const OpenGLResources* gr, uint16_t chunkId)
+{
+    for (int i = 0; i < gr->mapChunkActive; ++i) {
+        if (gr->mapChunkId[i] == chunkId)
+            return i;
+    }
+    return -1;
+}
+
+/*
+ * Return an unassigned cache index, or the least recently used one which
+ * was not drawn in the current frame.  If all are in use then -1 is returned.
+ */
+static int _evictChunk(OpenGLResources* gr)
+{
+    uint32_t oldest = gr->mapFrame;
+    int i, lru = -1;
+
+    for (i = 0; i < gr->mapChunkActive; ++i) {
+        if (gr->mapChunkId[i] == 0xffff)
+            return i;
+        if (gr->mapChunkUsed[i] < oldest) {
+            oldest = gr->mapChunkUsed[i];
+            lru = i;
+        }
+    }
+    if (lru >= 0)
+        ++gr->chunkStats.evicted;
+    return lru;
+}
+
+/*
+ * Find (or create) chunk geometry in the cache and add it to the draw list
+ * of the current frame.
+ * Return the chunk cache index used, or -1 if no slot is available.
  *
  * \param x         Map tile column.
  * \param y         Map tile row.
- * \param bumpPass  Replace a cached chunk.
  */
-static int _obtainChunkGeo(ChunkInfo* ci, int x, int y, int bumpPass)
+static int _obtainChunkGeo(ChunkInfo* ci, int x, int y)
 {
     OpenGLResources* gr = ci->gr;
     ChunkLoc* loc;
-    int i;
+    int i, n;
     int ccol, crow;
     int cdim = gr->mapChunkDim;
     int wx, wy;
@@ -1150,47 +1394,154 @@ static int _obtainChunkGeo(ChunkInfo* ci, int x, int y, int bumpPass)
     crow = y / cdim;
     chunkId = CHUNK_ID(ccol, crow);
 
-    if (bumpPass)
-    {
-        // Find unassigned chunk to replace.
-        for (i = 0; i < CHUNK_CACHE_SIZE; ++i) {
-            if ((ci->geoUsedMask & (1 << i)) == 0)
-                goto build;
-        }
-        // This should never be reached unless the function is called more
-        // than CHUNK_CACHE_SIZE times.
-        assert(0 && "bumpPass failed");
-        return -1;
+    i = _findChunk(gr, chunkId);
+    if (i < 0) {
+        i = _evictChunk(gr);
+        if (i < 0)
+            return -1;
+        gr->mapChunkId[i] = chunkId;
+        _buildChunkGeo(ci, i, gr->mapData + (crow * gr->mapW + ccol) * cdim);
+        ++gr->chunkStats.misses;
+        ci->built = 1;
+    } else if (gr->mapChunkUsed[i] != gr->mapFrame) {
+        ++gr->chunkStats.hits;
     }
-    else
-    {
-        // Check if already made.
-        for (i = 0; i < CHUNK_CACHE_SIZE; ++i) {
-            if (ci->mapChunkId[i] == chunkId)
-                goto used;
-        }
+    gr->mapChunkUsed[i] = gr->mapFrame;
 
-        // Find unused VBO.
-        for (i = 0; i < CHUNK_CACHE_SIZE; ++i) {
-            if (ci->mapChunkId[i] == 0xffff)
-                goto build;
-        }
+    wx += ccol * cdim;
+    wy += crow * cdim;
 
-        // No unused VBO, fail.
-        return -1;
+    // Check if already drawn at this location (a small map can have the same
+    // chunk in more than one corner).
+    for (n = 0; n < ci->drawCount; ++n) {
+        loc = ci->chunkLoc + n;
+        if (ci->slot[n] == i && loc->x == wx && loc->y == wy)
+            return i;
     }
 
-build:
-    ci->mapChunkId[i] = chunkId;
-    _buildChunkGeo(ci, i, gr->mapData + (crow * gr->mapW + ccol) * cdim);
-used:
-    loc = ci->chunkLoc + i;
-    loc->x = wx + (ccol * cdim);
-    loc->y = wy + (crow * cdim);
-    ci->geoUsedMask |= 1 << i;
+    loc = ci->chunkLoc + n;
+    loc->x = wx;
+    loc->y = wy;
+    ci->slot[n] = i;
+    ci->drawCount = n + 1;
     return i;
 }
 
+/*
+ * Build one uncached chunk just beyond the view edge in the direction of
+ * travel so that it is ready before it scrolls into view.
+ */
+static void _prefetchChunkGeo(ChunkInfo* ci, int travelDir,
+                              int left, int top, int right, int bot,
+                              int halfW, int halfH)
+{
+    OpenGLResources* gr = ci->gr;
+    int px[2], py[2];
+    int i, x, y;
+    int cdim = gr->mapChunkDim;
+    uint16_t chunkId;
+
+    switch (travelDir) {
+        case DIR_WEST:
+            px[0] = px[1] = left - halfW;
+            py[0] = top;
+            py[1] = bot;
+            break;
+        case DIR_EAST:
+            px[0] = px[1] = right + halfW;
+            py[0] = top;
+            py[1] = bot;
+            break;
+        case DIR_NORTH:
+            px[0] = left;
+            px[1] = right;
+            py[0] = py[1] = top - halfH;
+            break;
+        case DIR_SOUTH:
+            px[0] = left;
+            px[1] = right;
+            py[0] = py[1] = bot + halfH;
+            break;
+        default:
+            return;
+    }
+
+    for (i = 0; i < 2; ++i) {
+        x = (px[i] + gr->mapW) % gr->mapW / cdim;
+        y = (py[i] + gr->mapH) % gr->mapH / cdim;
+        chunkId = CHUNK_ID(x, y);
+        if (_findChunk(gr, chunkId) < 0) {
+            int n = _evictChunk(gr);
+            if (n >= 0) {
+                gr->mapChunkId[n] = chunkId;
+                gr->mapChunkUsed[n] = gr->mapFrame;
+                _buildChunkGeo(ci, n, gr->mapData + (y * gr->mapW + x) * cdim);
+                ++gr->chunkStats.prefetched;
+            }
+            return;
+        }
+    }
+}
+
+/*
+ * Rewrite the TileId of a single map tile after Map::setTileAt() has
+ * changed it.  Only chunks currently in the cache are updated; any others
+ * will pick up the change when they are built.
+ *
+ * \param x         Map tile column.
+ * \param y         Map tile row.
+ */
+void gpu_updateMapTile(void* res, int x, int y)
+{
+    OpenGLResources* gr = (OpenGLResources*) res;
+    float drawRect[4];
+    const TileRenderData* tr;
+    MapFx* fx;
+    TileId tid;
+    int i, n, cx, cy, tile, fxUsed;
+    int cdim = gr->mapChunkDim;
+
+    if (! gr->mapUVs || x < 0 || y < 0 || x >= gr->mapW || y >= gr->mapH)
+        return;
+
+    i = _findChunk(gr, CHUNK_ID(x / cdim, y / cdim));
+    if (i < 0)
+        return;
+
+    cx = x % cdim;
+    cy = y % cdim;
+    tile = cy * cdim + cx;
+    tid = gr->mapData[y * gr->mapW + x];
+    tr = gr->renderData + tid;
+
+    drawRect[0] = (-0.5f + cx) * VIEW_TILE_SIZE;
+    drawRect[1] = (-0.5f - cy) * VIEW_TILE_SIZE;
+    drawRect[2] = VIEW_TILE_SIZE;
+    drawRect[3] = VIEW_TILE_SIZE;
+
+    glBindBuffer(GL_ARRAY_BUFFER, gr->mapChunkVbo[i]);
+    glBufferSubData(GL_ARRAY_BUFFER, tile * sizeof(TileId), sizeof(TileId),
+                    &tid);
+
+    // Remove any effect on the old tile and add one for the new tile.
+    fx = gr->mapChunkFx + i*CHUNK_FX_LIMIT;
+    fxUsed = gr->mapChunkFxUsed[i];
+    for (n = 0; n < fxUsed; ++n) {
+        if (fx[n].tile == tile) {
+#ifdef MAP_ANIMATOR
+            stopChunkAnimations(MAP_ANIMATOR, fx + n, 1);
+#endif
+            fx[n] = fx[--fxUsed];
+            break;
+        }
+    }
+    if (tr->animType == ATYPE_INVERT && fxUsed < CHUNK_FX_LIMIT) {
+        _initFxInvert(fx + fxUsed, tid, drawRect, gr->mapUVs + tr->vid*4);
+        fx[fxUsed++].tile = tile;
+    }
+    gr->mapChunkFxUsed[i] = fxUsed;
+}
+
 /*
  * \param view          Pointer to TileView with a valid map.
  * \param tileUVs       Table of four floats (minU,minV,maxU,maxV) per tile.
@@ -1199,14 +1550,17 @@ used:
  * \param cx            Map tile row to center view on.
  * \param cy            Map tile column to center view on.
  * \param scale         Normal = 2.0 / view->columns.
+ * \param travelDir     Direction the view is moving (DIR_NONE if unknown).
+ *                      Used to prefetch chunks about to come into view.
  */
 void gpu_drawMap(void* res, const TileView* view, const float* tileUVs,
                  const BlockingGroups* blocks,
-                 int cx, int cy, float scale)
+                 int cx, int cy, float scale, int travelDir)
 {
+    PROF_ZONE("drawMap");
     OpenGLResources* gr = (OpenGLResources*) res;
-    ChunkLoc cloc[4];   // Tile location of chunks on the map.
-    int i, usedMask;
+    ChunkInfo ci;
+    int i;
 
     // Render shadows.
     if (blocks) {
@@ -1218,7 +1572,8 @@ void gpu_drawMap(void* res, const TileView* view, const float* tileUVs,
             glUniform3f(gr->shadowViewer, 0.0f, 0.0f, 11.0f);
             glUniform3i(gr->shadowCounts, blocks->left, blocks->center,
                                           blocks->right);
-            glUniform3fv(gr->shadowShapes, gr->blockCount, blocks->tilePos);
+            glUniform4fv(gr->shadowShapes, (gr->blockCount * 3 + 3) / 4,
+                         blocks->tilePos);
 
             glBindFramebuffer(GL_DRAW_FRAMEBUFFER, gr->shadowFbo);
             glViewport(0, 0, SHADOW_DIM, SHADOW_DIM);
@@ -1232,16 +1587,16 @@ void gpu_drawMap(void* res, const TileView* view, const float* tileUVs,
     }
 
     {
-    ChunkInfo ci;
-    int bindex[4];  // Chunk vertex buffer index (0-3) at view corner.
     int left, top, right, bot;
     int halfW, halfH;
 
     ci.gr = gr;
-    ci.uvs = tileUVs;
-    ci.mapChunkId = gr->mapChunkId;
-    ci.chunkLoc = cloc;
-    ci.geoUsedMask = 0;
+    ci.uvs = gr->mapUVs = tileUVs;
+    if (gr->tileTableUVs != tileUVs)
+        _buildTileTable(gr, tileUVs);
+    ci.drawCount = 0;
+    ci.built = 0;
+    ++gr->mapFrame;
 
     // FIXME: Apply scale.
     halfW = view->columns / 2;
@@ -1252,23 +1607,15 @@ void gpu_drawMap(void* res, const TileView* view, const float* tileUVs,
     top   = cy - halfH;
     bot   = cy + halfH;
 
-    // First pass to see what chunks are cached.
-    bindex[0] = _obtainChunkGeo(&ci, left,  top, 0);
-    bindex[1] = _obtainChunkGeo(&ci, right, top, 0);
-    bindex[2] = _obtainChunkGeo(&ci, left,  bot, 0);
-    bindex[3] = _obtainChunkGeo(&ci, right, bot, 0);
-
-    // Second pass to bump any cached chunks (if needed).
-    if (bindex[0] < 0)
-        _obtainChunkGeo(&ci, left,  top, 1);
-    if (bindex[1] < 0)
-        _obtainChunkGeo(&ci, right, top, 1);
-    if (bindex[2] < 0)
-        _obtainChunkGeo(&ci, left,  bot, 1);
-    if (bindex[3] < 0)
-        _obtainChunkGeo(&ci, right, bot, 1);
-
-    usedMask = ci.geoUsedMask;
+    _obtainChunkGeo(&ci, left,  top);
+    _obtainChunkGeo(&ci, right, top);
+    _obtainChunkGeo(&ci, left,  bot);
+    _obtainChunkGeo(&ci, right, bot);
+
+    // Spread the building work out by only prefetching when nothing else
+    // was built this frame.
+    if (! ci.built && travelDir != DIR_NONE)
+        _prefetchChunkGeo(&ci, travelDir, left, top, right, bot, halfW, halfH);
     }
 
     {
@@ -1288,6 +1635,12 @@ void gpu_drawMap(void* res, const TileView* view, const float* tileUVs,
 
     glUseProgram(gr->shadeWorld);
     glUniform2f(gr->worldScroll, gr->tilesVDim, gr->time);
+    glUseProgram(gr->shadeTiles);
+    glUniform2f(gr->tilesScroll, gr->tilesVDim, gr->time);
+    glUniform1i(gr->tilesChunkDim, gr->mapChunkDim);
+
+    glActiveTexture(GL_TEXTURE0 + GTU_TILE_TABLE);
+    glBindTexture(GL_TEXTURE_2D, gr->tileTableTex);
     glActiveTexture(GL_TEXTURE0 + GTU_SHADOW);
     if (gr->blockCount)
         glBindTexture(GL_TEXTURE_2D, gr->shadowTex);
@@ -1303,33 +1656,38 @@ void gpu_drawMap(void* res, const TileView* view, const float* tileUVs,
 
     glDisable(GL_BLEND);
 
-    for (i = 0; i < 4; ++i) {
-        if (usedMask & (1 << i)) {
-            // Position chunk in viewport.
-            matrix[ MAT_X ] = (float) (cloc[i].x - cx) * scale;
-            matrix[ MAT_Y ] = (float) (cy - cloc[i].y) * scaleY;
-            glUniformMatrix4fv(gr->worldTrans, 1, GL_FALSE, matrix);
+    for (i = 0; i < ci.drawCount; ++i) {
+        const ChunkLoc* loc = ci.chunkLoc + i;
+        int slot = ci.slot[i];
 
-            glBindVertexArray(gr->vao[ GLOB_MAP_CHUNK0 + i ]);
-            glDrawArrays(GL_TRIANGLES, 0, gr->mapChunkVertCount);
+        // Position chunk in viewport.
+        matrix[ MAT_X ] = (float) (loc->x - cx) * scale;
+        matrix[ MAT_Y ] = (float) (cy - loc->y) * scaleY;
+        glUniformMatrix4fv(gr->tilesTrans, 1, GL_FALSE, matrix);
 
-            if (gr->mapChunkFxUsed[i])
-                fxUsed = 1;
-        }
+        glBindVertexArray(gr->mapChunkVao[slot]);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, gr->mapChunkTiles);
+
+        if (gr->mapChunkFxUsed[slot])
+            fxUsed = 1;
     }
 
+    // Map objects & effects are drawn with the regular world shader.
+    glUseProgram(gr->shadeWorld);
+
     if (fxUsed) {
         const int MAPFX_LIST = 2;
         float rect[4];
         float xoff, yoff;
         float* fxAttr = gpu_beginTris(gr, MAPFX_LIST);
-        for (i = 0; i < 4; ++i) {
-            if (usedMask & (1 << i) && gr->mapChunkFxUsed[i]) {
-                xoff = (float) (cloc[i].x - cx);
-                yoff = (float) (cy - cloc[i].y);
-
-                const MapFx* it  = gr->mapChunkFx + i*CHUNK_FX_LIMIT;
-                const MapFx* end = it + gr->mapChunkFxUsed[i];
+        for (i = 0; i < ci.drawCount; ++i) {
+            int slot = ci.slot[i];
+            if (gr->mapChunkFxUsed[slot]) {
+                xoff = (float) (ci.chunkLoc[i].x - cx);
+                yoff = (float) (cy - ci.chunkLoc[i].y);
+
+                const MapFx* it  = gr->mapChunkFx + slot*CHUNK_FX_LIMIT;
+                const MapFx* end = it + gr->mapChunkFxUsed[slot];
                 for (; it != end; ++it) {
                     // Assuming only ATYPE_INVERT effects are used for now.
 #ifdef EMULATE_U4
@@ -10,21 +10,13 @@
 #endif
 
 #include "anim.h"
+#include "gpu.h"
 #include "tile.h"
 
 enum GLObject {
     GLOB_QUAD,
 #ifdef GPU_RENDER
-    GLOB_DRAW_LIST0,
-    GLOB_DRAW_LIST1,
-    GLOB_FX_LIST0,
-    GLOB_FX_LIST1,
-    GLOB_MAPFX_LIST0,
-    GLOB_MAPFX_LIST1,
-    GLOB_MAP_CHUNK0,
-    GLOB_MAP_CHUNK1,
-    GLOB_MAP_CHUNK2,
-    GLOB_MAP_CHUNK3,
+    GLOB_STREAM,        // Ring buffer holding all draw lists.
 #endif
     GLOB_COUNT
 };
@@ -34,21 +26,30 @@ enum GLTextureUnit {
     GTU_MATERIAL,
     GTU_NOISE,
     GTU_SHADOW,
-    GTU_SCALER_LUT
+    GTU_SCALER_LUT,
+    GTU_TILE_TABLE
 };
 
+#define STREAM_REGIONS  3       // Ring buffer regions for each DrawList.
+
 struct DrawList {
-    int     buf;        // GLObject vbo index toggle.
-    int     byteSize;
+    int     byteSize;   // Size of each region.
+    int     base;       // Byte offset of the first region in GLOB_STREAM.
+    int     region;     // Region holding the current list.
     GLsizei count;      // Number of floats.
+    GLsync  fence[STREAM_REGIONS];  // Signaled when region draw is done.
 };
 
 #define CHUNK_FX_LIMIT  8
+#define CHUNK_CACHE_MIN 4       // Enough for the four corners of the view.
+#define CHUNK_CACHE_MAX 64
+#define WHOLE_MAP_DIM   64      // Maps this size or smaller are one chunk.
 
 struct MapFx {
     float x, y, w, h;
     float u, v, u2, v2;
     AnimId anim;
+    uint16_t tile;      // Index of tile in chunk.
 };
 
 struct OpenGLResources {
@@ -88,21 +89,39 @@ struct OpenGLResources {
     GLint  worldShadowMap;
     GLint  worldScroll;
 
+    GLuint shadeTiles;          // World shader with instanced map tiles.
+    GLint  tilesTrans;
+    GLint  tilesScroll;
+    GLint  tilesChunkDim;
+    GLuint tileTableTex;        // UVs & animation of each TileId.
+    GLuint tileCornerVbo;
+    const float* tileTableUVs;  // UVs used to build tileTableTex.
+    uint32_t tileCount;
+
     GLuint tilesTex;            // Managed by user.
     GLuint tilesMat;            // Managed by user.
     float  tilesVDim;
     float  time;
     DrawList dl[3];
     float* dptr;
+    GpuStreamStats streamStats;
     const TileId* mapData;
     const TileRenderData* renderData;
     int    blockCount;
-    GLsizei mapChunkVertCount;
+    GLsizei mapChunkTiles;      // Number of TileIds in each chunk VBO.
     uint16_t mapW;
     uint16_t mapH;
     uint16_t mapChunkDim;       // Size in tiles (width & height are the same).
-    uint16_t mapChunkId[4];     // Chunk X,Y of associated GLOB_MAP_CHUNK.
-    uint16_t mapChunkFxUsed[4];
-    MapFx mapChunkFx[4*CHUNK_FX_LIMIT];
+    uint16_t mapChunkCount;     // Number of chunk VBOs in the cache.
+    uint16_t mapChunkActive;    // Number of chunk VBOs used by current map.
+    const float* mapUVs;        // Tile UVs of last gpu_drawMap() call.
+    uint32_t mapFrame;          // Incremented each gpu_drawMap() call.
+    GpuChunkStats chunkStats;
+    GLuint   mapChunkVbo[CHUNK_CACHE_MAX];
+    GLuint   mapChunkVao[CHUNK_CACHE_MAX];
+    uint32_t mapChunkUsed[CHUNK_CACHE_MAX];  // mapFrame of last use (LRU).
+    uint16_t mapChunkId[CHUNK_CACHE_MAX];    // Chunk X,Y held in each VBO.
+    uint16_t mapChunkFxUsed[CHUNK_CACHE_MAX];
+    MapFx mapChunkFx[CHUNK_CACHE_MAX*CHUNK_FX_LIMIT];
 #endif
 };
@@ -72,6 +72,7 @@ void Image::putPixel(int x, int y, int r, int g, int b, int a) {
     RGBA col;
     rgba_set(col, r, g, b, a);
     pixels[ y*w + x ] = *((uint32_t*) &col);
+    image32_markDirty(this, x, y, 1, 1);
 }
 
 void Image::makeColorTransparent(const RGBA& bgColor, int haloSize, int shadowOpacity)
@@ -139,6 +140,7 @@ void Image::performTransparencyHack(const RGBA& transColor,
  */
 void Image::putPixelIndex(int x, int y, uint32_t index) {
     pixels[ y*w + x ] = index;
+    image32_markDirty(this, x, y, 1, 1);
 }
 
 /**
@@ -187,6 +189,8 @@ void Image::fillRect(int x, int y, int rw, int rh, int r, int g, int b, int a) {
     if (blitH < 1)
         return;
 
+    image32_markDirty(this, x, y, blitW, blitH);
+
     while (blitH--) {
         dp = drow;
         dend = dp + blitW;
@@ -263,6 +267,7 @@ void Image::drawLetter(int dx, int dy, int sx, int sy, int sw, int sh,
 
     srow = pixels + w * sy + sx;
     drow = dest->pixels + dest->w * dy + dx;
+    image32_markDirty(dest, dx, dy, sw, sh);
 
     {
     uint32_t* dp;
@@ -329,6 +334,7 @@ void Image::drawSubRectInvertedOn(Image *dest, int x, int y, int rx, int ry, int
 
     srow = pixels + w * ry + rx;
     drow = dest->pixels + dest->w * y + x;
+    image32_markDirty(dest, x, y, rw, rh);
 
     srow += w * (rh - 1);
     while (rh--) {
@@ -354,4 +360,6 @@ void Image::drawHighlighted() {
         col->b = 0xff - col->b;
         ++col;
     }
+    if (dirty)
+        dirty->full = 1;
 }
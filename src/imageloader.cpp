@@ -13,7 +13,11 @@
 // A black & white palette
 static RGBA bwPalette[2] = {{0,0,0,0}, {255,255,255,255}};
 
-static const RGBA* stdPalette(int bpp)
+/**
+ * Return the standard palette for images of the given depth (or NULL).
+ * This may load a palette file so it must be called on the main thread.
+ */
+const RGBA* stdPalette(int bpp)
 {
     switch(bpp) {
         case 8:
@@ -209,7 +213,12 @@ static void setFromRawData(Image *image, int width, int height, int bpp, unsigne
 #include "imageloader_u4.cpp"
 
 
-Image* loadImage(U4FILE *file, int ftype, int width, int height, int bpp) {
+/**
+ * Decode an image.  The palette is used for 1, 4 & 8 bpp images and is
+ * normally the stdPalette() of the depth.
+ */
+Image* loadImage(U4FILE *file, int ftype, int width, int height, int bpp,
+                 const RGBA* palette) {
     switch(ftype) {
     case FTYPE_PNG:
         return loadImage_png(file);
@@ -218,12 +227,95 @@ Image* loadImage(U4FILE *file, int ftype, int width, int height, int bpp) {
     case FTYPE_U4RLE:
     case FTYPE_U4LZW:
     case FTYPE_U5LZW:
-        return loadImage_u4(file, ftype, width, height, bpp);
+        return loadImage_u4(file, ftype, width, height, bpp, palette);
 
     case FTYPE_FMTOWNS:
     case FTYPE_FMTOWNS_PIC:
     case FTYPE_FMTOWNS_TIF:
-        return loadImage_fmTowns(file, width, height, bpp);
+        return loadImage_fmTowns(file, width, height, bpp, palette);
     }
     return NULL;
 }
+
+#ifdef DEBUG
+#include <set>
+#include <string.h>
+
+extern uint64_t getMicroTicks();
+
+/*
+ * Time the decoding of each RLE & LZW compressed image in the installed
+ * game data and print the average time of each.
+ */
+void decodeBenchmark(int rounds) {
+    static const char* typeName[] = { "RLE", "LZW", "U5LZW" };
+    LZWEntry dict[LZW_DICT_SIZE];
+    std::set<std::string> seen;
+    std::map<Symbol, ImageInfo*>::const_iterator it;
+    ImageSet* set;
+    uint32_t id;
+    uint64_t start, total, sum = 0;
+    long compLen, rawLen, decLen;
+    int i;
+
+    printf("file              type    bytes   decode ms\n");
+    for (id = 0; (set = xu4.config->newScheme(id)); ++id) {
+        for (it = set->info.begin(); it != set->info.end(); ++it) {
+            const ImageInfo* info = it->second;
+            int ftype = info->filetype;
+            if (ftype != FTYPE_U4RLE && ftype != FTYPE_U4LZW &&
+                ftype != FTYPE_U5LZW)
+                continue;
+
+            // Original game data is named with a "u4/" or "u4u/" path.
+            const char* fn = xu4.config->confString(info->filename);
+            const char* base = strchr(fn, '/');
+            base = base ? base + 1 : fn;
+            if (! seen.insert(base).second)
+                continue;
+
+            U4FILE* uf = u4fopen(base);
+            if (! uf)
+                continue;
+            compLen = uf->length();
+            std::vector<uint8_t> comp(compLen + 1);
+            compLen = uf->read(&comp[0], 1, compLen);
+            u4fclose(uf);
+
+            if (ftype == FTYPE_U4RLE)
+                rawLen = rleGetDecompressedSize(&comp[0], compLen);
+            else if (ftype == FTYPE_U4LZW)
+                rawLen = lzwDecodeU4(&comp[0], compLen, NULL, 0, dict);
+            else if (compLen >= 4)
+                rawLen = comp[0] + (comp[1]<<8) + (comp[2]<<16) + (comp[3]<<24);
+            else
+                rawLen = 0;
+            if (rawLen <= 0)
+                continue;
+            std::vector<uint8_t> raw(rawLen);
+
+            total = 0;
+            for (i = 0; i < rounds; ++i) {
+                start = getMicroTicks();
+                if (ftype == FTYPE_U4RLE)
+                    decLen = rleDecompress(&comp[0], compLen, &raw[0], rawLen);
+                else if (ftype == FTYPE_U4LZW)
+                    decLen = lzwDecodeU4(&comp[0], compLen, &raw[0], rawLen,
+                                         dict);
+                else
+                    decLen = lzwDecodeU5(&comp[0] + 4, compLen - 4, &raw[0],
+                                         rawLen, dict);
+                total += getMicroTicks() - start;
+                if (decLen != rawLen)
+                    errorFatal("decodeBenchmark failed to decode %s", base);
+            }
+            sum += total;
+            printf("%-16s  %-5s  %7ld  %10.3f\n", base,
+                   typeName[ftype - FTYPE_U4RLE], rawLen,
+                   double(total) * 0.001 / rounds);
+        }
+        delete set;
+    }
+    printf("all images: %.3f ms\n", double(sum) * 0.001 / rounds);
+}
+#endif
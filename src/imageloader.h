@@ -21,6 +21,8 @@ enum ImageFiletype {
     FTYPE_ATLAS         // Special internal type for ImageInfo.
 };
 
-Image* loadImage(U4FILE *file, int ftype, int width, int height, int bpp);
+const RGBA* stdPalette(int bpp);
+Image* loadImage(U4FILE *file, int ftype, int width, int height, int bpp,
+                 const RGBA* palette);
 
 #endif /* IMAGELOADER_H */
@@ -9,7 +9,8 @@
  * Loads in an FM TOWNS files, which we assume is 16 bits.
  * Only TIF format is implemented, PIC is not handled.
  */
-Image *loadImage_fmTowns(U4FILE *file, int width, int height, int bpp) {
+Image *loadImage_fmTowns(U4FILE *file, int width, int height, int bpp,
+                         const RGBA *palette) {
     const int offset = 510;     // 510 for TIF.
 
     if (width == -1 || height == -1 || bpp == -1) {
@@ -40,7 +41,7 @@ Image *loadImage_fmTowns(U4FILE *file, int width, int height, int bpp) {
 
     if (bpp == 4)
     {
-        setFromRawData(image, width, height, bpp, raw, stdPalette(bpp));
+        setFromRawData(image, width, height, bpp, raw, palette);
 //      if (width % 2)
 //          errorFatal("FMTOWNS 4bit images cannot handle widths not divisible by 2!");
 //      unsigned char nibble_mask = 0x0F;
@@ -3,15 +3,15 @@
  */
 
 #include "rle.h"
-#include "lzw/u4decode.h"
-#include "lzw/u6decode.h"
+#include "lzw/lzw.h"
 
 /**
  * Load an Ultima IV image and apply the standard U4 16 or 256 color palette.
  * This loader handles the original 4-bit images, as well as the 8-bit VGA
  * upgrade images.
  */
-Image *loadImage_u4(U4FILE *file, int ftype, int width, int height, int bpp) {
+Image *loadImage_u4(U4FILE *file, int ftype, int width, int height, int bpp,
+                    const RGBA *palette) {
     Image* image = NULL;
     unsigned char *raw = NULL;
     unsigned char *compressed = NULL;
@@ -45,44 +45,54 @@ Image *loadImage_u4(U4FILE *file, int ftype, int width, int height, int bpp) {
 
     case FTYPE_U4RLE:
     case FTYPE_U4LZW:
+    case FTYPE_U5LZW:
+    {
         // Loader for U4 images with RLE or LZW compression.  Like raw images,
         // the data is just a stream of pixel data with no palette information
         // (e.g. start.ega, rune_*.ega).
         // (e.g. title.ega, tree.ega).
+        // U5 images are similar to U4 LZW images, but with a slightly
+        // different variation on the LZW algorithm.
+        //
+        // The decompressed size is known in advance so the data is decoded
+        // directly into the raw buffer in a single pass.
+
+        LZWEntry dict[LZW_DICT_SIZE];
+        long requiredLength = (width * height * bpp / 8);
+        long decLen = -1;
 
         compLen = file->length();
         compressed = (unsigned char *) malloc(compLen);
         file->read(compressed, 1, compLen);
 
+        if (ftype == FTYPE_U5LZW) {
+            // U5 files begin with the decompressed size.
+            if (compLen < 4)
+                rawLen = 0;
+            else
+                rawLen = compressed[0] + (compressed[1]<<8) +
+                         (compressed[2]<<16) + (compressed[3]<<24);
+        } else
+            rawLen = requiredLength;
+        raw = (unsigned char *) malloc(rawLen);
+
         if (ftype == FTYPE_U4RLE)
-            rawLen = rleDecompressMemory(compressed, compLen, (void**) &raw);
-        else
-            rawLen = decompress_u4_memory(compressed, compLen, (void**) &raw);
+            decLen = rleDecompress(compressed, compLen, raw, rawLen);
+        else if (ftype == FTYPE_U4LZW)
+            decLen = lzwDecodeU4(compressed, compLen, raw, rawLen, dict);
+        else if (rawLen)
+            decLen = lzwDecodeU5(compressed+4, compLen-4, raw, rawLen, dict);
         free(compressed);
 
-        if (rawLen != (width * height * bpp / 8))
+        if (decLen != rawLen || rawLen < requiredLength)
             goto cleanup_raw;
-        break;
-
-    case FTYPE_U5LZW:
-        // Loader for U5 images with LZW compression.  Similar to U4 LZW
-        // images, but with a slightly different variation on the LZW algorithm.
-
-        compLen = file->length();
-        compressed = (unsigned char *) malloc(compLen);
-        file->read(compressed, 1, compLen);
-
-        rawLen = compressed[0] + (compressed[1]<<8) +
-                 (compressed[2]<<16) + (compressed[3]<<24);
-        raw = (unsigned char *) malloc(rawLen);
-        U6Decode::lzw_decompress(compressed+4, compLen-4, raw, rawLen);
-        free(compressed);
+    }
         break;
     }
 
     image = Image::create(width, height);
     if (image)
-        setFromRawData(image, width, height, bpp, raw, stdPalette(bpp));
+        setFromRawData(image, width, height, bpp, raw, palette);
 
 cleanup_raw:
     free(raw);
@@ -11,7 +11,9 @@
 #include "imagemgr.h"
 #include "intro.h"
 #include "settings.h"
+#include "thread.h"
 #include "xu4.h"
+#include "support/profiler.h"
 
 #ifdef USE_GL
 #include "gpu.h"
@@ -20,11 +22,253 @@
 using std::string;
 
 Image *screenScale(Image *src, int scale, int n, int filter);
+extern uint64_t getMicroTicks();
+
+extern bool verbose;
+
+#ifdef CONF_MODULE
+/*
+ * The image cache holds images as they are after loading, fixup and
+ * scaling so that later runs can skip that work.  It is a CDI package in
+ * the user directory.  Each chunk is keyed by a hash of the source file and
+ * everything else which affects the result.  The package appId identifies
+ * the settings common to all images; when these change the cache is
+ * rebuilt.
+ */
+#define IMAGE_CACHE_VERSION 1   // Increment when loaders or fixups change.
+#define IMAGE_CACHE_FILE    "imagecache.pak"
+
+struct ImageCacheHead {
+    uint32_t check;             // High half of the 64-bit key.
+    int16_t srcW, srcH;         // Dimensions before scaling.
+    uint16_t w, h;
+};
+
+struct ImageCache {
+    CDIPak pak;
+    const CDIEntry* toc;        // NULL if there is no usable package.
+    uint32_t tocCount;
+    uint32_t pakId;
+    std::vector<uint8_t> used;  // Flags TOC entries read this session.
+    CDIWriter writer;           // Package being built if writer.fp is set.
+    string path;
+    uint64_t loadTime;          // Microseconds spent in ImageMgr::load.
+    int depth;                  // Nesting of ImageMgr::load calls.
+    int loaded;
+    int hits;
+};
+
+#define FNV_INIT    0xcbf29ce484222325ULL
+#define FNV_PRIME   0x100000001b3ULL
+
+static uint64_t fnv1a(uint64_t hash, const void* data, size_t len) {
+    const uint8_t* it  = (const uint8_t*) data;
+    const uint8_t* end = it + len;
+    for (; it != end; ++it) {
+        hash ^= *it;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static ImageCache* cacheOpen() {
+    ImageCache* ic = new ImageCache;
+    CDIEntry head;
+    int32_t id[3];
+
+    ic->toc = NULL;
+    ic->tocCount = 0;
+    ic->writer.fp = NULL;
+    ic->path = xu4.settings->getUserPath() + IMAGE_CACHE_FILE;
+    ic->loadTime = 0;
+    ic->depth = ic->loaded = ic->hits = 0;
+
+    id[0] = IMAGE_CACHE_VERSION;
+#ifdef USE_GL
+    // Images are scaled by the GPU.
+    id[1] = id[2] = 0;
+#else
+    id[1] = xu4.settings->scale;
+    id[2] = xu4.settings->filter;
+#endif
+    ic->pakId = (uint32_t) fnv1a(FNV_INIT, id, sizeof(id));
+
+    if (cdi_mapPak(&ic->pak, ic->path.c_str(), &head)) {
+        if (head.appId == ic->pakId) {
+            ic->toc = cdi_mapPakTOC(&ic->pak, &head);
+            if (ic->toc) {
+                ic->tocCount = CDI_TOC_SIZE((&head));
+                ic->used.resize(ic->tocCount, 0);
+            }
+        }
+        if (! ic->toc)
+            cdi_unmapPak(&ic->pak);
+    }
+    return ic;
+}
+
+/*
+ * Finish writing any new images and replace the package with it.
+ * Only the old images which were used this session are carried over so
+ * that entries for changed files or settings are dropped.
+ */
+static void cacheClose(ImageCache* ic) {
+    if (verbose)
+        printf("ImageMgr: %d images loaded in %.2f ms (%d from cache)\n",
+               ic->loaded, double(ic->loadTime) * 0.001, ic->hits);
+
+    if (ic->writer.fp && ic->toc) {
+        for (uint32_t i = 0; i < ic->tocCount; ++i) {
+            const CDIEntry* it = ic->toc + i;
+            const uint8_t* data;
+            if (! ic->used[i] ||
+                cdi_findAppId(ic->writer.toc, ic->writer.count, it->appId))
+                continue;
+            data = cdi_pakChunk(&ic->pak, it);
+            if (data)
+                cdi_writeChunk(&ic->writer, it->cdi, it->appId,
+                               data, it->bytes);
+        }
+    }
+
+    if (ic->toc)
+        cdi_unmapPak(&ic->pak);
+
+    if (ic->writer.fp) {
+        string tmp(ic->path + ".tmp");
+        if (cdi_endPak(&ic->writer)) {
+            remove(ic->path.c_str());
+            if (rename(tmp.c_str(), ic->path.c_str()) != 0)
+                remove(tmp.c_str());
+        } else {
+            remove(tmp.c_str());
+        }
+    }
+    delete ic;
+}
+
+/*
+ * Return the hash of the source file and all the settings used to load it.
+ */
+static uint64_t cacheKey(const ImageInfo* info, const uint8_t* src, long len,
+                         bool unscaled) {
+    int32_t param[12];
+    const string& video = xu4.settings->videoType;
+    uint64_t hash;
+
+    param[0]  = info->filetype;
+    param[1]  = info->width;
+    param[2]  = info->height;
+    param[3]  = info->depth;
+    param[4]  = info->tiles;
+    param[5]  = info->prescale;
+    param[6]  = info->fixup;
+    param[7]  = (info->name == BKGD_SHAPES);
+    param[8]  = unscaled;
+    param[9]  = 0;
+    param[10] = 0;
+    param[11] = 0;
+    if (info->fixup == FIXUP_BLACKTRANSPARENCYHACK &&
+        xu4.settings->enhancements &&
+        xu4.settings->enhancementsOptions.u4TileTransparencyHack) {
+        const SettingsEnhancementOptions& opt =
+            xu4.settings->enhancementsOptions;
+        param[9]  = 1;
+        param[10] = opt.u4TrileTransparencyHackShadowBreadth;
+        param[11] = opt.u4TileTransparencyHackPixelShadowOpacity;
+    }
+
+    hash = fnv1a(FNV_INIT, src, len);
+    hash = fnv1a(hash, param, sizeof(param));
+    hash = fnv1a(hash, video.c_str(), video.size());
+    if (info->fixup == FIXUP_INTRO) {
+        const unsigned char* sig = xu4.intro->getSigData();
+        size_t n = 0;
+        while (sig[n])
+            n += 2;
+        hash = fnv1a(hash, sig, n);
+    }
+    return hash;
+}
+
+/*
+ * Return a new image from the cache or NULL if the key is not found.
+ */
+static Image* cacheFind(ImageCache* ic, uint64_t key, int16_t* srcDim) {
+    const CDIEntry* ent;
+    const uint8_t* chunk;
+    ImageCacheHead head;
+    Image* img;
+    uint32_t bytes;
+
+    if (! ic->toc)
+        return NULL;
+    ent = cdi_findAppId(ic->toc, ic->tocCount, (uint32_t) key);
+    if (! ent || ent->cdi != DA7A_IMAGE_RGBA8 ||
+        ent->bytes < sizeof(head) ||
+        ! (chunk = cdi_pakChunk(&ic->pak, ent)))
+        return NULL;
+
+    memcpy(&head, chunk, sizeof(head));
+    bytes = head.w * head.h * 4;
+    if (head.check != uint32_t(key >> 32) ||
+        ent->bytes != sizeof(head) + bytes)
+        return NULL;
+
+    img = Image::create(head.w, head.h);
+    if (img) {
+        ic->used[ent - ic->toc] = 1;
+        memcpy(img->pixels, chunk + sizeof(head), bytes);
+        srcDim[0] = head.srcW;
+        srcDim[1] = head.srcH;
+    }
+    return img;
+}
+
+/*
+ * Add an image to the new package.  The used images of the current one
+ * are copied to it by cacheClose().
+ */
+static void cacheStore(ImageCache* ic, uint64_t key, const Image* img,
+                       int srcW, int srcH) {
+    ImageCacheHead head;
+    uint32_t bytes = img->w * img->h * 4;
+    uint8_t* chunk;
+
+    if (! ic->writer.fp) {
+        string tmp(ic->path + ".tmp");
+        if (! cdi_beginPak(&ic->writer, tmp.c_str(), ic->pakId))
+            return;
+    } else if (cdi_findAppId(ic->writer.toc, ic->writer.count,
+                             (uint32_t) key)) {
+        // Another image has the same appId; cacheFind() could only ever
+        // return the first one.
+        return;
+    }
+
+    chunk = (uint8_t*) malloc(sizeof(head) + bytes);
+    if (chunk) {
+        head.check = uint32_t(key >> 32);
+        head.srcW  = srcW;
+        head.srcH  = srcH;
+        head.w     = img->w;
+        head.h     = img->h;
+        memcpy(chunk, &head, sizeof(head));
+        memcpy(chunk + sizeof(head), img->pixels, bytes);
+        cdi_writeChunk(&ic->writer, DA7A_IMAGE_RGBA8, (uint32_t) key,
+                       chunk, sizeof(head) + bytes);
+        free(chunk);
+    }
+}
+#endif
 
 
 ImageSymbols ImageMgr::sym;
 
-ImageMgr::ImageMgr() : vgaColors(NULL), resGroup(0) {
+ImageMgr::ImageMgr() : vgaColors(NULL), vgaMissing(false), resGroup(0) {
+#ifdef CONF_MODULE
+    cache = cacheOpen();
+#endif
 #ifdef TRACE_ON
     logger = new Debug("debug/imagemgr.txt", "ImageMgr");
     TRACE(*logger, "creating ImageMgr");
@@ -56,6 +300,9 @@ ImageMgr::~ImageMgr() {
 
     delete[] vgaColors;
     delete logger;
+#ifdef CONF_MODULE
+    cacheClose(cache);
+#endif
 }
 
 #ifdef USE_GL
@@ -356,11 +603,10 @@ U4FILE * ImageMgr::getImageFile(ImageInfo *info)
         file = u4fopen(basename);
 #ifdef CONF_MODULE
     } else if (fn[0] == 'I' && fn[2] < 0x20) {
-        const CDIEntry* ent = xu4.config->imageFile(fn);
-        if (ent) {
-            file = u4fopen_stdio(xu4.config->modulePath());
-            u4fseek(file, ent->offset, SEEK_SET);
-        } else
+        FileView view;
+        if (xu4.config->imageFile(fn, &view))
+            file = u4fopen_mem(view.data, view.bytes);
+        else
             file = NULL;
     } else
         file = NULL;
@@ -408,23 +654,30 @@ ImageInfo *ImageMgr::get(Symbol name, bool returnUnscaled) {
 
 #ifdef CONF_MODULE
 static Image* buildAtlas(ImageMgr* mgr, ImageInfo* atlas) {
-    const int maxChild = 16;
-    AtlasSubImage asiBuffer[maxChild];
-    const ImageInfo* subInfo[maxChild];
+    AtlasSubImage asiBuffer[ATLAS_CHILD_MAX];
+    const ImageInfo* subInfo[ATLAS_CHILD_MAX];
     const ImageInfo* info;
     RGBA brush;
     int i, n;
     int siCount = 0;
-    int count = xu4.config->atlasImages(atlas->filename, asiBuffer, maxChild);
+    int count = xu4.config->atlasImages(atlas->filename, asiBuffer,
+                                        ATLAS_CHILD_MAX);
     Image* image = Image::create(atlas->width, atlas->height);
 
     rgba_set(brush, 255, 0, 255, 255);
 
+    // Load all the child images before composing the atlas.  Only the
+    // children are needed; the atlas image is not touched until they are
+    // all resident.
+    for (i = 0; i < count; ++i) {
+        Symbol name = asiBuffer[i].name;
+        subInfo[i] = (name < AEDIT_OP_COUNT) ? NULL : mgr->get(name, true);
+    }
+
     // Blit the child images and count the total number of SubImages.
     for (i = 0; i < count; ++i) {
         const AtlasSubImage* asi = asiBuffer + i;
         if (asi->name < AEDIT_OP_COUNT) {
-            subInfo[i] = NULL;
             switch (asi->name) {
                 case AEDIT_BRUSH:
                     rgba_set(brush, asi->x, asi->y, asi->w, asi->h);
@@ -435,7 +688,7 @@ static Image* buildAtlas(ImageMgr* mgr, ImageInfo* atlas) {
                     break;
             }
         } else {
-            subInfo[i] = info = mgr->get(asi->name, true);
+            info = subInfo[i];
             if (info && info->image) {
                 image32_blit(image, asi->x, asi->y, info->image, 0);
 
@@ -531,92 +784,162 @@ static Image* buildAtlas(ImageMgr* mgr, ImageInfo* atlas) {
 }
 #endif
 
+/*
+ * An image being loaded.  loadBegin() and loadEnd() must be called on the
+ * main thread, but loadDecode() only uses the job & image data so it can be
+ * run on a worker thread.
+ */
+struct ImageJob {
+    ImageInfo* info;
+    U4FILE* file;
+    uint8_t* source;        // Copy of the file contents (or NULL).
+    Image* image;
+    const RGBA* palette;    // Resolved on the main thread for loadDecode().
+#ifdef CONF_MODULE
+    uint64_t key;
+#endif
+    int srcW, srcH;
+    bool returnUnscaled;
+    bool cached;            // Image is from the cache & needs no decoding.
+    bool worker;            // Decoded by a worker thread.
+    bool done;              // Set by the worker when loadDecode() returns.
+};
+
 ImageInfo* ImageMgr::load(ImageInfo* info, bool returnUnscaled) {
+    PROF_ZONE("loadImage");
+    ImageJob job;
 #ifdef CONF_MODULE
     if (info->filetype == FTYPE_ATLAS) {
         info->image = buildAtlas(this, info);
         info->resGroup = resGroup;
         return info;
     }
-#endif
-
-    U4FILE *file = getImageFile(info);
-    Image *unscaled = NULL;
-    if (file) {
-        TRACE(*logger, string("loading image from file '") + info->filename + string("'"));
-        //printf( "ImageMgr load %d:%s\n", resGroup, info->filename.c_str() );
-
-        unscaled = loadImage(file, info->filetype, info->width, info->height,
-                             info->depth);
-        u4fclose(file);
-
-        if (! unscaled) {
-            errorWarning("Can't load image \"%s\" with type %d",
-                         xu4.config->confString(info->filename), info->filetype);
-            return info;
-        }
 
-        info->resGroup = resGroup;
-        if (info->width == -1) {
-            // Write in the values for later use.
-            info->width  = unscaled->width();
-            info->height = unscaled->height();
-        }
-
-#ifdef USE_GL
-        // Pre-compute tile UVs.
-        if (info->tiles > 1 && info->tileTexCoord == NULL ) {
-            // Assuming image is one tile wide.
-            float iwf = (float) unscaled->width();
-            float ihf = (float) unscaled->height();
-            float tileH = iwf;
-            float tileY = 0.0f;
-            float *uv;
-            int tileCount = info->tiles;
-
-            info->tileTexCoord = uv = new float[tileCount * 4];
-            for (int i = 0; i < tileCount; ++i) {
-                *uv++ = 0.0f;
-                *uv++ = tileY / ihf;
-                *uv++ = 1.0f;
-                *uv++ = (tileY + tileH) / ihf;
-                tileY += tileH;
-            }
-        }
-        /*
-        SubImage* simg = (SubImage*) info->subImages;
-        SubImage* end = simg + info->subImageCount;
-        while (simg != end) {
-            simg->u0 = simg->x / iwf;
-            simg->v0 = simg->y / ihf;
-            simg->u1 = (simg->x + simg->width) / iwf;
-            simg->v1 = (simg->y + simg->height) / ihf;
-            ++simg;
-        }
-        */
+    uint64_t startTime = getMicroTicks();
+    ++cache->depth;
 #endif
+    if (loadBegin(&job, info, returnUnscaled)) {
+        loadDecode(&job);
+        info = loadEnd(&job);
+    } else {
+        info = NULL;
+    }
+#ifdef CONF_MODULE
+    if (--cache->depth == 0)
+        cache->loadTime += getMicroTicks() - startTime;
+#endif
+    return info;
+}
 
-#if 0
-        string out("/tmp/xu4/");
-        unscaled->save(out.append(name).append(".ppm").c_str());
+/*
+ * Open the file of an image and (with CONF_MODULE) look for it in the cache.
+ * The file is read into memory so that decoding does not touch any shared
+ * U4FILE state.
+ *
+ * Return false if the file cannot be opened.
+ */
+bool ImageMgr::loadBegin(ImageJob* job, ImageInfo* info, bool returnUnscaled) {
+    U4FILE* file = getImageFile(info);
+    const uint8_t* data;
+    long len;
+
+    job->info   = info;
+    job->file   = file;
+    job->source = NULL;
+    job->image  = NULL;
+    job->palette = NULL;
+#ifdef CONF_MODULE
+    job->key    = 0;
 #endif
-    }
-    else
-    {
+    job->returnUnscaled = returnUnscaled;
+    job->cached = job->worker = job->done = false;
+
+    if (! file) {
         errorWarning("Failed to open file %s for reading.",
                      xu4.config->confString(info->filename));
-        return NULL;
+        return false;
+    }
+    TRACE(*logger, string("loading image from file '") + info->filename + string("'"));
+    //printf( "ImageMgr load %d:%s\n", resGroup, info->filename.c_str() );
+
+    len  = file->length();
+    data = (const uint8_t*) file->contents();
+    if (! data) {
+        job->source = (uint8_t*) malloc(len);
+        if (job->source && file->read(job->source, 1, len) == (size_t) len) {
+            u4fclose(file);
+            job->file = u4fopen_mem(job->source, len);
+            data = job->source;
+        } else {
+            free(job->source);
+            job->source = NULL;
+            file->seek(0, SEEK_SET);
+        }
     }
 
-    if (unscaled == NULL)
-        return NULL;
+#ifdef CONF_MODULE
+    ++cache->loaded;
+
+    // The vision fixup depends on the previously loaded vision so
+    // these images are never cached.
+    if (data && info->fixup != FIXUP_ABYSS) {
+        int16_t dim[2];
+        job->key = cacheKey(info, data, len, returnUnscaled);
+        job->image = cacheFind(cache, job->key, dim);
+        if (job->image) {
+            ++cache->hits;
+            job->cached = true;
+            job->srcW = dim[0];
+            job->srcH = dim[1];
+        }
+    }
+#endif
+
+    // The palettes may need to be loaded so this is not left to loadDecode().
+    if (! job->cached)
+        job->palette = stdPalette(info->depth);
 
 #ifdef USE_GL
     info->prescale = 1;
 #else
     if (info->prescale == 0)
         info->prescale = 1;
+
+    if (! returnUnscaled && ! job->cached &&
+        (xu4.settings->scale % info->prescale) != 0) {
+        int orig_scale = xu4.settings->scale;
+        xu4.settings->scale = info->prescale;
+        xu4.settings->write();
+        errorFatal("image %s is prescaled to an incompatible size: %d\n"
+            "Resetting the scale to %d. Sorry about the inconvenience, please restart.",
+            xu4.config->confString(info->filename), orig_scale,
+            xu4.settings->scale);
+    }
 #endif
+    return true;
+}
+
+/*
+ * Decode, fix up and scale the image of a job started with loadBegin().
+ * This is called from worker threads so it must not use anything other than
+ * the job and the settings.
+ */
+void ImageMgr::loadDecode(ImageJob* job) {
+    const ImageInfo* info = job->info;
+    Image* unscaled = NULL;
+
+    if (! job->cached)
+        unscaled = loadImage(job->file, info->filetype, info->width,
+                             info->height, info->depth, job->palette);
+    u4fclose(job->file);
+    job->file = NULL;
+    free(job->source);
+    job->source = NULL;
+
+    if (! unscaled)
+        return;
+    job->srcW = unscaled->width();
+    job->srcH = unscaled->height();
 
     /*
      * fixup the image before scaling it
@@ -659,43 +982,241 @@ ImageInfo* ImageMgr::load(ImageInfo* info, bool returnUnscaled) {
         break;
     }
 
-#if 0
-    string out2("/tmp/xu4/");
-    unscaled->save(out2.append(name).append("-fixup.ppm").c_str());
+#ifndef USE_GL
+    if (! job->returnUnscaled) {
+        Image* scaled = screenScale(unscaled,
+                                    xu4.settings->scale / info->prescale,
+                                    info->tiles, 1);
+        delete unscaled;
+        unscaled = scaled;
+    }
 #endif
+    job->image = unscaled;
+}
 
-#ifdef USE_GL
-    info->image = unscaled;
-    //info->tex = gpu_makeTexture(info->image);
-#else
-    if (returnUnscaled)
-    {
-        info->image = unscaled;
+/*
+ * Assign the image decoded by loadDecode() to the ImageInfo.
+ */
+ImageInfo* ImageMgr::loadEnd(ImageJob* job) {
+    ImageInfo* info = job->info;
+
+    if (! job->image) {
+        errorWarning("Can't load image \"%s\" with type %d",
+                     xu4.config->confString(info->filename), info->filetype);
         return info;
     }
 
-    int imageScale = xu4.settings->scale;
-    if ((imageScale % info->prescale) != 0) {
-        int orig_scale = imageScale;
-        xu4.settings->scale = info->prescale;
-        xu4.settings->write();
-        errorFatal("image %s is prescaled to an incompatible size: %d\n"
-            "Resetting the scale to %d. Sorry about the inconvenience, please restart.",
-            xu4.config->confString(info->filename), orig_scale,
-            xu4.settings->scale);
+    info->resGroup = resGroup;
+    if (info->width == -1) {
+        // Write in the values for later use.
+        info->width  = job->srcW;
+        info->height = job->srcH;
+    }
+
+#ifdef USE_GL
+    // Pre-compute tile UVs.
+    if (info->tiles > 1 && info->tileTexCoord == NULL ) {
+        // Assuming image is one tile wide.
+        float iwf = (float) job->srcW;
+        float ihf = (float) job->srcH;
+        float tileH = iwf;
+        float tileY = 0.0f;
+        float *uv;
+        int tileCount = info->tiles;
+
+        info->tileTexCoord = uv = new float[tileCount * 4];
+        for (int i = 0; i < tileCount; ++i) {
+            *uv++ = 0.0f;
+            *uv++ = tileY / ihf;
+            *uv++ = 1.0f;
+            *uv++ = (tileY + tileH) / ihf;
+            tileY += tileH;
+        }
     }
-    imageScale /= info->prescale;
+#endif
 
-    info->image = screenScale(unscaled, imageScale, info->tiles, 1);
-    delete unscaled;
+    info->image = job->image;
+#ifdef CONF_MODULE
+    if (job->key && ! job->cached)
+        cacheStore(cache, job->key, info->image, job->srcW, job->srcH);
+#endif
+    return info;
+}
 
-#if 0
-    string out3("/tmp/xu4/");
-    info->image->save(out3.append(name).append("-scale.ppm").c_str());
+// Maximum number of threads used to decode images.
+#define DECODE_THREADS_MAX  8
+
+struct DecodeQueue {
+    ImageMgr* mgr;
+    ImageJob** jobs;
+    int count;
+    int next;               // Index of the next job to take.
+    Mutex* mutex;
+    Cond* cond;             // Broadcast when a job is done.
+};
+
+void ImageMgr::decodeWorker(void* arg) {
+    DecodeQueue* dq = (DecodeQueue*) arg;
+    ImageJob* job;
+
+    for (;;) {
+        mutexLock(dq->mutex);
+        job = (dq->next < dq->count) ? dq->jobs[dq->next++] : NULL;
+        mutexUnlock(dq->mutex);
+        if (! job)
+            break;
+
+        dq->mgr->loadDecode(job);
+
+        mutexLock(dq->mutex);
+        job->done = true;
+        condBroadcast(dq->cond);
+        mutexUnlock(dq->mutex);
+    }
+}
+
+/*
+ * Add a job to load an image unless it is already loaded or queued.
+ */
+static void addJob(std::vector<ImageJob>& jobs, ImageInfo* info,
+                   bool returnUnscaled) {
+    std::vector<ImageJob>::const_iterator it;
+
+    if (info->image || info->filetype == FTYPE_ATLAS)
+        return;
+    for (it = jobs.begin(); it != jobs.end(); ++it) {
+        if (it->info == info)
+            return;
+    }
+    jobs.push_back(ImageJob());
+    jobs.back().info = info;
+    jobs.back().returnUnscaled = returnUnscaled;
+}
+
+/**
+ * Load a number of images at once.  The names may also be those of
+ * SubImages, in which case the image holding them is loaded.
+ *
+ * The images are decoded and scaled on worker threads while the main
+ * thread assigns them in order.  An atlas is built as soon as all of its
+ * children are loaded.
+ */
+void ImageMgr::preload(const Symbol* names, int count) {
+    PROF_ZONE("preloadImages");
+    std::vector<ImageJob> jobs;
+    std::vector<ImageJob*> queue;
+    std::vector< std::pair<ImageInfo*, size_t> > atlases;
+    Thread* threads[DECODE_THREADS_MAX];
+    DecodeQueue dq;
+    ImageInfo* info;
+    size_t i, ai;
+    int threadCount = 0;
+    uint64_t startTime = getMicroTicks();
+
+    for (int n = 0; n < count; ++n) {
+        info = getInfoFromSet(names[n], baseSet);
+        if (! info && ! getSubImage(names[n], &info))
+            continue;
+        if (info->image)
+            continue;
+#ifdef CONF_MODULE
+        if (info->filetype == FTYPE_ATLAS) {
+            AtlasSubImage asi[ATLAS_CHILD_MAX];
+            int acount = xu4.config->atlasImages(info->filename, asi,
+                                                 ATLAS_CHILD_MAX);
+            for (int c = 0; c < acount; ++c) {
+                if (asi[c].name >= AEDIT_OP_COUNT) {
+                    ImageInfo* child = getInfoFromSet(asi[c].name, baseSet);
+                    if (child)
+                        addJob(jobs, child, true);
+                }
+            }
+            atlases.push_back(std::make_pair(info, jobs.size()));
+            continue;
+        }
 #endif
+        addJob(jobs, info, false);
+    }
+
+#ifdef CONF_MODULE
+    ++cache->depth;
 #endif
+    for (i = 0; i < jobs.size(); ++i) {
+        ImageJob& job = jobs[i];
+        if (! loadBegin(&job, job.info, job.returnUnscaled)) {
+            job.info = NULL;
+            continue;
+        }
+        // The intro & vision fixups use data outside the job.
+        if (! job.cached && job.file->contents() &&
+            job.info->fixup != FIXUP_INTRO && job.info->fixup != FIXUP_ABYSS) {
+            job.worker = true;
+            queue.push_back(&job);
+        }
+    }
 
-    return info;
+    dq.mgr   = this;
+    dq.jobs  = queue.empty() ? NULL : &queue.front();
+    dq.count = queue.size();
+    dq.next  = 0;
+    dq.mutex = NULL;
+    dq.cond  = NULL;
+    if (dq.count > 1) {
+        dq.mutex = mutexCreate();
+        dq.cond  = condCreate();
+        if (dq.mutex && dq.cond) {
+            int n = cpuCount();
+            if (n > DECODE_THREADS_MAX)
+                n = DECODE_THREADS_MAX;
+            if (n > dq.count)
+                n = dq.count;
+            for (; threadCount < n; ++threadCount) {
+                threads[threadCount] = threadCreate(decodeWorker, &dq);
+                if (! threads[threadCount])
+                    break;
+            }
+        }
+    }
+
+    for (i = ai = 0; ; ++i) {
+        // Build any atlas whose children have all been loaded.
+        for (; ai < atlases.size() && atlases[ai].second <= i; ++ai) {
+            if (! atlases[ai].first->image)
+                load(atlases[ai].first, false);
+        }
+        if (i == jobs.size())
+            break;
+
+        ImageJob& job = jobs[i];
+        if (! job.info)
+            continue;
+        if (job.worker && threadCount) {
+            mutexLock(dq.mutex);
+            while (! job.done)
+                condWait(dq.cond, dq.mutex);
+            mutexUnlock(dq.mutex);
+        } else {
+            loadDecode(&job);
+        }
+        loadEnd(&job);
+    }
+
+    int workers = threadCount;
+    while (threadCount)
+        threadJoin(threads[--threadCount]);
+    if (dq.cond)
+        condFree(dq.cond);
+    if (dq.mutex)
+        mutexFree(dq.mutex);
+
+#ifdef CONF_MODULE
+    if (--cache->depth == 0)
+        cache->loadTime += getMicroTicks() - startTime;
+#endif
+    if (verbose)
+        printf("ImageMgr: preloaded %d images (%d decoded by %d threads)"
+               " in %.2f ms\n", (int) jobs.size(), dq.count, workers,
+               double(getMicroTicks() - startTime) * 0.001);
 }
 
 /**
@@ -757,12 +1278,15 @@ void ImageMgr::freeResourceGroup(uint16_t group) {
 
 /**
  * Get the 256 color VGA palette from the u4upgrad file.
+ * A missing file is remembered so it is only searched for once.
  */
 const RGBA* ImageMgr::vgaPalette() {
-    if (vgaColors == NULL) {
+    if (vgaColors == NULL && ! vgaMissing) {
         U4FILE *pal = u4fopen("u4vga.pal");
-        if (!pal)
+        if (!pal) {
+            vgaMissing = true;
             return NULL;
+        }
 
         vgaColors = new RGBA[256];
 
@@ -134,6 +134,8 @@ struct AtlasSubImage {
     int16_t x, y, w, h;
 };
 
+#define ATLAS_CHILD_MAX 16
+
 struct SubImage {
     Symbol name;
     int16_t x, y, width, height;
@@ -206,6 +208,7 @@ public:
 
     ImageInfo* imageInfo(Symbol name, const SubImage** subPtr);
     ImageInfo* get(Symbol name, bool returnUnscaled=false);
+    void preload(const Symbol* names, int count);
 
     uint16_t setResourceGroup(uint16_t group);
     void freeResourceGroup(uint16_t group);
@@ -216,6 +219,10 @@ private:
     static void notice(int, void*, void*);
     const SubImage* getSubImage(Symbol name, ImageInfo** infoPtr);
     ImageInfo* load(ImageInfo* info, bool returnUnscaled);
+    bool loadBegin(struct ImageJob* job, ImageInfo* info, bool returnUnscaled);
+    void loadDecode(struct ImageJob* job);
+    ImageInfo* loadEnd(struct ImageJob* job);
+    static void decodeWorker(void* arg);
     U4FILE * getImageFile(ImageInfo *info);
     ImageSet* scheme(Symbol setname);
     ImageInfo* getInfoFromSet(Symbol name, ImageSet *set);
@@ -229,9 +236,13 @@ private:
     std::map<Symbol, ImageSet *> imageSets;
     ImageSet *baseSet;
     RGBA* vgaColors;
+    bool vgaMissing;
     Debug *logger;
     int listenerId;
     uint16_t resGroup;
+#ifdef CONF_MODULE
+    struct ImageCache* cache;
+#endif
 };
 
 #endif /* IMAGEMGR_H */
@@ -195,6 +195,7 @@ private:
         MI_GAMEPLAY_04,
         MI_GAMEPLAY_05,
         MI_GAMEPLAY_06,
+        MI_GAMEPLAY_07,
         MI_INTERFACE_01,
         MI_INTERFACE_02,
         MI_INTERFACE_03,
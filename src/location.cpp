@@ -2,10 +2,6 @@
  * $Id$
  */
 
-#include <list>
-#include <map>
-#include <set>
-
 #include "location.h"
 
 #include "context.h"
@@ -44,10 +40,9 @@ void locationFree(Location **stack) {
 }
 
 /**
- * Append the entire stack of objects at the given location to a vector.
+ * Append the entire stack of objects at the given location to a TileStack.
  */
-void Location::getTilesAt(std::vector<MapTile>& tiles,
-                          const Coords& coords, bool& focus) {
+void Location::getTilesAt(TileStack& tiles, const Coords& coords, bool& focus) {
     const Object *obj = map->objectAt(coords);
     const Creature *m = dynamic_cast<const Creature *>(obj);
     focus = false;
@@ -69,18 +64,20 @@ void Location::getTilesAt(std::vector<MapTile>& tiles,
         tiles.push_back(c->party->getTransport());
 
     /* Add visual-only annotations to the list */
-    std::list<Annotation *> annot = map->annotations.ptrsToAllAt(coords);
-    std::list<Annotation *>::const_iterator i;
-    for (i = annot.begin(); i != annot.end(); i++) {
-        if ((*i)->visualOnly)
+    const Annotation* annot[ANNOTATIONS_AT_MAX];
+    int annotCount = map->annotations.ptrsToAllAt(coords, annot,
+                                                  ANNOTATIONS_AT_MAX);
+    int i;
+    for (i = 0; i < annotCount; i++) {
+        if (annot[i]->visualOnly)
         {
-            tiles.push_back((*i)->tile);
+            tiles.push_back(annot[i]->tile);
 
             /* If this is the first cover-up annotation,
              * everything underneath it will be invisible,
              * so stop here
              */
-            if ((*i)->coverUp)
+            if (annot[i]->coverUp)
                 return;
         }
     }
@@ -114,15 +111,15 @@ void Location::getTilesAt(std::vector<MapTile>& tiles,
         tiles.push_back(c->party->getTransport());
 
     /* then permanent annotations */
-    for (i = annot.begin(); i != annot.end(); i++) {
-        if (!(*i)->visualOnly) {
-            tiles.push_back((*i)->tile);
+    for (i = 0; i < annotCount; i++) {
+        if (!annot[i]->visualOnly) {
+            tiles.push_back(annot[i]->tile);
 
             /* If this is the first cover-up annotation,
              * everything underneath it will be invisible,
              * so stop here
              */
-            if ((*i)->coverUp)
+            if (annot[i]->coverUp)
                 return;
         }
     }
@@ -148,26 +145,34 @@ void Location::getTilesAt(std::vector<MapTile>& tiles,
  * cannot be found, it returns a "best guess" tile.
  */
 TileId Location::getReplacementTile(const Coords& atCoords, const Tile * forTile) {
-    std::map<TileId, int> validMapTileCount;
+    // The search stops before the queue holds 64 steps, so a small ring
+    // buffer is enough and no memory need be allocated.
+    const int queueSize = 128;
+    Coords searchQueue[queueSize];
+    int queueHead = 0;
+    int queueLen = 0;
+
+    // Each step examines four neighbors.
+    TileId validId[4];
+    int validCount[4];
+    int validLen;
 
     const static int dirs[][2] = {{-1,0},{1,0},{0,-1},{0,1}};
     const static int dirs_per_step = sizeof(dirs) / sizeof(*dirs);
     int loop_count = 0;
-
-    std::set<Coords> searched;
-    std::list<Coords> searchQueue;
+    int i, j;
 
     //Pathfinding to closest traversable tile with appropriate replacement properties.
     //For tiles marked water-replaceable, pathfinding includes swimmables.
-    searchQueue.push_back(atCoords);
+    searchQueue[queueLen++] = atCoords;
     do
     {
-        Coords currentStep = searchQueue.front();
-        searchQueue.pop_front();
+        Coords currentStep = searchQueue[queueHead];
+        queueHead = (queueHead + 1) & (queueSize - 1);
+        --queueLen;
 
-        searched.insert(currentStep);
-
-        for (int i = 0; i < dirs_per_step; i++)
+        validLen = 0;
+        for (i = 0; i < dirs_per_step; i++)
         {
             Coords newStep(currentStep);
             map_move(newStep, dirs[i][0], dirs[i][1], map);
@@ -175,46 +180,47 @@ TileId Location::getReplacementTile(const Coords& atCoords, const Tile * forTile
             Tile const * tileType = map->tileTypeAt(newStep,WITHOUT_OBJECTS);
 
             if (!tileType->isOpaque()) {
-                //if (searched.find(newStep) == searched.end()) -- the find mechanism doesn't work.
-                searchQueue.push_back(newStep);
+                searchQueue[(queueHead + queueLen) & (queueSize - 1)] = newStep;
+                ++queueLen;
             }
 
             if ((tileType->isReplacement() && (forTile->isLandForeground() || forTile->isLivingObject())) ||
                 (tileType->isWaterReplacement() && forTile->isWaterForeground()))
             {
-                std::map<TileId, int>::iterator validCount = validMapTileCount.find(tileType->getId());
-
-                if (validCount == validMapTileCount.end())
-                {
-                    validMapTileCount[tileType->getId()] = 1;
+                TileId id = tileType->getId();
+                for (j = 0; j < validLen; j++) {
+                    if (validId[j] == id)
+                        break;
                 }
-                else
-                {
-                    validMapTileCount[tileType->getId()]++;
+                if (j == validLen) {
+                    validId[j] = id;
+                    validCount[j] = 0;
+                    ++validLen;
                 }
+                validCount[j]++;
             }
         }
 
-        if (validMapTileCount.size() > 0)
+        if (validLen > 0)
         {
-            std::map<TileId, int>::iterator itr = validMapTileCount.begin();
-
-            TileId winner = itr->first;
-            int score = itr->second;
+            // Pick the most common tile, or the lowest id of those tied.
+            TileId winner = validId[0];
+            int score = validCount[0];
 
-            while (++itr != validMapTileCount.end())
+            for (j = 1; j < validLen; j++)
             {
-                if (score < itr->second)
+                if (score < validCount[j] ||
+                    (score == validCount[j] && validId[j] < winner))
                 {
-                    score = itr->second;
-                    winner = itr->first;
+                    score = validCount[j];
+                    winner = validId[j];
                 }
             }
 
             return winner;
         }
         /* loop_count is an ugly hack to temporarily fix infinite loop */
-    } while (++loop_count < 128 && searchQueue.size() > 0 && searchQueue.size() < 64);
+    } while (++loop_count < 128 && queueLen > 0 && queueLen < 64);
 
     /* couldn't find a tile, give it the classic default */
     return map->tileset->getByName(Tile::sym.brickFloor)->getId();
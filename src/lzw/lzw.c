@@ -37,23 +37,8 @@
 #include <stdlib.h>
 #include <string.h>
 
-typedef void (*WRITE_DECOMP)(unsigned char root, unsigned char *destination, long* position);
-
-typedef struct _lzwDictionaryEntry
-{
-    unsigned char root;
-    int codeword;
-    unsigned char occupied;
-} lzwDictionaryEntry;
-
-long generalizedDecompress(WRITE_DECOMP outFunc, unsigned char* compressedMem, unsigned char* decompressedMem, long compressedSize);
-int getNextCodeword(long* bitsRead, unsigned char *compressedMem);
-void discardRoot(unsigned char root, unsigned char *destination, long* position);
-void outputRoot(unsigned char root, unsigned char *destination, long* position);
-
-void getString(int codeword, lzwDictionaryEntry *lzwDictionary, unsigned char* stack, int *elementsInStack);
-int getNewHashCode(unsigned char root, int codeword, lzwDictionaryEntry* dictionary);
-unsigned char hashPosFound(int hashCode, unsigned char root, int codeword, lzwDictionaryEntry* dictionary);
+static int getNewHashCode(unsigned char root, int codeword, const LZWEntry* dictionary);
+static unsigned char hashPosFound(int hashCode, unsigned char root, int codeword, const LZWEntry* dictionary);
 
 /*
  * This function returns the decompressed size of a block of compressed data.
@@ -66,9 +51,15 @@ unsigned char hashPosFound(int hashCode, unsigned char root, int codeword, lzwDi
  * No errors: (long) decompressed size
  * Error: (long) -1
  */
-long lzwGetDecompressedSize(unsigned char* compressedMem, long compressedSize)
+long lzwGetDecompressedSize(const unsigned char* compressedMem, long compressedSize)
 {
-    return(generalizedDecompress(&discardRoot, compressedMem, NULL, compressedSize));
+    long size;
+    LZWEntry* dict = (LZWEntry *) malloc(sizeof(LZWEntry) * LZW_DICT_SIZE);
+    if (! dict)
+        return(-1);
+    size = lzwDecodeU4(compressedMem, compressedSize, NULL, 0, dict);
+    free(dict);
+    return(size);
 }
 
 /*
@@ -82,209 +73,342 @@ long lzwGetDecompressedSize(unsigned char* compressedMem, long compressedSize)
  * No errors: (long) decompressed size
  * Error: (long) -1
  */
-long lzwDecompress(unsigned char* compressedMem, unsigned char* decompressedMem, long compressedSize)
+long lzwDecompress(const unsigned char* compressedMem, unsigned char* decompressedMem, long compressedSize)
 {
-    return(generalizedDecompress(&outputRoot, compressedMem, decompressedMem, compressedSize));
+    long size;
+    LZWEntry* dict = (LZWEntry *) malloc(sizeof(LZWEntry) * LZW_DICT_SIZE);
+    if (! dict)
+        return(-1);
+    size = lzwDecodeU4(compressedMem, compressedSize, decompressedMem, 0x7fffffff, dict);
+    free(dict);
+    return(size);
 }
 
 /* --------------------------------------------------------------------------------------
    Functions used only inside lzw.c
    -------------------------------------------------------------------------------------- */
 
+/* clear the dictionary so that it only contains the roots */
+static void clearDictionary(LZWEntry* dict)
+{
+    int i;
+    memset(dict, 0, sizeof(LZWEntry) * LZW_DICT_SIZE);
+    for (i = 0; i < 0x100; i++)
+    {
+        dict[i].len = 1;
+        dict[i].first = (uint8_t) i;
+    }
+}
+
 /*
- * This function does the actual decompression work.
- * Parameters:
- * perform_decompression: FALSE ==> return decompressed size, but discard decompressed data
- * compressed_mem: compressed data
- * decompressed_mem: this is where the compressed data will be decompressed to
- * compressed_size: size of the compressed data (in bytes)
+ * Output the string of a codeword in the dictionary.
+ * Returns zero if the string does not fit in the output.
  */
-long generalizedDecompress(WRITE_DECOMP outFunc, unsigned char* compressedMem, unsigned char* decompressedMem, long compressedSize)
+static int outputString(const LZWEntry* entry, int codeword, uint8_t* out, long pos, long outlen)
 {
-    int i;
+    if (out)
+    {
+        if (pos + entry->len > outlen)
+            return(0);
+        if (codeword < 0x100)
+            out[pos] = (uint8_t) codeword;
+        else
+            memcpy(out + pos, out + entry->pos, entry->len);
+    }
+    return(1);
+}
+
+/*
+ * Output the string of the previous codeword followed by its first
+ * character.  This is the string of a codeword that is yet to be defined.
+ * Returns zero if the string does not fit in the output.
+ */
+static int outputUndefined(long prevPos, long prevLen, uint8_t first, uint8_t* out, long pos, long outlen)
+{
+    if (out)
+    {
+        if (pos + prevLen + 1 > outlen)
+            return(0);
+        memcpy(out + pos, out + prevPos, prevLen);
+        out[pos + prevLen] = first;
+    }
+    return(1);
+}
 
+/*
+ * Output a single root.
+ * Returns zero if it does not fit in the output.
+ */
+static int outputRoot(uint8_t root, uint8_t* out, long pos, long outlen)
+{
+    if (out)
+    {
+        if (pos >= outlen)
+            return(0);
+        out[pos] = root;
+    }
+    return(1);
+}
+
+/*
+ * Decompresses a block of U4 LZW data from memory to memory in a single pass.
+ * Parameters:
+ * in, inlen: compressed data and its size (in bytes)
+ * out, outlen: destination and its size (in bytes).  If out is NULL, the
+ *              decompressed size is determined but nothing is written.
+ * dict: scratch space for LZW_DICT_SIZE entries
+ *
+ * Returns:
+ * No errors: (long) decompressed size
+ * Error: (long) -1 if the data is corrupt or does not fit into out
+ */
+long lzwDecodeU4(const uint8_t* in, long inlen, uint8_t* out, long outlen, LZWEntry* dict)
+{
     /* re-initialize the dictionary when there are more than 0xccc entries */
     const int maxDictEntries = 0xccc;
 
-    const int lzwStackSize = 0x8000;
-    const int lzwDictionarySize = 0x1000;
+    const long bits = inlen * 8;
+    long bitsRead = 0;
+    long bytesWritten = 0;
 
     int old_code;
     int new_code;
     unsigned char character;
 
-    long bitsRead = 0;
-    long bytesWritten = 0;
+    /* where the string for OLD_CODE was output, its length & first character */
+    long oldPos, oldLen;
+    unsigned char oldFirst;
 
     /* newpos: position in the dictionary where new codeword was added                      */
     /* must be equal to current codeword (if it isn't, the compressed data must be corrupt) */
-    /* unknownCodeword: is the current codeword in the dictionary?                          */
     int newpos;
     unsigned char unknownCodeword;
-
-    /* initialize the dictionary and the stack */
-    lzwDictionaryEntry *lzwDictionary = (lzwDictionaryEntry *) malloc(sizeof(lzwDictionaryEntry) * lzwDictionarySize);
     int codewordsInDictionary = 0;
-    unsigned char *lzwStack = (unsigned char *) malloc(sizeof(unsigned char) * lzwStackSize);
-    int elementsInStack = 0;
+    const LZWEntry* entry;
+    LZWEntry* added;
+    long len;
 
-    /* clear the dictionary */
-    memset(lzwDictionary, 0, sizeof(lzwDictionaryEntry) * lzwDictionarySize);
-    for (i = 0; i < 0x100; i++)
-    {
-        lzwDictionary[i].occupied = 1;
-    }
+/* read the next 12-bit codeword from the compressed data */
+#define NEXT_CODEWORD(cw) \
+    cw = ((in[bitsRead >> 3] << 8) | in[(bitsRead >> 3) + 1]) >> (4 - (bitsRead & 7)); \
+    cw &= 0xfff; \
+    bitsRead += 12
 
-    if (bitsRead + 12 <= compressedSize * 8)
-    {
-        /* read OLD_CODE */
-        old_code = getNextCodeword(&bitsRead, compressedMem);
-        /* CHARACTER = OLD_CODE */
-        character = (unsigned char)old_code;
-        /* output OLD_CODE */
-        outFunc(character, decompressedMem, &bytesWritten);
-
-        while (bitsRead + 12 <= compressedSize * 8) /* WHILE there are still input characters DO */
-        {
-            /* read NEW_CODE */
-            new_code = getNextCodeword(&bitsRead, compressedMem);
+    if (bitsRead + 12 > bits)
+        return(0);
 
-            if (lzwDictionary[new_code].occupied)   /* is the codeword in the dictionary? */
-            {
-                /* codeword is present in the dictionary                                               */
-                /* it must either be a root or a non-root that has already been added to the dicionary */
-                unknownCodeword = 0;
+    clearDictionary(dict);
 
-                /* STRING = get translation of NEW_CODE */
-                getString(new_code,lzwDictionary,lzwStack,&elementsInStack);
-            }
-            else
-            {
-                /* codeword is yet to be defined */
-                unknownCodeword = 1;
+    /* read OLD_CODE */
+    NEXT_CODEWORD(old_code);
+    /* CHARACTER = OLD_CODE */
+    character = (unsigned char)old_code;
+    /* output OLD_CODE */
+    if (! outputRoot(character, out, bytesWritten, outlen))
+        return(-1);
+    oldPos = bytesWritten++;
+    oldLen = 1;
+    oldFirst = character;
+
+    while (bitsRead + 12 <= bits) /* WHILE there are still input characters DO */
+    {
+        /* read NEW_CODE */
+        NEXT_CODEWORD(new_code);
 
-                /* STRING = get translation of OLD_CODE */
-                /* STRING = STRING+CHARACTER            */
-                lzwStack[elementsInStack] = character;   /* push character on the stack */
-                elementsInStack++;
+        entry = dict + new_code;
+        if (entry->len)   /* is the codeword in the dictionary? */
+        {
+            unknownCodeword = 0;
 
-                getString(old_code,lzwDictionary,lzwStack,&elementsInStack);
-            }
+            /* STRING = get translation of NEW_CODE */
+            len = entry->len;
+            character = entry->first;
+            if (! outputString(entry, new_code, out, bytesWritten, outlen))
+                return(-1);
+        }
+        else
+        {
+            /* codeword is yet to be defined */
+            unknownCodeword = 1;
+
+            /* STRING = get translation of OLD_CODE */
+            /* STRING = STRING+CHARACTER            */
+            len = oldLen + 1;
+            character = oldFirst;
+            if (! outputUndefined(oldPos, oldLen, oldFirst, out, bytesWritten, outlen))
+                return(-1);
+        }
 
-            /* CHARACTER = first character in STRING */
-            character = lzwStack[elementsInStack-1];   /* element at top of stack */
+        /* add OLD_CODE + CHARACTER to the translation table */
+        /* the string is the one for OLD_CODE which is already in the output */
+        newpos = getNewHashCode(character, old_code, dict);
 
-            /* output STRING */
-            while (elementsInStack > 0)
-            {
-                outFunc(lzwStack[elementsInStack-1], decompressedMem, &bytesWritten);
-                elementsInStack--;
-            }
+        added = dict + newpos;
+        added->pos = oldPos;
+        added->len = oldLen + 1;
+        added->codeword = old_code;
+        added->root = character;
+        added->first = oldFirst;
+        codewordsInDictionary++;
 
-            /* add OLD_CODE + CHARACTER to the translation table */
-            newpos = getNewHashCode(character,old_code,lzwDictionary);
+        /* check for errors */
+        if (unknownCodeword && (newpos != new_code))
+            return(-1);
 
-            lzwDictionary[newpos].root = character;
-            lzwDictionary[newpos].codeword = old_code;
-            lzwDictionary[newpos].occupied = 1;
-            codewordsInDictionary++;
+        oldPos = bytesWritten;
+        oldLen = len;
+        oldFirst = character;
+        bytesWritten += len;
 
-            /* check for errors */
-            if (unknownCodeword && (newpos != new_code))
-            {
-                /* clean up */
-                free(lzwStack);
-                free(lzwDictionary);
+        if (codewordsInDictionary > maxDictEntries)
+        {
+            /* wipe dictionary */
+            codewordsInDictionary = 0;
+            clearDictionary(dict);
 
-                return(-1);
+            if (bitsRead + 12 <= bits)
+            {
+                NEXT_CODEWORD(new_code);
+                character = (unsigned char)new_code;
+
+                if (! outputRoot(character, out, bytesWritten, outlen))
+                    return(-1);
+                oldPos = bytesWritten++;
+                oldLen = 1;
+                oldFirst = character;
             }
-
-            if (codewordsInDictionary > maxDictEntries)
+            else
             {
-                /* wipe dictionary */
-                codewordsInDictionary = 0;
-                memset(lzwDictionary, 0, sizeof(lzwDictionaryEntry) * lzwDictionarySize);
-                for (i = 0; i < 0x100; i++)
-                {
-                    lzwDictionary[i].occupied = 1;
-                }
-
-                if (bitsRead + 12 <= compressedSize * 8)
-                {
-                    new_code = getNextCodeword(&bitsRead, compressedMem);
-                    character = (unsigned char)new_code;
-
-                    outFunc(character, decompressedMem, &bytesWritten);
-                }
-                else
-                {
-                    /* clean up */
-                    free(lzwStack);
-                    free(lzwDictionary);
-
-                    return(bytesWritten);
-                }
+                return(bytesWritten);
             }
-
-            /* OLD_CODE = NEW_CODE */
-            old_code = new_code;
         }
-    }    
-    /* clean up */
-    free(lzwStack);
-    free(lzwDictionary);
+
+        /* OLD_CODE = NEW_CODE */
+        old_code = new_code;
+    }
 
     return(bytesWritten);
 }
 
-/* read the next 12-bit codeword from the compressed data */
-int getNextCodeword(long* bitsRead, unsigned char *compressedMem)
+/*
+ * Decompresses a block of U5 (and U6) LZW data from memory to memory.
+ * This variant uses codewords of 9 to 12 bits, with 0x100 to reset the
+ * dictionary and 0x101 to mark the end of the data.
+ * The parameters and return value are the same as for lzwDecodeU4, but the
+ * 4-byte size header at the start of U5 files must already be skipped.
+ */
+long lzwDecodeU5(const uint8_t* in, long inlen, uint8_t* out, long outlen, LZWEntry* dict)
 {
-    int codeword = (compressedMem[(*bitsRead)/8] << 8) + compressedMem[(*bitsRead)/8+1];
-    codeword = codeword >> (4-((*bitsRead)%8));
-    codeword = codeword & 0xfff;
-    (*bitsRead) += 12;
-
-    return(codeword);
-}
+    const int max_codeword_length = 12;
+
+    const long bits = inlen * 8;
+    long bits_read = 0;
+    long bytes_written = 0;
+    int codeword_size = 9;
+    int next_free_codeword = 0x102;
+    int dictionary_size = 0x200;
+
+    int cW;
+    int pW = 0;
+    unsigned char C;
+
+    /* where the string for pW was output, its length & first character */
+    long pPos = 0, pLen = 0;
+    unsigned char pFirst = 0;
+
+    const LZWEntry* entry;
+    LZWEntry* added;
+    long len, i;
+    uint32_t word;
+
+    clearDictionary(dict);
+
+/* read the next codeword (LSB first) from the compressed data */
+#define NEXT_CODEWORD_LSB(cw) \
+    if (bits_read + codeword_size > bits) \
+        return(-1); \
+    i = bits_read >> 3; \
+    word = in[i]; \
+    if (i + 1 < inlen) \
+        word |= in[i + 1] << 8; \
+    if (i + 2 < inlen) \
+        word |= in[i + 2] << 16; \
+    cw = (word >> (bits_read & 7)) & ((1 << codeword_size) - 1); \
+    bits_read += codeword_size
+
+    for (;;) {
+        NEXT_CODEWORD_LSB(cW);
+        switch (cW) {
+            // re-init the dictionary
+        case 0x100:
+            codeword_size = 9;
+            next_free_codeword = 0x102;
+            dictionary_size = 0x200;
+            clearDictionary(dict);
+            NEXT_CODEWORD_LSB(cW);
+            C = (unsigned char) cW;
+            if (! outputRoot(C, out, bytes_written, outlen))
+                return(-1);
+            len = 1;
+            break;
+            // end of compressed file has been reached
+        case 0x101:
+            return(bytes_written);
+            // (cW <> 0x100) && (cW <> 0x101)
+        default:
+            entry = dict + cW;
+            if (cW < next_free_codeword) { // codeword is already in the dictionary
+                // output the string represented by cW
+                len = entry->len;
+                C = entry->first;
+                if (! outputString(entry, cW, out, bytes_written, outlen))
+                    return(-1);
+            }
+            else {  // codeword is not yet defined
+                // the new dictionary entry must correspond to cW
+                // if it doesn't, something is wrong with the lzw-compressed data.
+                if (cW != next_free_codeword)
+                    return(-1);
+                // output the string represented by pW and the char C
+                len = pLen + 1;
+                C = pFirst;
+                if (! outputUndefined(pPos, pLen, pFirst, out, bytes_written, outlen))
+                    return(-1);
+            }
 
-/* increment position pointer, but do not write root to memory */
-void discardRoot(unsigned char root, unsigned char *destination, long* position)
-{
-    (*position)++;
-}
+            // add pW+C to the dictionary
+            if (next_free_codeword < LZW_DICT_SIZE) {
+                added = dict + next_free_codeword;
+                added->pos = pPos;
+                added->len = pLen + 1;
+                added->codeword = pW;
+                added->root = C;
+                added->first = pFirst;
+            }
 
-/* output a root to memory */
-void outputRoot(unsigned char root, unsigned char *destination, long* position)
-{
-    destination[*position] = root;
-    (*position)++;
+            next_free_codeword++;
+            if (next_free_codeword >= dictionary_size) {
+                if (codeword_size < max_codeword_length) {
+                    codeword_size += 1;
+                    dictionary_size *= 2;
+                }
+            }
+            break;
+        }
+        // shift roles - the current cW becomes the new pW
+        pW = cW;
+        pPos = bytes_written;
+        pLen = len;
+        pFirst = C;
+        bytes_written += len;
+    }
 }
 
 /* --------------------------------------------------------------------------------------
    Dictionary-related functions
    -------------------------------------------------------------------------------------- */
 
-/* pushes the string associated with codeword onto the stack */
-void getString(int codeword, lzwDictionaryEntry *dictionary, unsigned char *stack, int *elementsInStack)
-{
-    unsigned char root;
-    int currentCodeword = codeword;
-
-    while (currentCodeword > 0xff)
-    {
-        root = dictionary[currentCodeword].root;
-        currentCodeword = dictionary[currentCodeword].codeword;
-        stack[*elementsInStack] = root;
-        (*elementsInStack)++;
-    }
-
-    /* push the root at the leaf */
-    stack[*elementsInStack] = (unsigned char)currentCodeword;
-    (*elementsInStack)++;
-}
-
-int getNewHashCode (unsigned char root, int codeword, lzwDictionaryEntry *dictionary)
+static int getNewHashCode(unsigned char root, int codeword, const LZWEntry *dictionary)
 {
     int hashCode;
 
@@ -307,27 +431,15 @@ int getNewHashCode (unsigned char root, int codeword, lzwDictionaryEntry *dictio
     return(hashCode);
 }
 
-unsigned char hashPosFound(int hashCode, unsigned char root, int codeword, lzwDictionaryEntry* dictionary)
+static unsigned char hashPosFound(int hashCode, unsigned char root, int codeword, const LZWEntry* dictionary)
 {
     if (hashCode > 0xff)   /* hash codes must not be roots */
     {
-        unsigned char c1, c2, c3;
-
-        if (dictionary[hashCode].occupied)
-        {
-            /* hash table position is occupied */
-            c1 = 1;
-            /* is our (root,codeword) pair already in the hash table? */
-            c2 = dictionary[hashCode].root == root;
-            c3 = dictionary[hashCode].codeword == codeword;
-        }
-        else
-        {
-            /* hash table position is free */
-            c1 = 0;
-        }
+        const LZWEntry* entry = dictionary + hashCode;
 
-        return((!c1) || (c1 && c2 && c3));
+        /* is the hash table position free, or is our (root,codeword) pair already there? */
+        return(! entry->len ||
+               (entry->root == root && entry->codeword == codeword));
     }
     else
     {
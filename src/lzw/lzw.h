@@ -21,12 +21,34 @@
 #ifndef LZW_H
 #define LZW_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-long lzwGetDecompressedSize(unsigned char* compressedMem, long compressedSize);
-long lzwDecompress(unsigned char* compressedMem, unsigned char* decompressedMem, long compressedSize);
+#define LZW_DICT_SIZE   0x1000
+
+/*
+ * Dictionary entry.  The string of an entry is kept in the decompressed
+ * output, so the decoders copy whole strings rather than walking the
+ * codeword chains.
+ */
+typedef struct {
+    uint32_t pos;       /* Offset of the string in the output. */
+    uint16_t len;       /* Length of the string (zero if unused). */
+    uint16_t codeword;  /* Prefix codeword. */
+    uint8_t  root;      /* Last character. */
+    uint8_t  first;     /* First character. */
+} LZWEntry;
+
+long lzwDecodeU4(const uint8_t* in, long inlen, uint8_t* out, long outlen,
+                 LZWEntry* dict);
+long lzwDecodeU5(const uint8_t* in, long inlen, uint8_t* out, long outlen,
+                 LZWEntry* dict);
+
+long lzwGetDecompressedSize(const unsigned char* compressedMem, long compressedSize);
+long lzwDecompress(const unsigned char* compressedMem, unsigned char* decompressedMem, long compressedSize);
 
 #ifdef __cplusplus
 }
@@ -33,8 +33,8 @@
  */
 long decompress_u4_file(FILE *in, long filesize, void **out)
 {
-    unsigned char *compressed_mem, *decompressed_mem;
-    long compressed_filesize, decompressed_filesize;
+    unsigned char *compressed_mem;
+    long compressed_filesize;
     long errorCode;
 
     /* size of the compressed input file */
@@ -52,29 +52,10 @@ long decompress_u4_file(FILE *in, long filesize, void **out)
     compressed_mem = (unsigned char *) malloc(compressed_filesize);
     fread(compressed_mem, 1, compressed_filesize, in);
 
-    /*
-     * determine decompressed file size
-     * if lzw_get_decompressed_size() can't determine the decompressed size (i.e. the compressed
-     * data is corrupt), it returns -1
-     */
-    decompressed_filesize = lzwGetDecompressedSize(compressed_mem,compressed_filesize);
-
-    if (decompressed_filesize <= 0) {
-        return(-1);
-    }
-
-    /* decompress file from compressed_mem[] into decompressed_mem[] */
-    decompressed_mem = (unsigned char *) malloc(decompressed_filesize);
-
-    /* testing: clear destination mem */
-    memset(decompressed_mem, 0, decompressed_filesize);
-
-    errorCode = lzwDecompress(compressed_mem, decompressed_mem, compressed_filesize);
+    errorCode = decompress_u4_memory(compressed_mem, compressed_filesize, out);
 
     free(compressed_mem);
 
-    *out = decompressed_mem;
-
     return(errorCode);
 }
 
@@ -82,6 +63,7 @@ long decompress_u4_memory(void *in, long inlen, void **out) {
     unsigned char *compressed_mem, *decompressed_mem;
     long compressed_filesize, decompressed_filesize;
     long errorCode;
+    LZWEntry *dict;
 
     /* size of the compressed input */
     compressed_filesize = inlen;
@@ -91,25 +73,25 @@ long decompress_u4_memory(void *in, long inlen, void **out) {
         return(-1);
 
     compressed_mem = (unsigned char *) in;
+    dict = (LZWEntry *) malloc(sizeof(LZWEntry) * LZW_DICT_SIZE);
 
     /*
      * determine decompressed data size
-     * if lzw_get_decompressed_size() can't determine the decompressed size (i.e. the compressed
+     * if lzwDecodeU4() can't determine the decompressed size (i.e. the compressed
      * data is corrupt), it returns -1
      */
-    decompressed_filesize = lzwGetDecompressedSize(compressed_mem,compressed_filesize);
+    decompressed_filesize = lzwDecodeU4(compressed_mem, compressed_filesize, NULL, 0, dict);
 
     if (decompressed_filesize <= 0) {
+        free(dict);
         return(-1);
     }
 
     /* decompress file from compressed_mem[] into decompressed_mem[] */
     decompressed_mem = (unsigned char *) malloc(decompressed_filesize);
 
-    /* testing: clear destination mem */
-    memset(decompressed_mem, 0, decompressed_filesize);
-
-    errorCode = lzwDecompress(compressed_mem, decompressed_mem, compressed_filesize);
+    errorCode = lzwDecodeU4(compressed_mem, compressed_filesize, decompressed_mem, decompressed_filesize, dict);
+    free(dict);
 
     *out = decompressed_mem;
 
@@ -30,14 +30,11 @@
 #include <stdio.h>
 #include <cstdlib>
 
+#include "lzw.h"
 #include "u6decode.h"
-#include "u6stack.h"
-#include "u6dict.h"
 
 using namespace U6Decode;
 
-Dict dict;
-
 unsigned char U6Decode::read1(FILE *f) {
     return(fgetc(f));
 }
@@ -97,156 +94,19 @@ long U6Decode::get_uncompressed_size(FILE *input_file) {
     }
 }
 
-// ----------------------------------------------
-// Read the next code word from the source buffer
-// ----------------------------------------------
-int U6Decode::get_next_codeword (long& bits_read, unsigned char *source, int codeword_size) {
-    unsigned char b0,b1,b2;
-    int codeword;
-   
-    b0 = source[bits_read/8];
-    b1 = source[bits_read/8+1];
-    b2 = source[bits_read/8+2];
-
-    codeword = ((b2 << 16) + (b1 << 8) + b0);
-    codeword = codeword >> (bits_read % 8);
-    switch (codeword_size) {
-    case 0x9:
-        codeword = codeword & 0x1ff;
-        break;
-    case 0xa:
-        codeword = codeword & 0x3ff;
-        break;
-    case 0xb:
-        codeword = codeword & 0x7ff;
-        break;
-    case 0xc:
-        codeword = codeword & 0xfff;
-        break;
-    default:
-        printf("Error: weird codeword size!\n");
-        break;
-    }
-    bits_read += codeword_size;
-
-    return (codeword);
-}
-
-void U6Decode::output_root(unsigned char root, unsigned char *destination, long& position) {
-    destination[position] = root;
-    position++;   
-}
-
-void U6Decode::get_string(Stack &stack, int codeword) {
-    unsigned char root;
-    int current_codeword;
-   
-    current_codeword = codeword;
-    while (current_codeword > 0xff)
-        {
-            root = dict.get_root(current_codeword);
-            current_codeword = dict.get_codeword(current_codeword);
-            stack.push(root);
-        }
-
-    // push the root at the leaf
-    stack.push((unsigned char)current_codeword);
-}
-
 // -----------------------------------------------------------------------------
 // LZW-decompress from buffer to buffer.
-// The parameters "source_length" and "destination_length" are currently unused.
-// They might be used to prevent reading/writing outside the buffers.
+// The decoding is done by lzwDecodeU5(); this only provides the dictionary.
 // -----------------------------------------------------------------------------
 int U6Decode::lzw_decompress(unsigned char *source, long source_length, unsigned char *destination, long destination_length) {
-    const int max_codeword_length = 12;
-
-    bool end_marker_reached = false;
-    int codeword_size = 9;
-    long bits_read = 0; 
-    int next_free_codeword = 0x102;
-    int dictionary_size = 0x200;
-
-    long bytes_written = 0;
-
-    int cW;
-    int pW = 0;
-    unsigned char C;
-
-    while (! end_marker_reached) {
-        cW = get_next_codeword(bits_read, source, codeword_size);
-        switch (cW) {
-            // re-init the dictionary
-        case 0x100:
-            codeword_size = 9;
-            next_free_codeword = 0x102;
-            dictionary_size = 0x200;
-            dict.init();
-            cW = get_next_codeword(bits_read, source, codeword_size);
-            output_root((unsigned char)cW, destination, bytes_written);
-            break;
-            // end of compressed file has been reached
-        case 0x101:
-            end_marker_reached = true;
-            break;
-            // (cW <> 0x100) && (cW <> 0x101)
-        default:
-            if (cW < next_free_codeword) { // codeword is already in the dictionary
-                Stack stack;
-
-                // create the string associated with cW (on the stack)
-                get_string(stack, cW);
-                C = stack.gettop();
-                // output the string represented by cW
-                while (!stack.is_empty()) {
-                    output_root(stack.pop(), destination, bytes_written);
-                }
-                // add pW+C to the dictionary
-                dict.add(C,pW);
-
-                next_free_codeword++;
-                if (next_free_codeword >= dictionary_size) {
-                    if (codeword_size < max_codeword_length) {
-                        codeword_size += 1;
-                        dictionary_size *= 2;
-                    }
-                }
-            }
-            else {  // codeword is not yet defined
-                Stack stack;
-
-                // create the string associated with pW (on the stack)
-                get_string(stack, pW);
-                C = stack.gettop();
-                // output the string represented by pW
-                while (!stack.is_empty()) {
-                    output_root(stack.pop(), destination, bytes_written);
-                }
-                // output the char C
-                output_root(C, destination, bytes_written);
-                // the new dictionary entry must correspond to cW
-                // if it doesn't, something is wrong with the lzw-compressed data.
-                if (cW != next_free_codeword) {
-                    printf("cW != next_free_codeword!\n");
-                    return(EXIT_FAILURE);
-                }
-                // add pW+C to the dictionary
-                dict.add(C,pW);
-             
-                next_free_codeword++;
-                if (next_free_codeword >= dictionary_size) {
-                    if (codeword_size < max_codeword_length) {
-                        codeword_size += 1;
-                        dictionary_size *= 2;
-                    } 
-                }
-            }
-            break;
-        }
-        // shift roles - the current cW becomes the new pW
-        pW = cW;
-    }
+    LZWEntry* dict = new LZWEntry[LZW_DICT_SIZE];
+    long len = lzwDecodeU5(source, source_length, destination, destination_length, dict);
+    delete[] dict;
 
+    if (len < 0) {
+        printf("Invalid LZW data!\n");
+        return(EXIT_FAILURE);
+    }
     return(EXIT_SUCCESS);
 }
 
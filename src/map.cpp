@@ -7,11 +7,18 @@
 
 #include "config.h"
 #include "debug.h"
+#include "error.h"
 #include "event.h"
 #include "party.h"
+#include "pathfind.h"
 #include "portal.h"
 #include "tileset.h"
 #include "xu4.h"
+#include "support/profiler.h"
+
+#ifdef GPU_RENDER
+#include "screen.h"
+#endif
 
 
 /**
@@ -211,7 +218,11 @@ Map::Map() {
     offset = 0;
     id = 0;
     data = NULL;
+    passGrid = NULL;
+    opacityGrid = NULL;
     tileset = NULL;
+    objBucketCols = objBucketRows = 0;
+    creatureCount = 0;
 }
 
 Map::~Map() {
@@ -221,84 +232,235 @@ Map::~Map() {
     }
     clearObjects();
     delete[] data;
+    delete[] passGrid;
+    delete[] opacityGrid;
 }
 
 const char* Map::getName() const {
     return xu4.config->confString(fname);
 }
 
+/*
+ * Append the occluders of map column x to pos, stopping at posEnd.
+ * Return the number of occluders which did not fit.
+ */
+static int blockingColumn(const Map* map, float*& pos, const float* posEnd,
+                          int x, int sy, int maxY, int centerX, int centerY) {
+    const uint8_t* grid = map->opacityGrid;
+    int width = map->width;
+    int di = sy * width + x;
+    int opaque;
+    int lost = 0;
+
+    for (int y = sy; y < maxY; di += width, ++y) {
+        opaque = grid ? grid[di] : map->tileset->get(map->data[di])->opaque;
+        if (opaque) {
+            if (pos == posEnd) {
+                ++lost;
+                continue;
+            }
+            *pos++ = (float) (x - centerX);
+            *pos++ = (float) (y - centerY);
+            *pos++ = (float) opaque;
+        }
+    }
+    return lost;
+}
+
+/*
+ * Set the group counts of occluders gathered in column order.
+ */
+static void blockingCounts(BlockingGroups* bg, const float* end) {
+    const float* pos = bg->tilePos;
+    int n;
+
+    for (n = 0; pos != end && pos[0] < 0.0f; pos += 3)
+        ++n;
+    bg->left = n;
+    for (n = 0; pos != end && pos[0] == 0.0f; pos += 3)
+        ++n;
+    bg->center = n;
+    bg->right = (end - pos) / 3;
+}
+
 /*
  * Build BlockingGroups for use by the shadow casting shader.
+ *
+ * If the groups were last built for a view of the same size one column or
+ * one row away, the existing occluders are scrolled and only the newly
+ * exposed column or row is scanned.  Set bg->vw to zero to force a full
+ * rebuild.
+ *
+ * Return false if the view holds more than BLOCKING_SHAPES_MAX occluders.
+ * The groups are then valid but hold only those from the leftmost columns.
  */
-void Map::queryBlocking(BlockingGroups* bg, int sx, int sy, int vw, int vh) const {
-    const Tile* tile;
-    int centerX, leftEndX, maxX;
-    int centerY, maxY;
-    int x, y, di;
-    int count;
+bool Map::queryBlocking(BlockingGroups* bg, int sx, int sy, int vw, int vh) const {
+    int centerX, centerY, maxX, maxY;
+    int x, lost, rowY;
     float* pos = bg->tilePos;
-    float* posEnd = pos + BLOCKING_POS_SIZE;
+    float* posEnd = pos + BLOCKING_SHAPES_MAX * 3;
+    int scroll = 0;
+    int scrollY = 0;
+
+    if (bg->vw == vw && bg->vh == vh && ! bg->lost) {
+        if (bg->sy == sy)
+            scroll = sx - bg->sx;
+        else if (bg->sx == sx)
+            scrollY = sy - bg->sy;
+        if (scroll != 1 && scroll != -1)
+            scroll = 0;
+        if (scrollY != 1 && scrollY != -1)
+            scrollY = 0;
+    }
 
-    centerX = sx + vw / 2;
-    centerY = sy + vw / 2;
+    bg->sx = sx;
+    bg->sy = sy;
+    bg->vw = vw;
+    bg->vh = vh;
 
-    // Initialize counts in case the function aborts (buffer_full).
-    bg->left = bg->center = bg->right = 0;
+    centerX = sx + vw / 2;
+    centerY = sy + vh / 2;
+    rowY = (scrollY > 0) ? sy + vh - 1 : sy;
 
     // Handle negative start positions.
-    if (sx < 0) {
-        vw += sx;   // Subtracts sx.
-        sx = 0;
-    }
     if (sy < 0) {
         vh += sy;   // Subtracts sy.
         sy = 0;
     }
-
-    maxX = sx + vw;
-    if (maxX > width)
-        maxX = width;
     maxY = sy + vh;
     if (maxY > height)
         maxY = height;
 
-#define BLOCKING_COLUMN \
-    for (di = sy * width + x, y = sy; y < maxY; di += width, ++y) { \
-        tile = tileset->get(data[di]); \
-        if (tile->opaque) { \
-            if (pos == posEnd) \
-                goto buffer_full; \
-            *pos++ = (float) (x - centerX); \
-            *pos++ = (float) (y - centerY); \
-            *pos++ = (float) tile->opaque; \
-            ++count; \
-        } \
+    if (scroll) {
+        // Remove the column which left the view and move the rest over.
+        float* end = pos + 3 * (bg->left + bg->center + bg->right);
+        float* it;
+        float* column;
+
+        if (scroll > 0) {
+            float gone = (float) (-(vw / 2));
+            for (it = pos; it != end && it[0] == gone; it += 3)
+                ;
+            memmove(pos, it, (end - it) * sizeof(float));
+            end = pos + (end - it);
+        } else {
+            float gone = (float) (vw - 1 - vw / 2);
+            while (end != pos && end[-3] == gone)
+                end -= 3;
+        }
+        for (it = pos; it != end; it += 3)
+            it[0] -= (float) scroll;
+
+        // Add the newly exposed column.
+        x = (scroll > 0) ? sx + vw - 1 : sx;
+        if (x >= 0 && x < width) {
+            column = end;
+            if (blockingColumn(this, end, posEnd, x, sy, maxY,
+                               centerX, centerY))
+                goto rebuild;
+            if (scroll < 0)
+                std::rotate(pos, column, end);
+        }
+        blockingCounts(bg, end);
+        return true;
     }
 
-    // Gather blocking tiles in column left to right order.
+    if (scrollY) {
+        // Remove the row which left the view and merge the newly exposed
+        // row into the ends of the columns.
+        float prev[BLOCKING_SHAPES_MAX * 3];
+        const float* it = prev;
+        const float* prevEnd;
+        float* out = pos;
+        float gone = (float) ((scrollY > 0) ? -(vh / 2) : vh - 1 - vh / 2);
+        float rx;
+        int minX = (sx < 0) ? 0 : sx;
+
+        maxX = sx + vw;
+        if (maxX > width)
+            maxX = width;
+        if (rowY < 0 || rowY >= height)
+            rowY = -1;
+
+        prevEnd = prev + 3 * (bg->left + bg->center + bg->right);
+        memcpy(prev, pos, (prevEnd - prev) * sizeof(float));
+
+        for (x = minX; x < maxX; ++x) {
+            if (scrollY < 0 && rowY >= 0 &&
+                blockingColumn(this, out, posEnd, x, rowY, rowY + 1,
+                               centerX, centerY))
+                goto rebuild;
+
+            rx = (float) (x - centerX);
+            for (; it != prevEnd && it[0] == rx; it += 3) {
+                if (it[1] == gone)
+                    continue;
+                if (out == posEnd)
+                    goto rebuild;
+                out[0] = it[0];
+                out[1] = it[1] - (float) scrollY;
+                out[2] = it[2];
+                out += 3;
+            }
 
-    leftEndX = (centerX < width) ? centerX : width;
-    count = 0;
-    for (x = sx; x < leftEndX; ++x) {
-        BLOCKING_COLUMN
+            if (scrollY > 0 && rowY >= 0 &&
+                blockingColumn(this, out, posEnd, x, rowY, rowY + 1,
+                               centerX, centerY))
+                goto rebuild;
+        }
+        blockingCounts(bg, out);
+        return true;
     }
-    bg->left = count;
 
-    count = 0;
-    if (centerX < width) {
-        BLOCKING_COLUMN
+rebuild:
+    // Gather blocking tiles in column left to right order.
+    if (sx < 0) {
+        vw += sx;   // Subtracts sx.
+        sx = 0;
     }
-    bg->center = count;
+    maxX = sx + vw;
+    if (maxX > width)
+        maxX = width;
 
-    count = 0;
-    for (++x; x < maxX; ++x) {
-        BLOCKING_COLUMN
-    }
-    bg->right = count;
-    return;
+    lost = 0;
+    for (x = sx; x < maxX; ++x)
+        lost += blockingColumn(this, pos, posEnd, x, sy, maxY,
+                               centerX, centerY);
+    blockingCounts(bg, pos);
+    bg->lost = lost;
+    return lost == 0;
+}
 
-buffer_full:
-    fprintf(stderr, "Map::queryBlocking pos buffer full!\n" );
+struct VisibleQuery {
+    int rect[4];        // minX, minY, maxX, maxY
+    const TileRenderData* rd;
+    const Animator* animator;
+    void (*func)(const Coords*, VisualId, void*);
+    void* user;
+    const Object** focusPtr;
+};
+
+static void queryVisibleBucket(VisibleQuery* vq, const ObjectBucket& bucket) {
+    ObjectBucket::const_iterator it;
+    const Coords* cp;
+    VisualId vid;
+
+    for (it = bucket.begin(); it != bucket.end(); ++it) {
+        Object* obj = *it;
+        cp = &obj->coords;
+        if (cp->x < vq->rect[0] || cp->x > vq->rect[2] ||
+            cp->y < vq->rect[1] || cp->y > vq->rect[3])
+            continue;
+        if (obj->focused)
+            *vq->focusPtr = obj;
+        //printf("KR obj %d %d %d,%d\n",
+        //        obj->tile.id, obj->tile.frame, cp->x, cp->y);
+        if (obj->animId != ANIM_UNUSED) {
+            obj->tile.frame = anim_valueI(vq->animator, obj->animId);
+        }
+        vid = vq->rd[obj->tile.id].vid + obj->tile.frame;
+        vq->func(cp, vid, vq->user);
+    }
 }
 
 /*
@@ -338,22 +500,36 @@ void Map::queryVisible(const Coords& center, int radius,
         func(cp, vid, user);
     }
 
-    const Animator* animator = &xu4.eventHandler->flourishAnim;
-    ObjectDeque::const_iterator it;
-    for(it = objects.begin(); it != objects.end(); it++) {
-        Object* obj = *it;
-        cp = &obj->coords;
-        if (OUTSIDE(cp))
-            continue;
-        if (obj->focused)
-            *focusPtr = obj;
-        //printf("KR obj %d %d %d,%d\n",
-        //        obj->tile.id, obj->tile.frame, cp->x, cp->y);
-        if (obj->animId != ANIM_UNUSED) {
-            obj->tile.frame = anim_valueI(animator, obj->animId);
+    if (! objBuckets.empty()) {
+        VisibleQuery vq;
+        int bx0, bx1, by0, by1, bx, by, bz;
+
+        vq.rect[0] = minX;
+        vq.rect[1] = minY;
+        vq.rect[2] = maxX;
+        vq.rect[3] = maxY;
+        vq.rd = rd;
+        vq.animator = &xu4.eventHandler->flourishAnim;
+        vq.func = func;
+        vq.user = user;
+        vq.focusPtr = focusPtr;
+
+        // Visit the buckets overlapping the area.
+        bx0 = std::max(minX, 0) >> OBJ_BUCKET_SHIFT;
+        by0 = std::max(minY, 0) >> OBJ_BUCKET_SHIFT;
+        bx1 = std::min(maxX >> OBJ_BUCKET_SHIFT, objBucketCols - 1);
+        by1 = std::min(maxY >> OBJ_BUCKET_SHIFT, objBucketRows - 1);
+        for (bz = 0; bz < levels; ++bz) {
+            for (by = by0; by <= by1; ++by) {
+                for (bx = bx0; bx <= bx1; ++bx) {
+                    queryVisibleBucket(&vq, objBuckets[
+                            (bz * objBucketRows + by) * objBucketCols + bx]);
+                }
+            }
         }
-        vid = rd[obj->tile.id].vid + obj->tile.frame;
-        func(cp, vid, user);
+
+        // The last bucket holds any objects outside the map bounds.
+        queryVisibleBucket(&vq, objBuckets.back());
     }
 
     if (flags & SHOW_AVATAR) {
@@ -373,13 +549,10 @@ void Map::queryVisible(const Coords& center, int radius,
 void Map::queryAnnotations(const Coords& pos,
                            int (*func)(const Annotation*, void*),
                            void* user) const {
-    AnnotationList::const_iterator ait;
-	for (ait = annotations.begin(); ait != annotations.end(); ++ait) {
-        const Annotation& ann = *ait;
-        if (ann.coords == pos) {
-            if (func(&ann, user) == Map::QueryDone)
-                break;
-        }
+    const Annotation* ann;
+    for (ann = annotations.firstAt(pos); ann; ann = annotations.nextAt(ann)) {
+        if (func(ann, user) == Map::QueryDone)
+            break;
     }
 }
 
@@ -389,10 +562,15 @@ void Map::queryAnnotations(const Coords& pos,
  */
 const Object *Map::objectAt(const Coords &coords) const {
     /* FIXME: return a list instead of one object */
-    ObjectDeque::const_iterator i;
+    ObjectBucket::const_iterator i;
     const Object *objAt = NULL;
+    int bucket = objectBucket(coords);
 
-    for(i = objects.begin(); i != objects.end(); i++) {
+    if (bucket < 0)
+        return NULL;
+
+    const ObjectBucket& objs = objBuckets[bucket];
+    for(i = objs.begin(); i != objs.end(); i++) {
         const Object *obj = *i;
 
         if (coords == obj->coords) {
@@ -410,6 +588,30 @@ const Object *Map::objectAt(const Coords &coords) const {
     return objAt;
 }
 
+/**
+ * Fill a list with the objects at the given (x,y,z) coords.
+ *
+ * \param list  Array to hold object pointers.
+ * \param max   Maximum number of objects to store in list.
+ *
+ * \return Number of objects stored in list.
+ */
+int Map::objectsAt(const Coords &coords, Object** list, int max) const {
+    ObjectBucket::const_iterator i;
+    int count = 0;
+    int bucket = objectBucket(coords);
+
+    if (bucket < 0)
+        return 0;
+
+    const ObjectBucket& objs = objBuckets[bucket];
+    for(i = objs.begin(); i != objs.end() && count < max; i++) {
+        if (coords == (*i)->coords)
+            list[count++] = *i;
+    }
+    return count;
+}
+
 /**
  * Returns the portal for the correspoding action(s) given.
  * If there is no portal that corresponds to the actions flagged
@@ -445,11 +647,10 @@ TileId Map::getTileFromData(const Coords &coords) const {
 const Tile* Map::tileTypeAt(const Coords &coords, int withObjects) const {
     /* FIXME: this should return a list of tiles, with the most visible at the front */
     /* FIXME: this only returns the first valid annotation it can find */
-    AnnotationList::const_iterator ait;
-    for(ait = annotations.begin(); ait != annotations.end(); ait++) {
-        const Annotation& ann = *ait;
-        if (ann.coords == coords && ! ann.visualOnly)
-            return tileset->get( ann.tile.id );
+    const Annotation* ann;
+    for (ann = annotations.firstAt(coords); ann; ann = annotations.nextAt(ann)) {
+        if (! ann->visualOnly)
+            return tileset->get( ann->tile.id );
     }
 
     TileId tid = 0;
@@ -472,6 +673,13 @@ const Tile* Map::tileTypeAt(const Coords &coords, int withObjects) const {
 void Map::setTileAt(const Coords& coords, TileId tid) {
     int i = (coords.z * width * height) + (coords.y * width) + coords.x;
     data[i] = tid;
+    if (passGrid)
+        passGrid[i] = tileset->passability(tid);
+    if (opacityGrid && coords.z == 0)
+        opacityGrid[i] = tileset->get(tid)->opaque;
+#ifdef GPU_RENDER
+    screenMapTileChanged(this, coords);
+#endif
 }
 
 /**
@@ -557,14 +765,17 @@ Creature *Map::addCreature(const Creature *creature, const Coords& coords) {
 
     /* place the creature on the map */
     objects.push_back(m);
+    indexObject(m);
     return m;
 }
 
 /**
- * Adds an object to the given map
+ * Adds an existing object to the given map
  */
 Object *Map::addObject(Object *obj, Coords coords) {
+    obj->placeOnMap(this, coords);
     objects.push_back(obj);
+    indexObject(obj);
     return obj;
 }
 
@@ -576,6 +787,7 @@ Object *Map::addObject(MapTile tile, MapTile prevtile, const Coords& coords) {
     obj->placeOnMap(this, coords);
 
     objects.push_back(obj);
+    indexObject(obj);
 
     return obj;
 }
@@ -594,6 +806,7 @@ bool Map::removeObject(const Object *rem, bool deleteObject) {
     ObjectDeque::iterator i;
     for (i = objects.begin(); i != objects.end(); i++) {
         if (*i == rem) {
+            unindexObject(*i);
             /* Party members persist through different maps, so don't delete them! */
             if (deleteObject && ! isPartyMember(*i))
                 delete (*i);
@@ -605,6 +818,7 @@ bool Map::removeObject(const Object *rem, bool deleteObject) {
 }
 
 ObjectDeque::iterator Map::removeObject(ObjectDeque::iterator rem, bool deleteObject) {
+    unindexObject(*rem);
     /* Party members persist through different maps, so don't delete them! */
     if (!isPartyMember(*rem) && deleteObject)
         delete (*rem);
@@ -618,14 +832,87 @@ bool Map::objectPresent(const Object* obj) const {
     return find(objects.begin(), objects.end(), obj) != objects.end();
 }
 
+/*
+ * Return the objBuckets index for a position, or -1 if no objects have been
+ * added.  Positions outside the map use the last (overflow) bucket.
+ */
+int Map::objectBucket(const Coords& pos) const {
+    if (objBuckets.empty())
+        return -1;
+    if (pos.x < 0 || pos.x >= width || pos.y < 0 || pos.y >= height ||
+        pos.z < 0 || pos.z >= levels)
+        return objBuckets.size() - 1;
+    return ((pos.z * objBucketRows + (pos.y >> OBJ_BUCKET_SHIFT)) *
+            objBucketCols) + (pos.x >> OBJ_BUCKET_SHIFT);
+}
+
+/*
+ * Add an object to the spatial index at its current coords.
+ */
+void Map::indexObject(Object* obj) {
+    if (objBuckets.empty()) {
+        objBucketCols = (width  + OBJ_BUCKET_DIM - 1) >> OBJ_BUCKET_SHIFT;
+        objBucketRows = (height + OBJ_BUCKET_DIM - 1) >> OBJ_BUCKET_SHIFT;
+        objBuckets.resize(objBucketCols * objBucketRows * levels + 1);
+    }
+    objBuckets[ objectBucket(obj->coords) ].push_back(obj);
+    if (obj->objType == Object::CREATURE)
+        ++creatureCount;
+}
+
+static bool eraseFromBucket(ObjectBucket& objs, const Object* obj) {
+    ObjectBucket::iterator it = std::find(objs.begin(), objs.end(), obj);
+    if (it == objs.end())
+        return false;
+    objs.erase(it);
+    return true;
+}
+
+/*
+ * Remove an object from the spatial index.
+ */
+void Map::unindexObject(const Object* obj) {
+    int bucket = objectBucket(obj->coords);
+    if (bucket < 0)
+        return;
+    if (! eraseFromBucket(objBuckets[bucket], obj)) {
+        // The object coords were changed without calling objectMoved().
+        std::vector<ObjectBucket>::iterator it;
+        for (it = objBuckets.begin(); it != objBuckets.end(); ++it) {
+            if (eraseFromBucket(*it, obj))
+                break;
+        }
+        if (it == objBuckets.end())
+            return;
+    }
+    if (obj->objType == Object::CREATURE)
+        --creatureCount;
+}
+
+/*
+ * Update the spatial index after the coords of an object have changed.
+ * Nothing is done if the object is not on this map.
+ *
+ * \param from  The previous coords of the object.
+ */
+void Map::objectMoved(Object* obj, const Coords& from) {
+    int b0 = objectBucket(from);
+    int b1 = objectBucket(obj->coords);
+    if (b0 != b1 && eraseFromBucket(objBuckets[b0], obj))
+        objBuckets[b1].push_back(obj);
+}
+
 /**
  * Moves all of the objects on the given map.
  * Returns an attacking object if there is a creature attacking.
  * Also performs special creature actions and creature effects.
  */
 Creature *Map::moveObjects(const Coords& avatar) {
+    PROF_ZONE("moveObjects");
     Creature *attacker = NULL;
 
+    pathfind_resetFields();
+
     for (unsigned int i = 0; i < objects.size(); i++) {
         Creature *m = dynamic_cast<Creature*>(objects[i]);
 
@@ -676,23 +963,120 @@ void Map::clearObjects() {
             delete *o;
     }
     objects.clear();
+    objBuckets.clear();
+    creatureCount = 0;
 }
 
 /**
  * Returns the number of creatures on the given map
  */
 int Map::getNumberOfCreatures() {
-    ObjectDeque::const_iterator i;
-    int n = 0;
+    return creatureCount;
+}
 
-    for (i = objects.begin(); i != objects.end(); i++) {
-        Object *obj = *i;
+/**
+ * Returns true if a creature can move from one tile onto another in the
+ * given direction.  The tiles are given as PASS_* masks.  Only the terrain
+ * is considered; the caller must deal with any objects that are in the way.
+ */
+bool map_creatureCanEnter(const Creature* m, int prevPass, int pass,
+                          Direction d, bool worldMap, bool ontoAvatar) {
+    // flying creatures
+    if ((pass & PASS_FLYABLE) && m->flies()) {
+        // FIXME: flying creatures behave differently on the world map?
+        if (worldMap)
+            return true;
+        else if (pass & (PASS_WALKABLE | PASS_SWIMABLE | PASS_SAILABLE))
+            return true;
+    }
+    // swimming creatures and sailing creatures
+    else if (pass & (PASS_SWIMABLE | PASS_SAILABLE | PASS_SHIP)) {
+        if (m->swims() && (pass & PASS_SWIMABLE))
+            return true;
+        if (m->sails() && (pass & PASS_SAILABLE))
+            return true;
+        if (m->canMoveOntoPlayer() && (pass & PASS_SHIP))
+            return true;
+    }
+    // ghosts and other incorporeal creatures
+    else if (m->isIncorporeal()) {
+        // can move anywhere but onto water, unless of course the creature can swim
+        if (! (pass & (PASS_SWIMABLE | PASS_SAILABLE)))
+            return true;
+    }
+    // walking creatures
+    else if (m->walks()) {
+        if ((pass & PASS_WALKON(d)) &&
+            (prevPass & PASS_WALKOFF(d)) &&
+            (pass & PASS_CREATURE_WALKABLE))
+            return true;
+    }
+    // Creatures that can move onto player
+    else if (ontoAvatar && m->canMoveOntoPlayer())
+    {
+        //tile should be transport
+        if ((pass & PASS_SHIP) && m->swims())
+            return true;
+    }
+    return false;
+}
 
-        if (obj->objType == Object::CREATURE)
-            n++;
+/*
+ * Build the passability grid from the map data.
+ */
+void Map::buildPassGrid() {
+    size_t i;
+    size_t count = width * height * levels;
+
+    passGrid = new uint16_t[count];
+    for (i = 0; i < count; ++i)
+        passGrid[i] = tileset->passability(data[i]);
+}
+
+/*
+ * Build the opacity grid of the first level from the map data.
+ */
+void Map::buildOpacityGrid() {
+    size_t i;
+    size_t count = width * height;
+
+    delete[] opacityGrid;
+    opacityGrid = new uint8_t[count];
+    for (i = 0; i < count; ++i)
+        opacityGrid[i] = tileset->get(data[i])->opaque;
+}
+
+/**
+ * Discards the passability and opacity grids.  This must be called if the
+ * map data is replaced without using setTileAt().
+ */
+void Map::freePassGrid() {
+    delete[] passGrid;
+    passGrid = NULL;
+    delete[] opacityGrid;
+    opacityGrid = NULL;
+}
+
+/**
+ * Returns the PASS_* mask of the tile at the given point.  This is
+ * equivalent to the mask of tileTypeAt(coords, WITHOUT_OBJECTS), or of
+ * tileTypeAt(coords, WITH_OBJECTS) when obj is the object at coords, but
+ * uses the passability grid when there are no annotations in the way.
+ */
+int Map::passabilityAt(const Coords& coords, const Object* obj) const {
+    const Annotation* ann;
+    for (ann = annotations.firstAt(coords); ann; ann = annotations.nextAt(ann)) {
+        if (! ann->visualOnly)
+            return tileset->passability(ann->tile.id);
     }
 
-    return n;
+    if (obj)
+        return tileset->passability(obj->tile.id);
+    if (MAP_IS_OOB(this, coords))
+        return tileset->passability(0);
+    if (passGrid)
+        return passGrid[coords.x + (coords.y * width) + (width * height * coords.z)];
+    return tileset->passability(getTileFromData(coords));
 }
 
 /**
@@ -703,11 +1087,13 @@ int Map::getValidMoves(const Coords& from, MapTile transport) {
     Direction d;
     Object *obj;
     const Creature *m, *to_m;
-    const Tile* prev_tile;
-    const Tile* tile;
+    int prevPass, pass;
     int ontoAvatar, ontoCreature;
     Coords testCoord;
 
+    if (! passGrid && data)
+        buildPassGrid();
+
     // get the creature object, if it exists (the one that's moving)
     m = Creature::getByTile(transport);
 
@@ -715,7 +1101,7 @@ int Map::getValidMoves(const Coords& from, MapTile transport) {
     if (m && m->canMoveOntoPlayer())
         isAvatar = false;
 
-    prev_tile = tileTypeAt(from, WITHOUT_OBJECTS);
+    prevPass = passabilityAt(from);
 
     retval = 0;
     for (d = DIR_WEST; d <= DIR_SOUTH; d = (Direction)(d+1)) {
@@ -744,11 +1130,11 @@ int Map::getValidMoves(const Coords& from, MapTile transport) {
 
         // get the destination tile
         if (ontoAvatar)
-            tile = c->party->getTransport().getTileType();
+            pass = tileset->passability(c->party->getTransport().id);
         else if (ontoCreature)
-            tile = obj->tile.getTileType();
+            pass = tileset->passability(obj->tile.id);
         else
-            tile = tileTypeAt(testCoord, WITH_OBJECTS);
+            pass = passabilityAt(testCoord, obj);
 
         // get the other creature object, if it exists (the one that's being moved onto)
         to_m = dynamic_cast<Creature*>(obj);
@@ -761,7 +1147,7 @@ int Map::getValidMoves(const Coords& from, MapTile transport) {
             // these conditions are not met, the creature cannot move onto another.
 
             if ((ontoAvatar && m->canMoveOntoPlayer()) || (ontoCreature && m->canMoveOntoCreatures()))
-                tile = tileTypeAt(testCoord, WITHOUT_OBJECTS); //Ignore all objects, and just consider terrain
+                pass = passabilityAt(testCoord); //Ignore all objects, and just consider terrain
               if ((ontoAvatar && !m->canMoveOntoPlayer())
                 ||  (
                         ontoCreature &&
@@ -781,14 +1167,14 @@ int Map::getValidMoves(const Coords& from, MapTile transport) {
             // avatar or horseback: check walkable
 
             const Tile* transTile = transport.getTileType();
-            if (transTile->isShip() && tile->isSailable())
+            if (transTile->isShip() && (pass & PASS_SAILABLE))
                 retval = DIR_ADD_TO_MASK(d, retval);
-            else if (transTile->isBalloon() && tile->isFlyable())
+            else if (transTile->isBalloon() && (pass & PASS_FLYABLE))
                 retval = DIR_ADD_TO_MASK(d, retval);
             else if (transTile->name == Tile::sym.avatar || transTile->isHorse()) {
-                if (tile->canWalkOn(d) &&
-                    (!transTile->isHorse() || tile->isCreatureWalkable()) &&
-                    prev_tile->canWalkOff(d))
+                if ((pass & PASS_WALKON(d)) &&
+                    (!transTile->isHorse() || (pass & PASS_CREATURE_WALKABLE)) &&
+                    (prevPass & PASS_WALKOFF(d)))
                     retval = DIR_ADD_TO_MASK(d, retval);
             }
 //            else if (ontoCreature && to_m->canMoveOntoPlayer()) {
@@ -798,48 +1184,9 @@ int Map::getValidMoves(const Coords& from, MapTile transport) {
 
         // creature movement
         else if (m) {
-            // flying creatures
-            if (tile->isFlyable() && m->flies()) {
-                // FIXME: flying creatures behave differently on the world map?
-                if (isWorldMap())
-                    retval = DIR_ADD_TO_MASK(d, retval);
-                else if (tile->isWalkable() ||
-                         tile->isSwimable() ||
-                         tile->isSailable())
-                    retval = DIR_ADD_TO_MASK(d, retval);
-            }
-            // swimming creatures and sailing creatures
-            else if (tile->isSwimable() ||
-                     tile->isSailable() ||
-                     tile->isShip()) {
-                if (m->swims() && tile->isSwimable())
-                    retval = DIR_ADD_TO_MASK(d, retval);
-                if (m->sails() && tile->isSailable())
-                    retval = DIR_ADD_TO_MASK(d, retval);
-                if (m->canMoveOntoPlayer() && tile->isShip())
-                    retval = DIR_ADD_TO_MASK(d, retval);
-            }
-            // ghosts and other incorporeal creatures
-            else if (m->isIncorporeal()) {
-                // can move anywhere but onto water, unless of course the creature can swim
-                if (!(tile->isSwimable() ||
-                      tile->isSailable()))
-                    retval = DIR_ADD_TO_MASK(d, retval);
-            }
-            // walking creatures
-            else if (m->walks()) {
-                if (tile->canWalkOn(d) &&
-                    prev_tile->canWalkOff(d) &&
-                    tile->isCreatureWalkable())
-                    retval = DIR_ADD_TO_MASK(d, retval);
-            }
-            // Creatures that can move onto player
-            else if (ontoAvatar && m->canMoveOntoPlayer())
-            {
-                //tile should be transport
-                if (tile->isShip() && m->swims())
-                    retval = DIR_ADD_TO_MASK(d, retval);
-            }
+            if (map_creatureCanEnter(m, prevPass, pass, d, isWorldMap(),
+                                     ontoAvatar))
+                retval = DIR_ADD_TO_MASK(d, retval);
         }
     }
 
@@ -1029,3 +1376,287 @@ void Map::fillMonsterTableDungeon(SaveGameMonsterRecord* table) const {
         ++table;
     }
 }
+
+#ifdef DEBUG
+extern uint64_t getMicroTicks();
+
+/*
+ * The objectAt() of the unindexed map for comparison.
+ */
+static const Object* objectAtLinear(const Map* map, const Coords& coords) {
+    ObjectDeque::const_iterator i;
+    const Object *objAt = NULL;
+
+    for(i = map->objects.begin(); i != map->objects.end(); i++) {
+        const Object *obj = *i;
+
+        if (coords == obj->coords) {
+            if (objAt && (objAt->objType == Object::UNKNOWN) &&
+                (obj->objType != Object::UNKNOWN))
+                objAt = obj;
+            else if (objAt && (! objAt->focused) && (obj->focused))
+                objAt = obj;
+            else if (!objAt)
+                objAt = obj;
+        }
+    }
+    return objAt;
+}
+
+static int objectsAtLinear(const Map* map, const Coords& coords,
+                           Object** list, int max) {
+    ObjectDeque::const_iterator i;
+    int count = 0;
+
+    for(i = map->objects.begin(); i != map->objects.end() && count < max; i++) {
+        if (coords == (*i)->coords)
+            list[count++] = *i;
+    }
+    return count;
+}
+
+/*
+ * Time objectAt() & objectsAt() against a linear search of the object list
+ * by querying every tile of maps populated like a town and the world.
+ */
+void objectBenchmark(int rounds) {
+    static const int mapDim[2]  = { 32, 256 };
+    static const int objCount[2] = { 32, 64 };
+    Object* list[8];
+    uint64_t start, tOld, tNew, tOldN, tNewN;
+    uint32_t seed = 1;
+    int m, i, x, y, found;
+
+    printf("size  objects  objectAt old/new ns  objectsAt old/new ns\n");
+    for (m = 0; m < 2; ++m) {
+        Map map;
+        map.width = map.height = mapDim[m];
+        map.tileset = xu4.config->tileset();
+        for (i = 0; i < objCount[m]; ++i) {
+            seed = seed * 1103515245 + 12345;
+            x = (seed >> 8) % mapDim[m];
+            y = (seed >> 20) % mapDim[m];
+            map.addObject(new Object(Object::CREATURE), Coords(x, y, 0));
+        }
+
+        tOld = tNew = tOldN = tNewN = 0;
+        found = 0;
+        for (i = 0; i < rounds; ++i) {
+            Coords pos(0, 0, 0);
+
+            start = getMicroTicks();
+            for (pos.y = 0; pos.y < mapDim[m]; ++pos.y)
+                for (pos.x = 0; pos.x < mapDim[m]; ++pos.x)
+                    found += objectAtLinear(&map, pos) ? 1 : 0;
+            tOld += getMicroTicks() - start;
+
+            start = getMicroTicks();
+            for (pos.y = 0; pos.y < mapDim[m]; ++pos.y)
+                for (pos.x = 0; pos.x < mapDim[m]; ++pos.x)
+                    found -= map.objectAt(pos) ? 1 : 0;
+            tNew += getMicroTicks() - start;
+
+            start = getMicroTicks();
+            for (pos.y = 0; pos.y < mapDim[m]; ++pos.y)
+                for (pos.x = 0; pos.x < mapDim[m]; ++pos.x)
+                    found += objectsAtLinear(&map, pos, list, 8);
+            tOldN += getMicroTicks() - start;
+
+            start = getMicroTicks();
+            for (pos.y = 0; pos.y < mapDim[m]; ++pos.y)
+                for (pos.x = 0; pos.x < mapDim[m]; ++pos.x)
+                    found -= map.objectsAt(pos, list, 8);
+            tNewN += getMicroTicks() - start;
+        }
+        if (found)
+            errorFatal("objectBenchmark lookups differ");
+
+        double ns = 1000.0 / (double(rounds) * mapDim[m] * mapDim[m]);
+        printf("%4d  %7d  %8.1f %8.1f      %8.1f %8.1f\n",
+               mapDim[m], objCount[m], tOld * ns, tNew * ns,
+               tOldN * ns, tNewN * ns);
+    }
+}
+
+/*
+ * The map_creatureCanEnter() & getValidMoves() which tested Tile properties
+ * rather than PASS_* masks, for comparison.
+ */
+static bool creatureCanEnterTiles(const Creature* m, const Tile* prev_tile,
+                                  const Tile* tile, Direction d, bool worldMap,
+                                  bool ontoAvatar) {
+    if (tile->isFlyable() && m->flies()) {
+        if (worldMap)
+            return true;
+        else if (tile->isWalkable() ||
+                 tile->isSwimable() ||
+                 tile->isSailable())
+            return true;
+    }
+    else if (tile->isSwimable() ||
+             tile->isSailable() ||
+             tile->isShip()) {
+        if (m->swims() && tile->isSwimable())
+            return true;
+        if (m->sails() && tile->isSailable())
+            return true;
+        if (m->canMoveOntoPlayer() && tile->isShip())
+            return true;
+    }
+    else if (m->isIncorporeal()) {
+        if (!(tile->isSwimable() ||
+              tile->isSailable()))
+            return true;
+    }
+    else if (m->walks()) {
+        if (tile->canWalkOn(d) &&
+            prev_tile->canWalkOff(d) &&
+            tile->isCreatureWalkable())
+            return true;
+    }
+    else if (ontoAvatar && m->canMoveOntoPlayer())
+    {
+        if (tile->isShip() && m->swims())
+            return true;
+    }
+    return false;
+}
+
+static int validMovesTiles(const Map* map, const Coords& from,
+                           MapTile transport) {
+    int retval;
+    Direction d;
+    const Object *obj;
+    const Creature *m, *to_m;
+    const Tile* prev_tile;
+    const Tile* tile;
+    int ontoAvatar, ontoCreature;
+    Coords testCoord;
+
+    m = Creature::getByTile(transport);
+
+    bool isAvatar = (map->type != Map::COMBAT) && (from == c->location->coords);
+    if (m && m->canMoveOntoPlayer())
+        isAvatar = false;
+
+    prev_tile = map->tileTypeAt(from, WITHOUT_OBJECTS);
+
+    retval = 0;
+    for (d = DIR_WEST; d <= DIR_SOUTH; d = (Direction)(d+1)) {
+        ontoAvatar = 0;
+        ontoCreature = 0;
+
+        testCoord = from;
+        map_move(testCoord, d, map);
+
+        if (MAP_IS_OOB(map, testCoord)) {
+            retval = DIR_ADD_TO_MASK(d, retval);
+            continue;
+        }
+
+        obj = map->objectAt(testCoord);
+
+        if ((map->flags & SHOW_AVATAR) && (testCoord == c->location->coords))
+            ontoAvatar = 1;
+        else if (obj && (obj->objType != Object::UNKNOWN))
+            ontoCreature = 1;
+
+        if (ontoAvatar)
+            tile = c->party->getTransport().getTileType();
+        else if (ontoCreature)
+            tile = obj->tile.getTileType();
+        else
+            tile = map->tileTypeAt(testCoord, WITH_OBJECTS);
+
+        to_m = dynamic_cast<const Creature*>(obj);
+
+        if (m && !isAvatar) {
+            if ((ontoAvatar && m->canMoveOntoPlayer()) || (ontoCreature && m->canMoveOntoCreatures()))
+                tile = map->tileTypeAt(testCoord, WITHOUT_OBJECTS);
+            if ((ontoAvatar && !m->canMoveOntoPlayer())
+                ||  (
+                        ontoCreature &&
+                        (
+                            (!m->canMoveOntoCreatures() && !to_m->canMoveOntoCreatures())
+                            || (m->isForceOfNature() && to_m->isForceOfNature())
+                        )
+                    )
+                )
+                continue;
+        }
+
+        if (isAvatar) {
+            const Tile* transTile = transport.getTileType();
+            if (transTile->isShip() && tile->isSailable())
+                retval = DIR_ADD_TO_MASK(d, retval);
+            else if (transTile->isBalloon() && tile->isFlyable())
+                retval = DIR_ADD_TO_MASK(d, retval);
+            else if (transTile->name == Tile::sym.avatar || transTile->isHorse()) {
+                if (tile->canWalkOn(d) &&
+                    (!transTile->isHorse() || tile->isCreatureWalkable()) &&
+                    prev_tile->canWalkOff(d))
+                    retval = DIR_ADD_TO_MASK(d, retval);
+            }
+        }
+        else if (m) {
+            if (creatureCanEnterTiles(m, prev_tile, tile, d, map->isWorldMap(),
+                                      ontoAvatar))
+                retval = DIR_ADD_TO_MASK(d, retval);
+        }
+    }
+
+    return retval;
+}
+
+/*
+ * Time getValidMoves() against the Tile property version for every
+ * creature type on each tile of a 64x64 area around the party.  This needs
+ * the game context.
+ */
+void moveBenchmark(int rounds) {
+    const int AREA = 64;
+    Map* map = c->location->map;
+    const Coords& pos = c->location->coords;
+    const Creature* const* table;
+    uint32_t count, n;
+    uint64_t start, tOld = 0, tNew = 0;
+    int x0, y0, x1, y1, i;
+    unsigned int sumOld = 0, sumNew = 0;
+    Coords from(0, 0, pos.z);
+
+    table = xu4.config->creatureTable(&count);
+
+    x0 = std::max(pos.x - AREA / 2, 0);
+    y0 = std::max(pos.y - AREA / 2, 0);
+    x1 = std::min(x0 + AREA, int(map->width));
+    y1 = std::min(y0 + AREA, int(map->height));
+
+    map->getValidMoves(pos, table[0]->tile);    // Build the pass grid.
+
+    for (i = 0; i < rounds; ++i) {
+        start = getMicroTicks();
+        for (n = 0; n < count; ++n) {
+            for (from.y = y0; from.y < y1; ++from.y)
+                for (from.x = x0; from.x < x1; ++from.x)
+                    sumOld += validMovesTiles(map, from, table[n]->tile);
+        }
+        tOld += getMicroTicks() - start;
+
+        start = getMicroTicks();
+        for (n = 0; n < count; ++n) {
+            for (from.y = y0; from.y < y1; ++from.y)
+                for (from.x = x0; from.x < x1; ++from.x)
+                    sumNew += map->getValidMoves(from, table[n]->tile);
+        }
+        tNew += getMicroTicks() - start;
+    }
+    if (sumOld != sumNew)
+        errorFatal("moveBenchmark results differ");
+
+    double ns = 1000.0 / (double(rounds) * count * (x1 - x0) * (y1 - y0));
+    printf("map %d, %u creatures, %dx%d tiles\n", map->id, count,
+           x1 - x0, y1 - y0);
+    printf("getValidMoves  tiles %.1f ns  masks %.1f ns\n",
+           tOld * ns, tNew * ns);
+}
+#endif
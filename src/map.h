@@ -23,6 +23,7 @@ struct Portal;
 typedef std::vector<Portal *> PortalList;
 typedef std::deque<Object *> ObjectDeque;
 typedef std::deque<const Object *> CObjectDeque;
+typedef std::vector<Object *> ObjectBucket;
 
 /* flags */
 #define SHOW_AVATAR (1 << 0)
@@ -34,10 +35,20 @@ typedef std::deque<const Object *> CObjectDeque;
 #define WITH_GROUND_OBJECTS 1
 #define WITH_OBJECTS        2
 
-#define BLOCKING_POS_SIZE   128*3
+/* objects are indexed in buckets of OBJ_BUCKET_DIM x OBJ_BUCKET_DIM tiles */
+#define OBJ_BUCKET_SHIFT    3
+#define OBJ_BUCKET_DIM      (1 << OBJ_BUCKET_SHIFT)
+
+/* the most occluders the shadow casting shader accepts; the tilePos floats
+   are packed into vec4 uniforms so this uses 192 of the 224 vectors GLES 3
+   guarantees */
+#define BLOCKING_SHAPES_MAX 256
+
 struct BlockingGroups {
     int left, center, right;
-    float tilePos[BLOCKING_POS_SIZE];
+    int sx, sy, vw, vh;     // View the groups were built for (vw 0 = none).
+    int lost;               // Number of occluders which did not fit.
+    float tilePos[BLOCKING_SHAPES_MAX * 3];
 };
 
 /**
@@ -70,7 +81,7 @@ public:
     // Member functions
     virtual const char* getName() const;
 
-    void queryBlocking(BlockingGroups*, int sx, int sy, int vw, int vh) const;
+    bool queryBlocking(BlockingGroups*, int sx, int sy, int vw, int vh) const;
     void queryVisible(const Coords &coords, int radius,
                       void (*func)(const Coords*, VisualId, void*),
                       void* user, const Object** focus) const;
@@ -81,10 +92,14 @@ public:
     Object* objectAt(const Coords &coords) {
         return (Object*) static_cast<const Map*>(this)->objectAt(coords);
     }
+    int objectsAt(const Coords &coords, Object** list, int max) const;
     const Portal *portalAt(const Coords &coords, int actionFlags);
     TileId getTileFromData(const Coords &coords) const;
     const Tile* tileTypeAt(const Coords &coords, int withObjects) const;
+    int passabilityAt(const Coords &coords, const Object* obj = NULL) const;
     void setTileAt(const Coords &coords, TileId tid);
+    void buildOpacityGrid();
+    void freePassGrid();
     bool isWorldMap() const;
     bool isEnclosed(const Coords &party);
     class Creature *addCreature(const class Creature *m, const Coords& coords);
@@ -94,6 +109,7 @@ public:
     ObjectDeque::iterator removeObject(ObjectDeque::iterator rem, bool deleteObject = true);
     void clearObjects();
     bool objectPresent(const Object* obj) const;
+    void objectMoved(Object* obj, const Coords& from);
     class Creature *moveObjects(const Coords& avatar);
     int getNumberOfCreatures();
     int getValidMoves(const Coords& from, MapTile transport);
@@ -128,11 +144,23 @@ public:
     PortalList      portals;
     AnnotationList  annotations;
     TileId*         data;
+    uint16_t*       passGrid;       // PASS_* mask of each data tile.
+    uint8_t*        opacityGrid;    // Tile::opaque of each level 0 tile.
     ObjectDeque     objects;
     std::map<Symbol, Coords> labels;
     const Tileset*  tileset;
 
 private:
+    std::vector<ObjectBucket> objBuckets;   // Spatial index of objects.
+    uint16_t        objBucketCols,
+                    objBucketRows;
+    int             creatureCount;
+
+    int objectBucket(const Coords& pos) const;
+    void indexObject(Object* obj);
+    void unindexObject(const Object* obj);
+    void buildPassGrid();
+
     // disallow map copying: all maps should be created and accessed
     // through the MapMgr
     Map(const Map &map);
@@ -156,6 +184,8 @@ void map_move(Coords&, int dx, int dy, const Map *map = NULL);
 int  map_getRelativeDirection(const Coords& a, const Coords& b, const Map* map = NULL);
 int  map_movementDistance(const Coords& a, const Coords &b, const Map *map = NULL);
 int  map_distance(const Coords& a, const Coords& b, const Map* map = NULL);
+bool map_creatureCanEnter(const Creature* m, int prevPass, int pass,
+                          Direction d, bool worldMap, bool ontoAvatar = false);
 bool map_outOfBounds(const Map* map, const Coords& c);
 
 #define MAP_IS_OOB(M,C) map_outOfBounds(M, C)
@@ -7,36 +7,108 @@
 
 #include "city.h"
 #include "config.h"
+#include "context.h"
 #include "dialogueloader.h"
 #include "debug.h"
 #include "dungeon.h"
 #include "error.h"
+#include "location.h"
 #include "mapmgr.h"
 #include "person.h"
+#include "settings.h"
 #include "u4file.h"
 #include "xu4.h"
+#include "support/profiler.h"
 
 #ifdef GPU_RENDER
 #include "tileset.h"
 #endif
 
 
+extern bool verbose;
+
+// Number of most recent Config::map() uses which are never unloaded.
+#define MAP_KEEP_RECENT 4
+
+struct MapResidency {
+    uint32_t lastUse;
+    uint16_t width, height;     // Dimensions as configured (before loading).
+    uint16_t chunk_width, chunk_height;
+    bool configured;
+};
+
+static std::vector<MapResidency> residency;   // Indexed by Map::id.
+static uint32_t residencyClock = 0;
+
+// The files being read ahead by mapPrefetch() for map prefetchId.
+static U4Fetch* prefetchMap = NULL;
+static U4Fetch* prefetchTlk = NULL;
+static int prefetchId = -1;
+
+static void prefetchFree() {
+    if (prefetchMap) {
+        u4fetchFree(prefetchMap);
+        prefetchMap = NULL;
+    }
+    if (prefetchTlk) {
+        u4fetchFree(prefetchTlk);
+        prefetchTlk = NULL;
+    }
+    prefetchId = -1;
+}
+
 #ifdef U5_DAT
 static bool isChunkCompressed(Map *map, int chunk) {
     return map->compressed_chunks[ chunk ] == 255;
 }
 #endif
 
+/*
+ * Return the residency state of a map, growing the table to cover its id.
+ */
+static MapResidency& mapResidency(const Map* map) {
+    if (map->id >= residency.size()) {
+        MapResidency unused;
+        memset(&unused, 0, sizeof(unused));
+        residency.resize(map->id + 1, unused);
+    }
+    return residency[map->id];
+}
+
+/*
+ * Convert a run of Ultima save ids to module TileIds.
+ * Each group of four source bytes is read before any of its results are
+ * stored so that the conversion can be done in place (see loadMapData).
+ */
+static void translateIds(TileId* dst, const uint8_t* src, int n,
+                         const TileId* table) {
+    TileId t0, t1, t2, t3;
+    for (; n >= 4; n -= 4) {
+        t0 = table[src[0]];
+        t1 = table[src[1]];
+        t2 = table[src[2]];
+        t3 = table[src[3]];
+        src += 4;
+        dst[0] = t0;
+        dst[1] = t1;
+        dst[2] = t2;
+        dst[3] = t3;
+        dst += 4;
+    }
+    while (n--)
+        *dst++ = table[*src++];
+}
+
 /**
  * Loads raw data from the given file.
  */
 bool loadMapData(Map *map, U4FILE *uf, Symbol borderTile) {
-    unsigned int x, xch, y, ych, di;
+    unsigned int xch, y, ych, di;
     unsigned int chunkCols, chunkRows;
     size_t chunkLen;
     uint8_t* chunk;
     uint8_t* cp;
-    const UltimaSaveIds* usaveIds = xu4.config->usaveIds();
+    const TileId* idTable = xu4.config->usaveIds()->moduleIdLUT();
     bool ok = false;
 #ifdef U5_DAT
     Symbol sym_sea = SYM_UNSET;
@@ -54,7 +126,7 @@ bool loadMapData(Map *map, U4FILE *uf, Symbol borderTile) {
     chunkRows = map->height / map->chunk_height;
 
     chunkLen = map->chunk_width * map->chunk_height;
-    chunk = new uint8_t[chunkLen];
+    chunk = NULL;
 
 #ifdef GPU_RENDER
     bool addBorder = false;
@@ -90,6 +162,11 @@ bool loadMapData(Map *map, U4FILE *uf, Symbol borderTile) {
     map->data = new TileId[map->width * map->height];
 #endif
 
+    // When chunks span the full map width their rows are contiguous in
+    // map->data and can be read straight into the destination.
+    if (map->chunk_width != map->width)
+        chunk = new uint8_t[chunkLen];
+
     if (map->offset)
         u4fseek(uf, map->offset, SEEK_CUR);
 
@@ -104,25 +181,30 @@ bool loadMapData(Map *map, U4FILE *uf, Symbol borderTile) {
                     sym_sea = xu4.config->intern("sea");
                 MapTile water = map->tileset->getByName(sym_sea)->getId();
                 for(y = 0; y < map->chunk_height; ++y) {
-                    for(x = 0; x < map->chunk_width; ++x) {
+                    for(unsigned int x = 0; x < map->chunk_width; ++x) {
                         map->data[x + (y * map->width) + di] = water.id;
                     }
                 }
             }
             else
 #endif
-            {
-                size_t n = u4fread(chunk, 1, chunkLen, uf);
-                if (n != chunkLen)
+            if (! chunk) {
+                // Read the bytes into the upper half of the destination
+                // and expand them forward to TileIds in place.
+                TileId* dst = map->data + di;
+                cp = ((uint8_t*) dst) + chunkLen * (sizeof(TileId) - 1);
+                if (u4fread(cp, 1, chunkLen, uf) != chunkLen)
+                    goto cleanup;
+                translateIds(dst, cp, chunkLen, idTable);
+            } else {
+                if (u4fread(chunk, 1, chunkLen, uf) != chunkLen)
                     goto cleanup;
 
                 cp = chunk;
                 for(y = 0; y < map->chunk_height; ++y) {
-                    for(x = 0; x < map->chunk_width; ++x) {
-                        int c = *cp++;
-                        MapTile mt = usaveIds->moduleId(c);
-                        map->data[x + (y * map->width) + di] = mt.id;
-                    }
+                    translateIds(map->data + (y * map->width) + di, cp,
+                                 map->chunk_width, idTable);
+                    cp += map->chunk_width;
                 }
             }
         }
@@ -165,9 +247,10 @@ static int moveBehavior(int ultValue) {
 }
 
 /**
- * Load city data from 'ult' and 'tlk' files.
+ * Load city data from 'ult' and 'tlk' files.  The tlk file is taken from
+ * tlkFetch if mapPrefetch() has read it.
  */
-static bool loadCityMap(Map *map, U4FILE *ult) {
+static bool loadCityMap(Map *map, U4FILE *ult, U4Fetch* tlkFetch) {
     City *city = dynamic_cast<City*>(map);
     int i, j;
     uint8_t* data;
@@ -217,7 +300,9 @@ static bool loadCityMap(Map *map, U4FILE *ult) {
 
     {
     const uint8_t* conv_idx = data + PD_CONV;
-    U4FILE *tlk = u4fopen(xu4.config->confString(city->tlk_fname));
+    U4FILE *tlk = tlkFetch ? u4fetchOpen(tlkFetch) : NULL;
+    if (! tlk)
+        tlk = u4fopen(xu4.config->confString(city->tlk_fname));
     if (! tlk)
         errorFatal("Unable to open .TLK file");
 
@@ -342,7 +427,7 @@ static bool loadDungeonMap(Map *map, U4FILE *uf, FILE *sav) {
     Dungeon *dungeon = dynamic_cast<Dungeon*>(map);
     const UltimaSaveIds* usaveIds = xu4.config->usaveIds();
     unsigned int i, j;
-    uint8_t* rawMap;
+    const uint8_t* rawMap;
     size_t bytes;
 
     /* the map must be 11x11 to be read from an .CON file */
@@ -354,16 +439,22 @@ static bool loadDungeonMap(Map *map, U4FILE *uf, FILE *sav) {
 
     /* load the dungeon map */
     bytes = DNG_HEIGHT * DNG_WIDTH * dungeon->levels;
-    dungeon->rawMap.reserve(bytes);
-    rawMap = &dungeon->rawMap.front();
-    if (sav) {
-        i = fread(rawMap, 1, bytes, sav);
+    // The raw map stays in the dungeon for subTokenAt() & fillRawMap().
+    if (! sav && dungeon->rawMap.size() == bytes) {
+        // Use the state kept by unloadMap().
+        i = bytes;
+        u4fseek(uf, bytes, SEEK_CUR);
+    } else if (sav) {
+        dungeon->rawMap.resize(bytes);
+        i = fread(&dungeon->rawMap[0], 1, bytes, sav);
         u4fseek(uf, bytes, SEEK_CUR);
     } else {
-        i = u4fread(rawMap, 1, bytes, uf);
+        dungeon->rawMap.resize(bytes);
+        i = u4fread(&dungeon->rawMap[0], 1, bytes, uf);
     }
     if (i != bytes)
         return false;
+    rawMap = &dungeon->rawMap[0];
 
     if (! dungeon->data)
         dungeon->data = new TileId[bytes];
@@ -502,29 +593,56 @@ static bool loadDungeonMap(Map *map, U4FILE *uf, FILE *sav) {
 }
 
 bool loadMap(Map *map, FILE* sav) {
+    PROF_ZONE("loadMap");
     U4FILE* uf;
     bool ok = false;
 
+    // Remember the configured size as loadMapData() may alter it.
+    MapResidency& mr = mapResidency(map);
+    if (! mr.configured) {
+        mr.width        = map->width;
+        mr.height       = map->height;
+        mr.chunk_width  = map->chunk_width;
+        mr.chunk_height = map->chunk_height;
+        mr.configured   = true;
+    }
+
+    U4Fetch* fetch = NULL;
+    U4Fetch* tlkFetch = NULL;
+    if (prefetchId == map->id) {
+        fetch    = prefetchMap;
+        tlkFetch = prefetchTlk;
+        prefetchMap = prefetchTlk = NULL;
+        prefetchId = -1;
+    }
+
 #ifdef CONF_MODULE
     if (map->fname) {
-        string fname( xu4.config->confString(map->fname) );
-        uf = u4fopen(fname);
+        uf = fetch ? u4fetchOpen(fetch) : NULL;
+        if (! uf) {
+            string fname( xu4.config->confString(map->fname) );
+            uf = u4fopen(fname);
+        }
     } else {
-        const CDIEntry* ent = xu4.config->mapFile(map->id);
-        if (ent) {
-            uf = u4fopen_stdio(xu4.config->modulePath());
-            u4fseek(uf, ent->offset, SEEK_SET);
-        } else
+        FileView view;
+        if (xu4.config->mapFile(map->id, &view))
+            uf = u4fopen_mem(view.data, view.bytes);
+        else
             uf = NULL;
     }
 #else
-    string fname( xu4.config->confString(map->fname) );
-    uf = u4fopen(fname);
+    uf = fetch ? u4fetchOpen(fetch) : NULL;
+    if (! uf) {
+        string fname( xu4.config->confString(map->fname) );
+        uf = u4fopen(fname);
+    }
 #endif
+    map->freePassGrid();
+
     if (uf) {
         switch (map->type) {
             case Map::CITY:
-                ok = loadCityMap(map, uf);
+                ok = loadCityMap(map, uf, tlkFetch);
                 break;
 
             case Map::COMBAT:
@@ -541,6 +659,237 @@ bool loadMap(Map *map, FILE* sav) {
                 break;
         }
         u4fclose(uf);
+
+        if (ok && map->type != Map::DUNGEON)
+            map->buildOpacityGrid();
     }
+    if (fetch)
+        u4fetchFree(fetch);
+    if (tlkFetch)
+        u4fetchFree(tlkFetch);
     return ok;
 }
+
+static size_t dungeonRoomMemory(const Map* map) {
+    const Dungeon* dng = static_cast<const Dungeon*>(map);
+    return dng->n_rooms * (sizeof(DngRoom) + sizeof(CombatMap) +
+                           2 * CON_WIDTH * CON_HEIGHT * sizeof(TileId));
+}
+
+/*
+ * Return the approximate number of bytes used by the loaded map.
+ */
+static size_t mapMemory(const Map* map) {
+    size_t area  = map->width * map->height;
+    size_t tiles = area * map->levels;
+    size_t bytes = tiles * sizeof(TileId);
+#ifdef GPU_RENDER
+    // Rows padded by loadMapData() to make the chunks square.
+    if (map->chunk_height < map->chunk_width)
+        bytes += map->width * (map->chunk_width - map->chunk_height) *
+                 sizeof(TileId);
+#endif
+    if (map->passGrid)
+        bytes += tiles * sizeof(uint16_t);
+    if (map->opacityGrid)
+        bytes += area;
+    if (isDungeon(map))
+        bytes += dungeonRoomMemory(map);
+    return bytes;
+}
+
+/*
+ * Return the most that mapMemory() can report for an unloaded map once it
+ * has been loaded and its grids built.  This follows the size changes made
+ * by loadMapData().
+ */
+static size_t mapMemoryLoaded(const Map* map) {
+    size_t w = map->width;
+    size_t h = map->height;
+    size_t pad = 0;
+#ifdef GPU_RENDER
+    if (! isDungeon(map)) {
+        size_t cw = map->chunk_width  ? map->chunk_width  : w;
+        size_t ch = map->chunk_height ? map->chunk_height : h;
+        if (isCity(map) && map->border_behavior == Map::BORDER_EXIT2PARENT) {
+            w += cw;
+            h += ch;
+        }
+        if (ch < cw)
+            pad = w * (cw - ch);
+    }
+#endif
+    size_t area  = w * h;
+    size_t tiles = area * map->levels;
+    size_t bytes = (tiles + pad) * sizeof(TileId) + tiles * sizeof(uint16_t);
+    if (isDungeon(map))
+        bytes += dungeonRoomMemory(map);
+    else
+        bytes += area;
+    return bytes;
+}
+
+/*
+ * Free everything loadMap() created so that Config::map() will load the map
+ * again on the next use.  The Map object itself is kept as other modules
+ * hold pointers to it.
+ *
+ * A dungeon keeps its raw map, in the same form as dngmap.sav, so that
+ * changes to it survive the reload.
+ */
+static void unloadMap(Map* map) {
+    if (isDungeon(map)) {
+        Dungeon* dng = static_cast<Dungeon*>(map);
+        dng->fillRawMap();          // Updated in place for the reload.
+        dng->freeRooms();
+    } else if (isCity(map)) {
+        City* city = static_cast<City*>(map);
+        city->removeAllPeople();
+        city->freePersons();
+    }
+
+    map->clearObjects();
+    map->freePassGrid();
+    delete[] map->data;
+    map->data = NULL;
+
+    const MapResidency& mr = mapResidency(map);
+    map->width        = mr.width;
+    map->height       = mr.height;
+    map->chunk_width  = mr.chunk_width;
+    map->chunk_height = mr.chunk_height;
+}
+
+/*
+ * Return true if the map is part of the current location stack.
+ */
+static bool mapActive(const Map* map) {
+    for (const Location* loc = c->location; loc; loc = loc->prev) {
+        if (loc->map == map)
+            return true;
+    }
+    return false;
+}
+
+static size_t mapMemoryResident(const std::vector<Map*>& maps) {
+    std::vector<Map*>::const_iterator it;
+    size_t total = 0;
+    for (it = maps.begin(); it != maps.end(); ++it) {
+        if (*it && (*it)->data)
+            total += mapMemory(*it);
+    }
+    return total;
+}
+
+/*
+ * Note the use of a map and unload the least recently used maps while the
+ * loaded maps exceed the mapMemoryLimit setting.  The world map, maps in
+ * the location stack and the last few maps used are never unloaded.
+ */
+void mapResidencyUpdate(std::vector<Map*>& maps, Map* used) {
+    std::vector<Map*>::iterator it;
+    Map* lru;
+    size_t total;
+    size_t limit = xu4.settings->mapMemoryLimit;
+
+    mapResidency(used).lastUse = ++residencyClock;
+    if (! limit || ! c)
+        return;
+    limit *= 1024;
+
+    total = mapMemoryResident(maps);
+    while (total > limit) {
+        lru = NULL;
+        for (it = maps.begin(); it != maps.end(); ++it) {
+            Map* m = *it;
+            if (! m || ! m->data || m->type == Map::WORLD)
+                continue;
+            const MapResidency& mr = mapResidency(m);
+            if (mr.lastUse + MAP_KEEP_RECENT > residencyClock)
+                continue;
+            if (lru && mapResidency(lru).lastUse <= mr.lastUse)
+                continue;
+            if (! mapActive(m))
+                lru = m;
+        }
+        if (! lru)
+            break;
+
+        total -= mapMemory(lru);
+        if (verbose)
+            printf("unload map %d (%u KB loaded)\n", lru->id,
+                   (unsigned int) (total / 1024));
+        unloadMap(lru);
+    }
+}
+
+/*
+ * Prepare to load a map ahead of its use by reading its files (including
+ * the dialogue of a city) on worker threads.  The map is not parsed here as Config and the loaders are not
+ * thread safe; once this returns true Config::map() can load it without
+ * waiting on file I/O.
+ *
+ * Return false while the file is being read, or if loading the map would
+ * go over the mapMemoryLimit and unload other maps.
+ */
+bool mapPrefetch(const std::vector<Map*>& maps, const Map* map) {
+    if (map->data)
+        return true;
+
+    size_t limit = xu4.settings->mapMemoryLimit;
+    if (limit && mapMemoryResident(maps) + mapMemoryLoaded(map) > limit * 1024)
+        return false;
+
+    if (prefetchId != map->id) {
+        prefetchFree();
+        prefetchId = map->id;
+
+        // Module maps without a file are already mapped into memory.
+        // A missing file is left for Config::map() to report.
+#ifdef CONF_MODULE
+        if (map->fname)
+#endif
+            prefetchMap = u4fetch(xu4.config->confString(map->fname));
+        if (isCity(map)) {
+            const City* city = static_cast<const City*>(map);
+            prefetchTlk = u4fetch(xu4.config->confString(city->tlk_fname));
+        }
+    }
+
+    return (! prefetchMap || u4fetchDone(prefetchMap)) &&
+           (! prefetchTlk || u4fetchDone(prefetchTlk));
+}
+
+#ifdef DEBUG
+extern uint64_t getMicroTicks();
+
+/*
+ * Time loadMap() for every map in the module and print the average load
+ * time of each.
+ */
+void mapBenchmark(int rounds) {
+    Map* map;
+    uint64_t start, total, sum = 0;
+    uint32_t id;
+    int i;
+
+    printf("map  type      size   load ms\n");
+    for (id = 0; (map = xu4.config->map(id)); ++id) {
+        total = 0;
+        for (i = 0; i < rounds; ++i) {
+            unloadMap(map);
+            // Read dungeons from the file rather than the kept raw map.
+            if (isDungeon(map))
+                static_cast<Dungeon*>(map)->rawMap.clear();
+            start = getMicroTicks();
+            if (! loadMap(map, NULL))
+                errorFatal("loadMap failed for map %d", id);
+            total += getMicroTicks() - start;
+        }
+        sum += total;
+        printf("%3d  %4d  %4dx%-4d  %8.3f\n", id, map->type,
+               map->width, map->height, double(total) * 0.001 / rounds);
+    }
+    printf("all maps: %.3f ms\n", double(sum) * 0.001 / rounds);
+}
+#endif
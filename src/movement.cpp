@@ -7,11 +7,22 @@
 #include "context.h"
 #include "debug.h"
 #include "dungeon.h"
+#include "pathfind.h"
+#include "settings.h"
 #include "utils.h"
 #include "xu4.h"
 
 bool collisionOverride = false;
 
+/*
+ * Return true if creatures should search for a path rather than using the
+ * original U4 behavior of stepping in the general direction of the target.
+ */
+static bool usePathfinding() {
+    const Settings* settings = xu4.settings;
+    return settings->enhancements && settings->enhancementsOptions.smartPathing;
+}
+
 /**
  * Attempt to move the avatar in the given direction.  User event
  * should be set if the avatar is being moved in response to a
@@ -197,6 +208,15 @@ int moveObject(Map *map, Creature *obj, const Coords& avatar) {
             break;
         }
 
+        if (usePathfinding()) {
+            const Creature* m = Creature::getByTile(obj->tile);
+            if (m) {
+                dir = pathfind_toAvatar(map, m, new_coords, avatar, dirmask);
+                if (dir)
+                    break;
+            }
+        }
+
         dir = map_pathTo(new_coords, avatar, dirmask, true, c->location->map);
         break;
     }
@@ -241,7 +261,7 @@ int moveObject(Map *map, Creature *obj, const Coords& avatar) {
     if (! (new_coords == obj->coords) &&
         ! MAP_IS_OOB(map, new_coords))
     {
-        obj->coords = new_coords;
+        obj->updateCoords(new_coords);
     }
     return 1;
 }
@@ -277,7 +297,11 @@ int moveCombatObject(int act, Map *map, Creature *obj, const Coords& target) {
         else if (new_coords.y >= (signed)(map->height - 1))
             valid_dirs = DIR_REMOVE_FROM_MASK(DIR_SOUTH, valid_dirs);
 
-        dir = map_pathTo(new_coords, target, valid_dirs);
+        dir = DIR_NONE;
+        if (usePathfinding())
+            dir = pathfind_toTarget(map, obj, new_coords, target, valid_dirs);
+        if (! dir)
+            dir = map_pathTo(new_coords, target, valid_dirs);
     }
 
     if (dir)
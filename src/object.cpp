@@ -33,6 +33,21 @@ bool Object::setDirection(Direction d) {
     return tile.setDirection(d);
 }
 
+/*
+ * Move the object, keeping the previous position in prevCoords.
+ * The spatial index of any map the object is on is updated.
+ */
+void Object::updateCoords(const Coords& pos) {
+    prevCoords = coords;
+    coords = pos;
+
+    if (onMaps && c) {
+        Location* loc = c->location;
+        for (; loc; loc = loc->prev)
+            loc->map->objectMoved(this, prevCoords);
+    }
+}
+
 /*
  * Sets Object coords & prevCoords to the specified position.
  */
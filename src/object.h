@@ -33,10 +33,7 @@ public:
     // Methods
     void setTile(const Tile *t) { tile = t->getId(); }
 
-    void updateCoords(const Coords& c) {
-        prevCoords = coords;
-        coords = c;
-    }
+    void updateCoords(const Coords& c);
 
     void placeOnMap(Map*, const Coords&);
     void removeFromMaps();
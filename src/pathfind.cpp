@@ -0,0 +1,365 @@
+/*
+ * pathfind.cpp
+ */
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "pathfind.h"
+
+#include "creature.h"
+#include "map.h"
+
+/*
+ * Searches are limited to a window of PATH_DIM x PATH_DIM tiles.  Smaller
+ * maps fit entirely inside the window; on larger maps it is centered on
+ * the search origin.
+ */
+#define PATH_DIM        64
+#define PATH_CELLS      (PATH_DIM * PATH_DIM)
+#define PATH_UNREACHED  0xffff
+#define PATH_MAX_NODES  1024
+#define FLOW_FIELDS     4
+
+struct PathWindow {
+    const Map* map;
+    int ox, oy, z;
+    int w, h;
+    bool wrap;
+    int16_t pass[PATH_CELLS];           // Terrain cache (-1 if unread).
+};
+
+/*
+ * A distance field shared by all creatures of the same movement class
+ * that are pursuing the same goal during a turn.
+ */
+struct FlowField {
+    const Map* map;
+    const Creature* mover;
+    Coords goal;
+    int moverClass;
+    PathWindow win;
+    uint16_t dist[PATH_CELLS];
+};
+
+struct PathNode {
+    int f;
+    int g;
+    int idx;
+
+    bool operator<(const PathNode& n) const { return f > n.f; }
+};
+
+static FlowField flowFields[FLOW_FIELDS];
+static int flowFieldsUsed = 0;
+static int flowFieldNext = 0;
+
+static void window_init(PathWindow* win, const Map* map, const Coords& center) {
+    win->map  = map;
+    win->z    = center.z;
+    win->wrap = (map->border_behavior == Map::BORDER_WRAP);
+
+    if (map->width <= PATH_DIM) {
+        win->ox = 0;
+        win->w  = map->width;
+    } else {
+        win->ox = center.x - PATH_DIM / 2;
+        win->w  = PATH_DIM;
+    }
+
+    if (map->height <= PATH_DIM) {
+        win->oy = 0;
+        win->h  = map->height;
+    } else {
+        win->oy = center.y - PATH_DIM / 2;
+        win->h  = PATH_DIM;
+    }
+
+    memset(win->pass, 0xff, sizeof(win->pass));
+}
+
+/*
+ * Return the window cell index of a map position, or -1 if it lies
+ * outside the window.
+ */
+static int window_index(const PathWindow* win, const Coords& pos) {
+    if (pos.z != win->z)
+        return -1;
+
+    int lx = pos.x - win->ox;
+    int ly = pos.y - win->oy;
+    if (win->wrap) {
+        int mw = win->map->width;
+        int mh = win->map->height;
+        lx %= mw;
+        if (lx < 0)
+            lx += mw;
+        ly %= mh;
+        if (ly < 0)
+            ly += mh;
+    }
+    if (lx < 0 || lx >= win->w || ly < 0 || ly >= win->h)
+        return -1;
+    return ly * PATH_DIM + lx;
+}
+
+static Coords window_coords(const PathWindow* win, int idx) {
+    Coords pos(win->ox + (idx % PATH_DIM), win->oy + (idx / PATH_DIM), win->z);
+    map_wrap(pos, win->map);
+    return pos;
+}
+
+static int window_pass(PathWindow* win, int idx, const Coords& pos) {
+    int pass = win->pass[idx];
+    if (pass < 0) {
+        pass = win->map->passabilityAt(pos);
+        win->pass[idx] = pass;
+    }
+    return pass;
+}
+
+/*
+ * Return the window index of the neighbor of pos in direction d, or -1 if
+ * that is off the map or outside the window.
+ */
+static int window_step(const PathWindow* win, Coords& pos, Direction d) {
+    map_move(pos, d, win->map);
+    if (MAP_IS_OOB(win->map, pos))
+        return -1;
+    return window_index(win, pos);
+}
+
+/*
+ * Return a key which is the same for all creatures that map_creatureCanEnter
+ * treats identically.
+ */
+static int moverClass(const Creature* m) {
+    return (m->flies()             ? 0x01 : 0) |
+           (m->swims()             ? 0x02 : 0) |
+           (m->sails()             ? 0x04 : 0) |
+           (m->isIncorporeal()     ? 0x08 : 0) |
+           (m->canMoveOntoPlayer() ? 0x10 : 0);
+}
+
+/*
+ * Fill in the distance from every reachable cell to the goal with a
+ * breadth-first search outward from the goal.
+ */
+static void flow_build(FlowField* ff) {
+    PathWindow* win = &ff->win;
+    std::vector<uint16_t> queue;
+    Coords pos, from;
+    int pass;
+    int d, bi, ai, gi;
+    size_t head;
+    bool world = ff->map->isWorldMap();
+
+    memset(ff->dist, 0xff, sizeof(ff->dist));
+
+    gi = window_index(win, ff->goal);
+    if (gi < 0)
+        return;
+    ff->dist[gi] = 0;
+
+    queue.reserve(win->w * win->h);
+    queue.push_back(gi);
+
+    for (head = 0; head < queue.size(); ++head) {
+        bi = queue[head];
+        pos = window_coords(win, bi);
+        pass = window_pass(win, bi, pos);
+
+        for (d = DIR_WEST; d <= DIR_SOUTH; ++d) {
+            // Find the cell that reaches this one by moving in direction d.
+            from = pos;
+            ai = window_step(win, from, dirReverse((Direction) d));
+            if (ai < 0 || ff->dist[ai] != PATH_UNREACHED)
+                continue;
+
+            // The goal is the avatar, so its terrain does not matter.
+            if (bi != gi &&
+                ! map_creatureCanEnter(ff->mover, window_pass(win, ai, from),
+                                       pass, (Direction) d, world))
+                continue;
+
+            ff->dist[ai] = ff->dist[bi] + 1;
+            queue.push_back(ai);
+        }
+    }
+}
+
+/*
+ * Return the flow field toward the goal for the movement class of the
+ * given creature, building it if no creature has asked for it yet.
+ */
+static const FlowField* flow_field(const Map* map, const Creature* mover,
+                                   const Coords& goal) {
+    FlowField* ff;
+    int mc = moverClass(mover);
+    int i;
+
+    for (i = 0; i < flowFieldsUsed; ++i) {
+        ff = flowFields + i;
+        if (ff->map == map && ff->moverClass == mc && ff->goal == goal)
+            return ff;
+    }
+
+    if (flowFieldsUsed < FLOW_FIELDS)
+        ff = flowFields + flowFieldsUsed++;
+    else {
+        ff = flowFields + flowFieldNext;
+        flowFieldNext = (flowFieldNext + 1) % FLOW_FIELDS;
+    }
+
+    ff->map   = map;
+    ff->mover = mover;
+    ff->goal  = goal;
+    ff->moverClass = mc;
+    window_init(&ff->win, map, goal);
+    flow_build(ff);
+    return ff;
+}
+
+/**
+ * Discards the flow fields built during the previous turn.  This must be
+ * called before creatures move as the terrain or avatar may have changed.
+ */
+void pathfind_resetFields() {
+    flowFieldsUsed = 0;
+    flowFieldNext = 0;
+}
+
+/**
+ * Returns the direction which takes a creature closest to the avatar along
+ * the shortest path, or DIR_NONE if no move in validDirs gets it closer.
+ * All creatures of the same movement class share a single distance field
+ * each turn.
+ */
+Direction pathfind_toAvatar(const Map* map, const Creature* mover,
+                            const Coords& from, const Coords& avatar,
+                            int validDirs) {
+    const FlowField* ff;
+    Coords pos;
+    int ci, ni, d;
+    int mask = 0;
+    int best;
+
+    if (from.z != avatar.z)
+        return DIR_NONE;
+
+    ff = flow_field(map, mover, avatar);
+    ci = window_index(&ff->win, from);
+    if (ci < 0)
+        return DIR_NONE;
+
+    best = ff->dist[ci];
+    for (d = DIR_WEST; d <= DIR_SOUTH; ++d) {
+        if (! DIR_IN_MASK(d, validDirs))
+            continue;
+        pos = from;
+        ni = window_step(&ff->win, pos, (Direction) d);
+        if (ni < 0)
+            continue;
+
+        if (ff->dist[ni] < best) {
+            best = ff->dist[ni];
+            mask = MASK_DIR(d);
+        } else if (mask && ff->dist[ni] == best)
+            mask |= MASK_DIR(d);
+    }
+
+    return mask ? dirRandomDir(mask) : DIR_NONE;
+}
+
+static int pathDistance(const PathWindow* win, const Coords& a,
+                        const Coords& b) {
+    int dx = abs(a.x - b.x);
+    int dy = abs(a.y - b.y);
+    if (win->wrap) {
+        dx = std::min(dx, (int) win->map->width - dx);
+        dy = std::min(dy, (int) win->map->height - dy);
+    }
+    return dx + dy;
+}
+
+/**
+ * Returns the first step of the shortest path between two points using a
+ * bounded A* search, or DIR_NONE if no path is found.  The first step is
+ * limited to validDirs so that objects next to the creature are avoided.
+ */
+Direction pathfind_toTarget(const Map* map, const Creature* mover,
+                            const Coords& from, const Coords& to,
+                            int validDirs) {
+    static PathWindow win;
+    static uint16_t gcost[PATH_CELLS];
+    static uint8_t firstDir[PATH_CELLS];
+    std::vector<PathNode> open;
+    PathNode node, next;
+    Coords pos, npos;
+    int pass;
+    int d, si, gi, expanded;
+    bool world = map->isWorldMap();
+
+    if (from.z != to.z)
+        return DIR_NONE;
+
+    window_init(&win, map, from);
+    si = window_index(&win, from);
+    gi = window_index(&win, to);
+    if (si < 0 || gi < 0 || si == gi)
+        return DIR_NONE;
+
+    memset(gcost, 0xff, sizeof(gcost));
+    gcost[si] = 0;
+    firstDir[si] = DIR_NONE;
+
+    node.g   = 0;
+    node.f   = pathDistance(&win, from, to);
+    node.idx = si;
+    open.push_back(node);
+
+    for (expanded = 0; ! open.empty() && expanded < PATH_MAX_NODES; ) {
+        std::pop_heap(open.begin(), open.end());
+        node = open.back();
+        open.pop_back();
+
+        if (node.g > gcost[node.idx])
+            continue;               // Superseded by a cheaper path.
+        if (node.idx == gi)
+            return (Direction) firstDir[gi];
+        ++expanded;
+
+        pos = window_coords(&win, node.idx);
+        pass = window_pass(&win, node.idx, pos);
+
+        for (d = DIR_WEST; d <= DIR_SOUTH; ++d) {
+            if (node.idx == si && ! DIR_IN_MASK(d, validDirs))
+                continue;
+            npos = pos;
+            next.idx = window_step(&win, npos, (Direction) d);
+            if (next.idx < 0)
+                continue;
+            next.g = node.g + 1;
+            if (next.g >= gcost[next.idx])
+                continue;
+
+            // The first step has already been checked by the caller and
+            // the target is occupied, so its terrain does not matter.
+            if (node.idx != si && next.idx != gi &&
+                ! map_creatureCanEnter(mover, pass,
+                                       window_pass(&win, next.idx, npos),
+                                       (Direction) d, world))
+                continue;
+
+            gcost[next.idx] = next.g;
+            firstDir[next.idx] = (node.idx == si) ? d : firstDir[node.idx];
+            next.f = next.g + pathDistance(&win, npos, to);
+            open.push_back(next);
+            std::push_heap(open.begin(), open.end());
+        }
+    }
+
+    return DIR_NONE;
+}
@@ -0,0 +1,22 @@
+/*
+ * pathfind.h
+ */
+
+#ifndef PATHFIND_H
+#define PATHFIND_H
+
+#include "coords.h"
+#include "direction.h"
+
+class Creature;
+class Map;
+
+void      pathfind_resetFields();
+Direction pathfind_toAvatar(const Map* map, const Creature* mover,
+                            const Coords& from, const Coords& avatar,
+                            int validDirs);
+Direction pathfind_toTarget(const Map* map, const Creature* mover,
+                            const Coords& from, const Coords& to,
+                            int validDirs);
+
+#endif
@@ -10,6 +10,13 @@
 #include "screen.h"
 #include "xu4.h"
 
+extern bool verbose;
+
+// Chebyshev distance from the party at which portal maps are prefetched.
+#define PREFETCH_RANGE  8
+
+static PortalStats pstats = { 0, 0 };
+
 /**
  * Creates a dungeon ladder portal based on the action given
  */
@@ -69,6 +76,7 @@ int usePortalAt(Location *location, const Coords& coords, PortalTriggerAction ac
         return 1;
     }
 
+    bool resident = xu4.config->mapResident(portal->destid);
     destination = xu4.config->map(portal->destid);
 
     if (! portal->message) {
@@ -129,6 +137,14 @@ int usePortalAt(Location *location, const Coords& coords, PortalTriggerAction ac
     else if (portal->destid == location->map->id)
         location->coords = portal->start;
     else {
+        ++pstats.transitions;
+        if (resident)
+            ++pstats.resident;
+        if (verbose)
+            printf("portal to map %d: %s (%u of %u resident)\n",
+                   portal->destid, resident ? "resident" : "loaded",
+                   pstats.resident, pstats.transitions);
+
         xu4.game->setMap(destination, portal->saveLocation, portal);
         musicPlayLocale();
     }
@@ -148,3 +164,42 @@ int usePortalAt(Location *location, const Coords& coords, PortalTriggerAction ac
 
     return 1;
 }
+
+/**
+ * Loads the destination map of the nearest portal the party is approaching
+ * so that entering it does not wait on the map loader.  At most one map is
+ * loaded per call to spread the work over several turns.
+ *
+ * The map file is read on a worker thread and the map is parsed here on a
+ * later turn once the read is done.  Nothing is prefetched if it would
+ * unload other maps to stay within the mapMemoryLimit.
+ */
+void portalPrefetch(const Location *location) {
+    const Map *map = location->map;
+    const Portal *nearest = NULL;
+    int nearestDist = PREFETCH_RANGE + 1;
+    int dist;
+
+    PortalList::const_iterator it;
+    for (it = map->portals.begin(); it != map->portals.end(); ++it) {
+        const Portal *p = *it;
+        if (p->exitPortal || p->destid == map->id ||
+            p->coords.z != location->coords.z)
+            continue;
+        dist = map_distance(p->coords, location->coords, map);
+        if (dist < nearestDist && ! xu4.config->mapResident(p->destid)) {
+            nearest = p;
+            nearestDist = dist;
+        }
+    }
+
+    if (nearest && xu4.config->prefetchMap(nearest->destid)) {
+        if (verbose)
+            printf("portal prefetch map %d\n", nearest->destid);
+        xu4.config->map(nearest->destid);
+    }
+}
+
+const PortalStats* portalStats() {
+    return &pstats;
+}
@@ -39,7 +39,14 @@ struct Portal {
     bool exitPortal;
 };
 
+struct PortalStats {
+    uint32_t transitions;   // Portals taken to another map.
+    uint32_t resident;      // Destination map was already loaded.
+};
+
 void createDngLadder(Location *location, PortalTriggerAction action, Portal *p);
 int usePortalAt(Location *location, const Coords& coords, PortalTriggerAction action);
+void portalPrefetch(const Location *location);
+const PortalStats* portalStats();
 
 #endif
@@ -4,6 +4,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include "rle.h"
 
@@ -57,8 +58,8 @@ long rleDecompressMemory(void *in, long inlen, void **out) {
 /**
  * Determine the uncompressed size of RLE compressed data.
  */
-long rleGetDecompressedSize(unsigned char *indata, long inlen) {
-    unsigned char *p;
+long rleGetDecompressedSize(const unsigned char *indata, long inlen) {
+    const unsigned char *p;
     unsigned char ch, count;
     long len = 0;
 
@@ -77,29 +78,33 @@ long rleGetDecompressedSize(unsigned char *indata, long inlen) {
 }
 
 /**
- * Decompress a block of RLE encoded memory.
+ * Decompress a block of RLE encoded memory.  Decoding stops when outlen
+ * bytes have been written, so if the decompressed size is already known
+ * this can be called directly without rleGetDecompressedSize().
  */
-long rleDecompress(unsigned char *indata, long inlen, unsigned char *outdata, long outlen) {
-    int i;
-    unsigned char *p, *q;
-    unsigned char ch, count, val;
+long rleDecompress(const unsigned char *indata, long inlen, unsigned char *outdata, long outlen) {
+    const unsigned char *p, *end;
+    unsigned char *q, *qend;
+    unsigned char ch;
+    long count;
 
     p = indata;
+    end = indata + inlen;
     q = outdata;
-    while ((p - indata) < inlen) {
+    qend = outdata + outlen;
+    while (p < end && q < qend) {
         ch = *p++;
         if (ch == RLE_RUNSTART) {
-            count = *p++;
-            val = *p++;
-            for (i = 0; i < count; i++) {
-                *q++ = val;
-                if ((q - outdata) >= outlen)
-                    break;
-            }
+            if (end - p < 2)
+                break;
+            count = p[0];
+            if (count > qend - q)
+                count = qend - q;
+            memset(q, p[1], count);
+            q += count;
+            p += 2;
         } else {
             *q++ = ch;
-            if ((q - outdata) >= outlen)
-                break;
         }
     }
 
@@ -13,8 +13,8 @@ extern "C" {
 
 long rleDecompressFile(FILE *in, long inlen, void **out);
 long rleDecompressMemory(void *in, long inlen, void **out);
-long rleGetDecompressedSize(unsigned char *indata, long inlen);
-long rleDecompress(unsigned char *indata, long inlen, unsigned char *outdata, long outlen);
+long rleGetDecompressedSize(const unsigned char *indata, long inlen);
+long rleDecompress(const unsigned char *indata, long inlen, unsigned char *outdata, long outlen);
 
 #ifdef __cplusplus
 }
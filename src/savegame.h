@@ -260,6 +260,8 @@ struct UltimaSaveIds {
 
     //uint8_t ultimaBaseId(TileId tid) const { return ultimaIdTable[tid]; }
     MapTile moduleId(uint8_t uid) const;
+    // Return the base TileId of all 256 Ultima ids, indexed by uid.
+    const TileId* moduleIdLUT() const { return moduleIdTable; }
     uint8_t ultimaId(const MapTile& tile) const;
 
     TileId  dngMapToModule(uint8_t u4DngId) const;
@@ -2,304 +2,443 @@
  * $Id$
  */
 
+#include <cstring>
 #include "debug.h"
 #include "image.h"
 #include "screen.h"
 #include "scale.h"
 
-/**
- * A simple row and column duplicating scaler.
- */
-Image *scalePoint(Image *src, int scale, int n) {
-    int x, y, i, j;
-    Image *dest;
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
-    dest = Image::create(src->width() * scale, src->height() * scale);
-    if (!dest)
-        return NULL;
-
-    for (y = 0; y < src->height(); y++) {
-        for (x = 0; x < src->width(); x++) {
-            for (i = 0; i < scale; i++) {
-                for (j = 0; j < scale; j++) {
-                    unsigned int index;
-                    src->getPixelIndex(x, y, index);
-                    dest->putPixelIndex(x * scale + j, y * scale + i, index);
-                }
-            }
-        }
-    }
+/*
+ * The scalers work directly on the 32-bit pixels.  Colors are only ever
+ * compared for equality or averaged channel by channel, so the byte order
+ * of the RGBA components does not matter.
+ */
 
-    return dest;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define ALPHA_MASK  0x000000ff
+#else
+#define ALPHA_MASK  0xff000000
+#endif
+
+#define colorAverage(A,B)   (((A) & (B)) + ((((A) ^ (B)) & 0xfefefefe) >> 1))
+
+static inline uint32_t colorAverage4(uint32_t a, uint32_t b,
+                                     uint32_t c, uint32_t d) {
+    uint32_t lo = (a & 0x03030303) + (b & 0x03030303) +
+                  (c & 0x03030303) + (d & 0x03030303);
+    uint32_t hi = ((a & 0xfcfcfcfc) >> 2) + ((b & 0xfcfcfcfc) >> 2) +
+                  ((c & 0xfcfcfcfc) >> 2) + ((d & 0xfcfcfcfc) >> 2);
+    return hi + ((lo >> 2) & 0x03030303);
 }
 
-/**
- * A scaler that interpolates each intervening pixel from it's two
- * neighbors.
+/*
+ * A row function writes the scale destination rows for a single source row.
+ * The rows array holds the source row above, the row itself, and the two
+ * rows below it.  These are clamped to the image (or tile) edges so that
+ * the row functions need only check the horizontal bounds.
  */
-Image *scale2xBilinear(Image *src, int scale, int n) {
-    int i, x, y, xoff, yoff;
-    RGBA a, b, c, d;
-    Image *dest;
+typedef void (*ScaleRowFunc)(uint32_t* dst, int pitch,
+                             const uint32_t* const* rows, int w, int scale);
 
-    /* this scaler works only with images scaled by 2x */
-    ASSERT(scale == 2, "invalid scale: %d", scale);
+/*
+ * Run a row function over each of the n tiles stacked vertically in src.
+ * The row above the top of a tile is taken from the preceding tile, but
+ * the rows below the bottom are clamped to the tile.
+ */
+static Image *scaleRows(const Image *src, int scale, int n,
+                        ScaleRowFunc func) {
+    const uint32_t* rows[4];
+    Image *dest;
+    int i, y, yEnd;
+    int w = src->w;
+    int tileH = src->h / n;
 
-    dest = Image::create(src->width() * scale, src->height() * scale);
-    if (!dest)
-        return NULL;
-
-    /*
-     * Each pixel in the source image is translated into four in the
-     * destination.  The destination pixels are dependant on the pixel
-     * itself, and the three surrounding pixels (A is the original
-     * pixel):
-     * A B
-     * C D
-     * The four destination pixels mapping to A are calculated as
-     * follows:
-     * [   A   ] [  (A+B)/2  ]
-     * [(A+C)/2] [(A+B+C+D)/4]
-     */
+    dest = Image::create(src->w * scale, src->h * scale);
+    if (!dest || !dest->pixels)
+        return dest;
 
     for (i = 0; i < n; i++) {
-        for (y = (src->height() / n) * i; y < (src->height() / n) * (i + 1); y++) {
-            if (y == (src->height() / n) * (i + 1) - 1)
-                yoff = 0;
-            else
-                yoff = 1;
-
-            for (x = 0; x < src->width(); x++) {
-                if (x == src->width() - 1)
-                    xoff = 0;
-                else
-                    xoff = 1;
+        y = tileH * i;
+        yEnd = y + tileH;
+        for (; y < yEnd; y++) {
+            rows[1] = src->pixels + y * w;
+            rows[0] = y ? rows[1] - w : rows[1];
+            rows[2] = (y + 1 < yEnd) ? rows[1] + w : rows[1];
+            rows[3] = (y + 2 < yEnd) ? rows[2] + w : rows[2];
+            func(dest->pixels + y * scale * dest->w, dest->w, rows, w, scale);
+        }
+    }
 
-                src->getPixel(x, y, a);
-                src->getPixel(x + xoff, y, b);
-                src->getPixel(x, y + yoff, c);
-                src->getPixel(x + xoff, y + yoff, d);
+    return dest;
+}
 
-                dest->putPixel(x * 2, y * 2, a.r, a.g, a.b, a.a);
-                dest->putPixel(x * 2 + 1, y * 2, (a.r + b.r) >> 1, (a.g + b.g) >> 1, (a.b + b.b) >> 1, (a.a + b.a) >> 1);
-                dest->putPixel(x * 2, y * 2 + 1, (a.r + c.r) >> 1, (a.g + c.g) >> 1, (a.b + c.b) >> 1, (a.a + c.a) >> 1);
-                dest->putPixel(x * 2 + 1, y * 2 + 1, (a.r + b.r + c.r + d.r) >> 2, (a.g + b.g + c.g + d.g) >> 2, (a.b + b.b + c.b + d.b) >> 2, (a.a + b.a + c.a + d.a) >> 2);
-            }
+static void pointRow(uint32_t* dst, int pitch, const uint32_t* const* rows,
+                     int w, int scale) {
+    const uint32_t* sp = rows[1];
+    uint32_t* dp = dst;
+    uint32_t* dend;
+    int x, i;
+
+    if (scale == 2) {
+        for (x = 0; x < w; x++) {
+            dp[0] = dp[1] = sp[x];
+            dp += 2;
+        }
+    } else {
+        for (x = 0; x < w; x++) {
+            for (dend = dp + scale; dp != dend; ++dp)
+                *dp = sp[x];
         }
     }
 
-    return dest;
+    for (i = 1; i < scale; i++)
+        memcpy(dst + pitch * i, dst, pitch * sizeof(uint32_t));
+}
+
+/**
+ * A simple row and column duplicating scaler.
+ */
+Image *scalePoint(Image *src, int scale, int n) {
+    return scaleRows(src, scale, 1, pointRow);
 }
 
-int colorEqual(RGBA a, RGBA b) {
-    return
-        a.r == b.r &&
-        a.g == b.g &&
-        a.b == b.b &&
-        a.a == b.a;
+/*
+ * Each pixel in the source image is translated into four in the
+ * destination.  The destination pixels are dependant on the pixel
+ * itself, and the three surrounding pixels (A is the original
+ * pixel):
+ * A B
+ * C D
+ * The four destination pixels mapping to A are calculated as
+ * follows:
+ * [   A   ] [  (A+B)/2  ]
+ * [(A+C)/2] [(A+B+C+D)/4]
+ */
+static void bilinearRow(uint32_t* dst, int pitch, const uint32_t* const* rows,
+                        int w, int scale) {
+    const uint32_t* sp = rows[1];
+    const uint32_t* sp2 = rows[2];
+    uint32_t* dp  = dst;
+    uint32_t* dp2 = dst + pitch;
+    uint32_t a, b, c, d;
+    int x = 0;
+
+#ifdef __SSE2__
+    // Four pixels at a time while the pixels to the right are in the row.
+    // The channels are summed as 16-bit values; pixels 0 & 1 in the low
+    // half and pixels 2 & 3 in the high half.
+    {
+    __m128i zero = _mm_setzero_si128();
+    __m128i A, B, C, D, ab, ac, abcd;
+    __m128i aL, bL, cL, dL, aH, bH, cH, dH;
+    __m128i abL, abH, acL, acH;
+
+    for (; x + 4 < w; x += 4) {
+        A = _mm_loadu_si128((const __m128i*) (sp + x));
+        B = _mm_loadu_si128((const __m128i*) (sp + x + 1));
+        C = _mm_loadu_si128((const __m128i*) (sp2 + x));
+        D = _mm_loadu_si128((const __m128i*) (sp2 + x + 1));
+
+        aL = _mm_unpacklo_epi8(A, zero);
+        bL = _mm_unpacklo_epi8(B, zero);
+        cL = _mm_unpacklo_epi8(C, zero);
+        dL = _mm_unpacklo_epi8(D, zero);
+        aH = _mm_unpackhi_epi8(A, zero);
+        bH = _mm_unpackhi_epi8(B, zero);
+        cH = _mm_unpackhi_epi8(C, zero);
+        dH = _mm_unpackhi_epi8(D, zero);
+
+        abL = _mm_add_epi16(aL, bL);
+        abH = _mm_add_epi16(aH, bH);
+        acL = _mm_add_epi16(aL, cL);
+        acH = _mm_add_epi16(aH, cH);
+
+        abcd = _mm_packus_epi16(
+                _mm_srli_epi16(_mm_add_epi16(abL, _mm_add_epi16(cL, dL)), 2),
+                _mm_srli_epi16(_mm_add_epi16(abH, _mm_add_epi16(cH, dH)), 2));
+        ab = _mm_packus_epi16(_mm_srli_epi16(abL, 1), _mm_srli_epi16(abH, 1));
+        ac = _mm_packus_epi16(_mm_srli_epi16(acL, 1), _mm_srli_epi16(acH, 1));
+
+        _mm_storeu_si128((__m128i*) dp,        _mm_unpacklo_epi32(A, ab));
+        _mm_storeu_si128((__m128i*) (dp + 4),  _mm_unpackhi_epi32(A, ab));
+        _mm_storeu_si128((__m128i*) dp2,       _mm_unpacklo_epi32(ac, abcd));
+        _mm_storeu_si128((__m128i*) (dp2 + 4), _mm_unpackhi_epi32(ac, abcd));
+        dp  += 8;
+        dp2 += 8;
+    }
+    }
+#endif
+
+    for (; x < w; x++) {
+        a = sp[x];
+        c = sp2[x];
+        if (x == w - 1) {
+            b = a;
+            d = c;
+        } else {
+            b = sp[x + 1];
+            d = sp2[x + 1];
+        }
+        dp[0]  = a;
+        dp[1]  = colorAverage(a, b);
+        dp2[0] = colorAverage(a, c);
+        dp2[1] = colorAverage4(a, b, c, d);
+        dp  += 2;
+        dp2 += 2;
+    }
 }
 
-RGBA colorAverage(RGBA a, RGBA b) {
-    RGBA result;
-    result.r = (a.r + b.r) >> 1;
-    result.g = (a.g + b.g) >> 1;
-    result.b = (a.b + b.b) >> 1;
-    result.a = (a.a + b.a) >> 1;
-    return result;
+/**
+ * A scaler that interpolates each intervening pixel from it's two
+ * neighbors.
+ */
+Image *scale2xBilinear(Image *src, int scale, int n) {
+    /* this scaler works only with images scaled by 2x */
+    ASSERT(scale == 2, "invalid scale: %d", scale);
+
+    return scaleRows(src, scale, n, bilinearRow);
 }
 
-int _2xSaI_GetResult1(RGBA a, RGBA b, RGBA c, RGBA d) {
+static inline int _2xSaI_GetResult1(uint32_t a, uint32_t b,
+                                    uint32_t c, uint32_t d) {
     int x = 0;
     int y = 0;
     int r = 0;
-    if (colorEqual(a, c)) x++; else if (colorEqual(b, c)) y++;
-    if (colorEqual(a, d)) x++; else if (colorEqual(b, d)) y++;
+    if (a == c) x++; else if (b == c) y++;
+    if (a == d) x++; else if (b == d) y++;
     if (x <= 1) r++;
     if (y <= 1) r--;
     return r;
 }
 
-int _2xSaI_GetResult2(RGBA a, RGBA b, RGBA c, RGBA d) {
+static inline int _2xSaI_GetResult2(uint32_t a, uint32_t b,
+                                    uint32_t c, uint32_t d) {
     int x = 0;
     int y = 0;
     int r = 0;
-    if (colorEqual(a, c)) x++; else if (colorEqual(b, c)) y++;
-    if (colorEqual(a, d)) x++; else if (colorEqual(b, d)) y++;
+    if (a == c) x++; else if (b == c) y++;
+    if (a == d) x++; else if (b == d) y++;
     if (x <= 1) r--;
     if (y <= 1) r++;
     return r;
 }
 
-/**
- * A more sophisticated scaler that interpolates each new pixel the
- * surrounding pixels.
+/*
+ * Each pixel in the source image is translated into four in the
+ * destination.  The destination pixels are dependant on the pixel
+ * itself, and the surrounding pixels as shown below (A is the
+ * original pixel):
+ * I E F J
+ * G A B K
+ * H C D L
+ * M N O P
  */
-Image *scale2xSaI(Image *src, int scale, int N) {
-    int ii, x, y, xoff0, xoff1, xoff2, yoff0, yoff1, yoff2;
-    RGBA a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p;
-    RGBA prod0, prod1, prod2;
-    Image *dest;
+static void saiRow(uint32_t* dst, int pitch, const uint32_t* const* rows,
+                   int w, int scale) {
+    const uint32_t* r0 = rows[0];
+    const uint32_t* r1 = rows[1];
+    const uint32_t* r2 = rows[2];
+    const uint32_t* r3 = rows[3];
+    uint32_t* dp  = dst;
+    uint32_t* dp2 = dst + pitch;
+    uint32_t a, b, c, d, e, f, g, h, i, j, k, l, m, n, o;
+    uint32_t prod0, prod1, prod2;
+    int x, xl, xr, xr2;
+
+    for (x = 0; x < w; x++) {
+        xl  = x ? x - 1 : 0;
+        xr  = (x + 1 < w) ? x + 1 : x;
+        xr2 = (x + 2 < w) ? x + 2 : xr;
+
+        a = r1[x];
+        b = r1[xr];
+        c = r2[x];
+        d = r2[xr];
+
+        e = r0[x];
+        f = r0[xr];
+        g = r1[xl];
+        h = r2[xl];
+
+        i = r0[xl];
+        j = r0[xr2];
+        k = r1[xl];
+        l = r2[xl];
+
+        m = r3[xl];
+        n = r3[x];
+        o = r3[xr];
+
+        if (a == d && b != c) {
+            if ((a == e && b == l) ||
+                (a == c && a == f && b != e && b == j))
+                prod0 = a;
+            else
+                prod0 = colorAverage(a, b);
 
-    /* this scaler works only with images scaled by 2x */
-    ASSERT(scale == 2, "invalid scale: %d", scale);
+            if ((a == g && c == o) ||
+                (a == b && a == h && g != c && c == m))
+                prod1 = a;
+            else
+                prod1 = colorAverage(a, c);
 
-    dest = Image::create(src->width() * scale, src->height() * scale);
-    if (!dest)
-        return NULL;
-
-    /*
-     * Each pixel in the source image is translated into four in the
-     * destination.  The destination pixels are dependant on the pixel
-     * itself, and the surrounding pixels as shown below (A is the
-     * original pixel):
-     * I E F J
-     * G A B K
-     * H C D L
-     * M N O P
-     */
-
-    for (ii = 0; ii < N; ii++) {
-        for (y = (src->height() / N) * ii; y < (src->height() / N) * (ii + 1); y++) {
-            if (y == 0)
-                yoff0 = 0;
+            prod2 = a;
+        }
+        else if (b == c && a != d) {
+            if ((b == f && a == h) ||
+                (b == e && b == d && a != f && a == i))
+                prod0 = b;
             else
-                yoff0 = -1;
-            if (y == (src->height() / N) * (ii + 1) - 1) {
-                yoff1 = 0;
-                yoff2 = 0;
-            }
-            else if (y == (src->height() / N) * (ii + 1) - 2) {
-                yoff1 = 1;
-                yoff2 = 1;
-            }
-            else {
-                yoff1 = 1;
-                yoff2 = 2;
-            }
+                prod0 = colorAverage(a, b);
 
+            if ((c == h && a == f) ||
+                (c == g && c == d && a != h && a == i))
+                prod1 = c;
+            else
+                prod1 = colorAverage(a, c);
 
-            for (x = 0; x < src->width(); x++) {
-                if (x == 0)
-                    xoff0 = 0;
-                else
-                    xoff0 = -1;
-                if (x == src->width() - 1) {
-                    xoff1 = 0;
-                    xoff2 = 0;
-                }
-                else if (x == src->width() - 2) {
-                    xoff1 = 1;
-                    xoff2 = 1;
-                }
-                else {
-                    xoff1 = 1;
-                    xoff2 = 2;
-                }
-
-                src->getPixel(x, y, a);
-                src->getPixel(x + xoff1, y, b);
-                src->getPixel(x, y + yoff1, c);
-                src->getPixel(x + xoff1, y + yoff1, d);
-
-                src->getPixel(x, y + yoff0, e);
-                src->getPixel(x + xoff1, y + yoff0, f);
-                src->getPixel(x + xoff0, y, g);
-                src->getPixel(x + xoff0, y + yoff1, h);
-
-                src->getPixel(x + xoff0, y + yoff0, i);
-                src->getPixel(x + xoff2, y + yoff0, j);
-                src->getPixel(x + xoff0, y, k);
-                src->getPixel(x + xoff0, y + yoff1, l);
-
-                src->getPixel(x + xoff0, y + yoff2, m);
-                src->getPixel(x, y + yoff2, n);
-                src->getPixel(x + xoff1, y + yoff2, o);
-                src->getPixel(x + xoff2, y + yoff2, p);
-
-                if (colorEqual(a, d) && !colorEqual(b, c)) {
-                    if ((colorEqual(a, e) && colorEqual(b, l)) ||
-                        (colorEqual(a, c) && colorEqual(a, f) && !colorEqual(b, e) && colorEqual(b, j)))
-                        prod0 = a;
-                    else
-                        prod0 = colorAverage(a, b);
-
-                    if ((colorEqual(a, g) && colorEqual(c, o)) ||
-                        (colorEqual(a, b) && colorEqual(a, h) && !colorEqual(g, c) && colorEqual(c, m)))
-                        prod1 = a;
-                    else
-                        prod1 = colorAverage(a, c);
+            prod2 = b;
+        }
+        else if (a == d && b == c) {
+            if (a == b)
+                prod0 = prod1 = prod2 = a;
+            else {
+                int r = 0;
+                prod0 = colorAverage(a, b);
+                prod1 = colorAverage(a, c);
 
-                    prod2 = a;
-                }
-                else if (colorEqual(b, c) && !colorEqual(a, d)) {
-                    if ((colorEqual(b, f) && colorEqual(a, h)) ||
-                        (colorEqual(b, e) && colorEqual(b, d) && !colorEqual(a, f) && colorEqual(a, i)))
-                        prod0 = b;
-                    else
-                        prod0 = colorAverage(a, b);
-
-                    if ((colorEqual(c, h) && colorEqual(a, f)) ||
-                        (colorEqual(c, g) && colorEqual(c, d) && !colorEqual(a, h) && colorEqual(a, i)))
-                        prod1 = c;
-                    else
-                        prod1 = colorAverage(a, c);
+                r += _2xSaI_GetResult1(a, b, g, e);
+                r += _2xSaI_GetResult2(b, a, k, f);
+                r += _2xSaI_GetResult2(b, a, h, n);
+                r += _2xSaI_GetResult1(a, b, l, o);
 
+                if (r > 0)
+                    prod2 = a;
+                else if (r < 0)
                     prod2 = b;
-                }
-                else if (colorEqual(a, d) && colorEqual(b, c)) {
-                    if (colorEqual(a, b))
-                        prod0 = prod1 = prod2 = a;
-                    else {
-                        int r = 0;
-                        prod0 = colorAverage(a, b);
-                        prod1 = colorAverage(a, c);
-
-                        r += _2xSaI_GetResult1(a, b, g, e);
-                        r += _2xSaI_GetResult2(b, a, k, f);
-                        r += _2xSaI_GetResult2(b, a, h, n);
-                        r += _2xSaI_GetResult1(a, b, l, o);
-
-                        if (r > 0)
-                            prod2 = a;
-                        else if (r < 0)
-                            prod2 = b;
-                        else {
-                            prod2.r = (a.r + b.r + c.r + d.r) >> 2;
-                            prod2.g = (a.g + b.g + c.g + d.g) >> 2;
-                            prod2.b = (a.b + b.b + c.b + d.b) >> 2;
-                        }
-                    }
-                }
-                else {
-                    if (colorEqual(a, c) && colorEqual(a, f) && !colorEqual(b, e) && colorEqual(b, j))
-                        prod0 = a;
-                    else if (colorEqual(b, e) && colorEqual(b, d) && !colorEqual(a, f) && colorEqual(a, i))
-                        prod0 = b;
-                    else
-                        prod0 = colorAverage(a, b);
-
-                    if (colorEqual(a, b) && colorEqual(a, h) && !colorEqual(g, c) && colorEqual(c, m))
-                        prod1 = a;
-                    else if (colorEqual(c, g) && colorEqual(c, d) && !colorEqual(a, h) && colorEqual(a, i))
-                        prod1 = c;
-                    else
-                        prod1 = colorAverage(a, c);
-
-                    prod2.r = (a.r + b.r + c.r + d.r) >> 2;
-                    prod2.g = (a.g + b.g + c.g + d.g) >> 2;
-                    prod2.b = (a.b + b.b + c.b + d.b) >> 2;
-                    prod2.a = 255;
-                }
-
-                dest->putPixel((x << 1), (y << 1), a.r, a.g, a.b, a.a);
-                dest->putPixel((x << 1) + 1, (y << 1), prod0.r, prod0.g, prod0.b, prod0.a);
-                dest->putPixel((x << 1), (y << 1) + 1, prod1.r, prod1.g, prod1.b, prod1.a);
-                dest->putPixel((x << 1) + 1, (y << 1) + 1, prod2.r, prod2.g, prod2.b, prod2.a);
+                else
+                    prod2 = colorAverage4(a, b, c, d);
             }
         }
+        else {
+            if (a == c && a == f && b != e && b == j)
+                prod0 = a;
+            else if (b == e && b == d && a != f && a == i)
+                prod0 = b;
+            else
+                prod0 = colorAverage(a, b);
+
+            if (a == b && a == h && g != c && c == m)
+                prod1 = a;
+            else if (c == g && c == d && a != h && a == i)
+                prod1 = c;
+            else
+                prod1 = colorAverage(a, c);
+
+            prod2 = colorAverage4(a, b, c, d) | ALPHA_MASK;
+        }
+
+        dp[0]  = a;
+        dp[1]  = prod0;
+        dp2[0] = prod1;
+        dp2[1] = prod2;
+        dp  += 2;
+        dp2 += 2;
     }
+}
 
-    return dest;
+/**
+ * A more sophisticated scaler that interpolates each new pixel the
+ * surrounding pixels.
+ */
+Image *scale2xSaI(Image *src, int scale, int N) {
+    /* this scaler works only with images scaled by 2x */
+    ASSERT(scale == 2, "invalid scale: %d", scale);
+
+    return scaleRows(src, scale, N, saiRow);
+}
+
+/*
+ * Each pixel in the source image is translated into four (or
+ * nine) in the destination.  The destination pixels are dependant
+ * on the pixel itself, and the eight surrounding pixels (E is the
+ * original pixel):
+ *
+ * A B C
+ * D E F
+ * G H I
+ */
+static void scale2xRow(uint32_t* dst, int pitch, const uint32_t* const* rows,
+                       int w, int scale) {
+    const uint32_t* r0 = rows[0];
+    const uint32_t* r1 = rows[1];
+    const uint32_t* r2 = rows[2];
+    uint32_t* dp  = dst;
+    uint32_t* dp2 = dst + pitch;
+    uint32_t* dp3 = dp2 + pitch;
+    uint32_t a, b, c, d, e, f, g, h, i;
+    uint32_t e0, e1, e2, e3;
+    uint32_t e4, e5, e6, e7;
+    int x, xl, xr;
+
+    for (x = 0; x < w; x++) {
+        xl = x ? x - 1 : 0;
+        xr = (x + 1 < w) ? x + 1 : x;
+
+        a = r0[xl];
+        b = r0[x];
+        c = r0[xr];
+
+        d = r1[xl];
+        e = r1[x];
+        f = r1[xr];
+
+        g = r2[xl];
+        h = r2[x];
+        i = r2[xr];
+
+        // lissen diagonals (45,135,225,315)
+        // corner : if there is gradient towards a diagonal direction,
+        // take the color of surrounding points in this direction
+        e0 = (d == b && b != f && d != h) ? d : e;
+        e1 = (b == f && b != d && f != h) ? f : e;
+        e2 = (d == h && d != b && h != f) ? d : e;
+        e3 = (h == f && d != h && b != f) ? f : e;
+
+        if (scale == 2) {
+            dp[0]  = e0;
+            dp[1]  = e1;
+            dp2[0] = e2;
+            dp2[1] = e3;
+            dp  += 2;
+            dp2 += 2;
+        } else {
+            // lissen eight more directions (22 or 67, 112 or 157...)
+            // middle of side : if there is a gradient towards one of these directions (middle of side direction and of direction of either diagonal around this side),
+            // take the color of surrounding points in this direction
+            e4 = (e0 == c) ? e0 : (e1 == a) ? e1 : e;
+            e5 = (e2 == a) ? e2 : (e0 == g) ? e0 : e;
+            e6 = (e1 == i) ? e1 : (e3 == c) ? e3 : e;
+            e7 = (e3 == g) ? e3 : (e2 == i) ? e2 : e;
+
+            dp[0]  = e0;
+            dp[1]  = e4;
+            dp[2]  = e1;
+            dp2[0] = e5;
+            dp2[1] = e;
+            dp2[2] = e6;
+            dp3[0] = e2;
+            dp3[1] = e7;
+            dp3[2] = e3;
+            dp  += 3;
+            dp2 += 3;
+            dp3 += 3;
+        }
+    }
 }
 
 /**
@@ -307,101 +446,10 @@ Image *scale2xSaI(Image *src, int scale, int N) {
  * the stair step effect by detecting angles.
  */
 Image *scaleScale2x(Image *src, int scale, int n) {
-    int ii, x, y, xoff0, xoff1, yoff0, yoff1;
-    RGBA a, b, c, d, e, f, g, h, i;
-    RGBA e0, e1, e2, e3;
-    RGBA e4, e5, e6, e7;
-    Image *dest;
-
     /* this scaler works only with images scaled by 2x or 3x */
     ASSERT(scale == 2 || scale == 3, "invalid scale: %d", scale);
 
-    dest = Image::create(src->width() * scale, src->height() * scale);
-    if (!dest)
-        return NULL;
-
-    /*
-     * Each pixel in the source image is translated into four (or
-     * nine) in the destination.  The destination pixels are dependant
-     * on the pixel itself, and the eight surrounding pixels (E is the
-     * original pixel):
-     *
-     * A B C
-     * D E F
-     * G H I
-     */
-
-    for (ii = 0; ii < n; ii++) {
-        for (y = (src->height() / n) * ii; y < (src->height() / n) * (ii + 1); y++) {
-            if (y == 0)
-                yoff0 = 0;
-            else
-                yoff0 = -1;
-            if (y == (src->height() / n) * (ii + 1) - 1)
-                yoff1 = 0;
-            else
-                yoff1 = 1;
-
-            for (x = 0; x < src->width(); x++) {
-                if (x == 0)
-                    xoff0 = 0;
-                else
-                    xoff0 = -1;
-                if (x == src->width() - 1)
-                    xoff1 = 0;
-                else
-                    xoff1 = 1;
-
-                src->getPixel(x + xoff0, y + yoff0, a);
-                src->getPixel(x, y + yoff0, b);
-                src->getPixel(x + xoff1, y + yoff0, c);
-
-                src->getPixel(x + xoff0, y, d);
-                src->getPixel(x, y, e);
-                src->getPixel(x + xoff1, y, f);
-
-                src->getPixel(x + xoff0, y + yoff1, g);
-                src->getPixel(x, y + yoff1, h);
-                src->getPixel(x + xoff1, y + yoff1, i);
-
-                // lissen diagonals (45,135,225,315)
-                // corner : if there is gradient towards a diagonal direction,
-                // take the color of surrounding points in this direction
-                e0 = colorEqual(d, b) && (!colorEqual(b, f)) && (!colorEqual(d, h)) ? d : e;
-                e1 = colorEqual(b, f) && (!colorEqual(b, d)) && (!colorEqual(f, h)) ? f : e;
-                e2 = colorEqual(d, h) && (!colorEqual(d, b)) && (!colorEqual(h, f)) ? d : e;
-                e3 = colorEqual(h, f) && (!colorEqual(d, h)) && (!colorEqual(b, f)) ? f : e;
-
-                // lissen eight more directions (22 or 67, 112 or 157...)
-                // middle of side : if there is a gradient towards one of these directions (middle of side direction and of direction of either diagonal around this side),
-                // take the color of surrounding points in this direction
-                e4 = colorEqual(e0, c) ? e0 : colorEqual(e1, a) ? e1 : e;
-                e5 = colorEqual(e2, a) ? e2 : colorEqual(e0, g) ? e0 : e;
-                e6 = colorEqual(e1, i) ? e1 : colorEqual(e3, c) ? e3 : e;
-                e7 = colorEqual(e3, g) ? e3 : colorEqual(e2, i) ? e2 : e;
-
-                if (scale == 2) {
-                    dest->putPixel(x * 2, y * 2, e0.r, e0.g, e0.b, e0.a);
-                    dest->putPixel(x * 2 + 1, y * 2, e1.r, e1.g, e1.b, e1.a);
-                    dest->putPixel(x * 2, y * 2 + 1, e2.r, e2.g, e2.b, e2.a);
-                    dest->putPixel(x * 2 + 1, y * 2 + 1, e3.r, e3.g, e3.b, e3.a);
-                } else if (scale == 3) {
-                    dest->putPixel(x * 3, y * 3, e0.r, e0.g, e0.b, e0.a);
-                    dest->putPixel(x * 3 + 1, y * 3, e4.r, e4.g, e4.b, e4.a);
-                    dest->putPixel(x * 3 + 2, y * 3, e1.r, e1.g, e1.b, e1.a);
-                    dest->putPixel(x * 3, y * 3 + 1, e5.r, e5.g, e5.b, e5.a);
-                    dest->putPixel(x * 3 + 1, y * 3 + 1, e.r, e.g, e.b, e.a);
-                    dest->putPixel(x * 3 + 2, y * 3 + 1, e6.r, e6.g, e6.b, e6.a);
-                    dest->putPixel(x * 3, y * 3 + 2, e2.r, e2.g, e2.b, e2.a);
-                    dest->putPixel(x * 3 + 1, y * 3 + 2, e7.r, e7.g, e7.b, e7.a);
-                    dest->putPixel(x * 3 + 2, y * 3 + 2, e3.r, e3.g, e3.b, e3.a);
-
-                }
-            }
-        }
-    }
-
-    return dest;
+    return scaleRows(src, scale, n, scale2xRow);
 }
 
 Scaler scalerGet(int filter) {
@@ -424,3 +472,58 @@ Scaler scalerGet(int filter) {
 int scaler3x(int filter) {
     return filter == ScreenFilter_Scale2x;
 }
+
+#ifdef DEBUG
+#include <cstdio>
+
+extern uint64_t getMicroTicks();
+
+/*
+ * Time each scaler at each scale it supports on an image shaped like the
+ * tileset and print the average time of each.
+ */
+void scalerBenchmark(int rounds) {
+    static const char* filterName[] = { "point", "2xBi", "2xSaI", "Scale2x" };
+    static const uint32_t colors[4] = {
+        0xff000000, 0xffffffff, 0xff20a040, 0xff4060c0
+    };
+    const int tileDim = 16;
+    const int tiles = 256;
+    Image* src = Image::create(tileDim, tileDim * tiles);
+    Image* dst;
+    uint32_t* pix = src->pixels;
+    uint32_t* end = pix + src->w * src->h;
+    uint32_t seed = 1;
+    uint64_t start, total;
+    int filter, scale, i;
+
+    // Runs of a few colors give the edge detecting scalers both matching
+    // and differing neighbours, as real tiles do.
+    while (pix != end) {
+        seed = seed * 1103515245 + 12345;
+        uint32_t col = colors[(seed >> 16) & 3];
+        for (i = (seed >> 24) & 7; i >= 0 && pix != end; --i)
+            *pix++ = col;
+    }
+
+    printf("filter   scale   ms\n");
+    for (filter = ScreenFilter_point; filter <= ScreenFilter_Scale2x; ++filter) {
+        for (scale = 2; scale <= 3; ++scale) {
+            if (scale == 3 && filter != ScreenFilter_point &&
+                ! scaler3x(filter))
+                continue;
+            Scaler scaler = scalerGet(filter);
+            total = 0;
+            for (i = 0; i < rounds; ++i) {
+                start = getMicroTicks();
+                dst = scaler(src, scale, tiles);
+                total += getMicroTicks() - start;
+                delete dst;
+            }
+            printf("%-7s  %5d  %8.3f\n", filterName[filter], scale,
+                   double(total) * 0.001 / rounds);
+        }
+    }
+    delete src;
+}
+#endif
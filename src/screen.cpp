@@ -24,6 +24,7 @@
 #include "tileanim.h"
 #include "tileset.h"
 #include "xu4.h"
+#include "support/profiler.h"
 
 #ifdef USE_GL
 #include "gpu.h"
@@ -55,6 +56,10 @@ struct Screen {
     int cursorEnabled;
     short needPrompt;
     short colorFG;
+    bool showProfile;
+#ifdef USE_GL
+    Image32Dirty screenDirty;   // Region of screenImage to upload.
+#endif
 #ifdef GPU_RENDER
     ImageInfo* textureInfo;
     TileView* renderMapView;
@@ -62,11 +67,12 @@ struct Screen {
     int mapId;          // Tracks map changes.
     int blockX;         // Tracks changes to view point.
     int blockY;
+    int travelDir;      // Direction of the last single tile view move.
     BlockingGroups* blockingUpdate;
     BlockingGroups blockingGroups;
 #else
-    uint8_t blockingGrid[VIEWPORT_W * VIEWPORT_H];
-    uint8_t screenLos[VIEWPORT_W * VIEWPORT_H];
+    uint32_t blockingRows[VIEWPORT_H];  // Bit x set if tile is opaque.
+    uint32_t losRows[VIEWPORT_H];       // Bit x set if tile is visible.
 #endif
 
     Screen() {
@@ -86,6 +92,7 @@ struct Screen {
         cursorEnabled = 1;
         needPrompt = 1;
         colorFG = FONT_COLOR_INDEX(FG_WHITE);
+        showProfile = false;
 #ifdef GPU_RENDER
         textureInfo = NULL;
         renderMapView = NULL;
@@ -105,6 +112,7 @@ static void screenFindLineOfSight();
 static const int BufferSize = 1024;
 
 extern bool verbose;
+extern uint64_t getMicroTicks();
 
 // Just extern the system functions here. That way people aren't tempted to call them as part of the public API.
 extern void screenInit_sys(const Settings*, int* dim, int reset);
@@ -136,10 +144,15 @@ static void initDungeonTileChars(std::map<string, int>& dungeonTileChars) {
 }
 
 static void screenInit_data(Screen* scr, Settings& settings) {
+    uint64_t phase[4];
+
+    phase[0] = getMicroTicks();
 #ifdef GPU_RENDER
     scr->mapId = -1;
     scr->blockX = scr->blockY = -1;
+    scr->travelDir = DIR_NONE;
     scr->blockingUpdate = NULL;
+    scr->blockingGroups.vw = 0;
 #endif
 
     scr->filterScaler = scalerGet(settings.filter);
@@ -154,6 +167,8 @@ static void screenInit_data(Screen* scr, Settings& settings) {
     xu4.screenImage = Image::create
 #ifdef USE_GL
         (320, 200);
+    xu4.screenImage->dirty = &scr->screenDirty;
+    scr->screenDirty.count = 0;
 #else
         (320 * settings.scale, 200 * settings.scale);
 #endif
@@ -161,6 +176,16 @@ static void screenInit_data(Screen* scr, Settings& settings) {
 
     xu4.imageMgr = new ImageMgr;
 
+#ifdef GPU_RENDER
+    {
+    // Decode the images needed right away in parallel.
+    Symbol names[3];
+    names[0] = BKGD_CHARSET;
+    xu4.config->internSymbols(names + 1, 2, "texture material");
+    xu4.imageMgr->preload(names, 3);
+    }
+#endif
+
     scr->charsetInfo = xu4.imageMgr->get(BKGD_CHARSET);
     if (! scr->charsetInfo)
         errorLoadImage(BKGD_CHARSET);
@@ -187,6 +212,7 @@ static void screenInit_data(Screen* scr, Settings& settings) {
     }
     }
 #endif
+    phase[1] = getMicroTicks();
 
     assert(scr->state.tileanims == NULL);
     scr->state.tileanims = xu4.config->newTileAnims(settings.videoType.c_str());
@@ -204,8 +230,16 @@ static void screenInit_data(Screen* scr, Settings& settings) {
     initDungeonTileChars(scr->dungeonTileChars);
     if (scr->dungeonView)
         scr->dungeonView->cacheGraphicData();
+    phase[2] = getMicroTicks();
 
     Tileset::loadImages();
+    phase[3] = getMicroTicks();
+
+    if (verbose)
+        printf("screen data: images %.2f ms, layouts %.2f ms, tiles %.2f ms\n",
+               double(phase[1] - phase[0]) * 0.001,
+               double(phase[2] - phase[1]) * 0.001,
+               double(phase[3] - phase[2]) * 0.001);
 }
 
 static void screenDelete_data(Screen* scr) {
@@ -249,8 +283,13 @@ void screenDelete() {
  * Re-initializes the screen and implements any changes made in settings
  */
 void screenReInit() {
+    uint64_t start = getMicroTicks();
     screenDelete_data(xu4.screen);
     screenInit_sys(xu4.settings, &xu4.screen->dispWidth, SYS_RESET);
+    xu4.eventHandler->setFrameSync(screenFrameSync());
+    if (verbose)
+        printf("screen reset: display %.2f ms\n",
+               double(getMicroTicks() - start) * 0.001);
     screenInit_data(xu4.screen, *xu4.settings); // Load new backgrounds, etc.
 }
 
@@ -433,7 +472,10 @@ static void screenLoadLayoutsFromConf(Screen* scr) {
         errorFatal("no dungeon gem layout found!\n");
 }
 
-vector<MapTile> screenViewportTile(unsigned int width, unsigned int height, int x, int y, bool &focus) {
+/*
+ * Set tiles to the stack at a viewport position.
+ */
+void screenViewportTile(TileStack& tiles, unsigned int width, unsigned int height, int x, int y, bool &focus) {
     Map* map = c->location->map;
     Coords center = c->location->coords;
     static MapTile grass = map->tileset->getByName(Tile::sym.grass)->getId();
@@ -452,17 +494,16 @@ vector<MapTile> screenViewportTile(unsigned int width, unsigned int height, int
     /* Wrap the location if we can */
     map_wrap(tc, map);
 
+    tiles.clear();
+
     /* off the edge of the map: pad with grass tiles */
     if (MAP_IS_OOB(map, tc)) {
         focus = false;
-        vector<MapTile> result;
-        result.push_back(grass);
-        return result;
+        tiles.push_back(grass);
+        return;
     }
 
-    vector<MapTile> tiles;
     c->location->getTilesAt(tiles, tc, focus);
-    return tiles;
 }
 
 /*
@@ -491,13 +532,13 @@ bool screenTileUpdate(TileView *view, const Coords &coords)
 #else
     // Draw if it is on screen
     if (x >= 0 && y >= 0 && x < VIEWPORT_W && y < VIEWPORT_H &&
-        xu4.screen->screenLos[y*VIEWPORT_W + x])
+        ((xu4.screen->losRows[y] >> x) & 1))
     {
         // Get the tiles
         bool focus;
         Coords mc(coords);
         map_wrap(mc, loc->map);
-        vector<MapTile> tiles;
+        TileStack tiles;
         loc->getTilesAt(tiles, mc, focus);
 
         view->drawTile(tiles, x, y);
@@ -543,6 +584,17 @@ void screenDisableMap() {
     xu4.screen->renderMapView = NULL;
 }
 
+/*
+ * Update the map geometry of a single tile changed by Map::setTileAt().
+ */
+void screenMapTileChanged(const Map* map, const Coords& pos) {
+    Screen* sp = xu4.screen;
+    if (sp && sp->mapId == map->id && pos.z == 0) {
+        gpu_updateMapTile(xu4.gpu, pos.x, pos.y);
+        sp->blockingGroups.vw = 0;  // Occluders may have changed.
+    }
+}
+
 /*
  * \param center    Center of view.
  */
@@ -553,23 +605,61 @@ void screenUpdateMap(TileView* view, const Map* map, const Coords& center) {
 
     // Reset map rendering data when the location changes.
     if (sp->mapId != map->id) {
+        if (verbose && sp->mapId >= 0) {
+            const GpuChunkStats* cs = gpu_chunkStats(xu4.gpu);
+            const GpuStreamStats* ss = gpu_streamStats(xu4.gpu);
+            printf("map %d chunks: %u hits, %u misses, %u prefetched,"
+                   " %u evicted\n", sp->mapId, cs->hits, cs->misses,
+                   cs->prefetched, cs->evicted);
+            printf("map %d draw lists: %u mapped, %u without stall,"
+                   " %u waited\n", sp->mapId, ss->maps, ss->unsynced,
+                   ss->waits);
+        }
         sp->mapId = map->id;
         sp->blockX = -1;
+        sp->blockingGroups.vw = 0;
+        sp->travelDir = DIR_NONE;
         gpu_resetMap(xu4.gpu, map);
     }
 
     // Update the map render position & remake the blocking groups if
-    // the view has moved.
-    if (sp->blockX != center.x || sp->blockY != center.y) {
+    // the view has moved or a tile has changed.
+    if (sp->blockX != center.x || sp->blockY != center.y ||
+        sp->blockingGroups.vw == 0) {
+        int dx = center.x - sp->blockX;
+        int dy = center.y - sp->blockY;
+
+        // Note the travel direction so the renderer can prefetch chunks.
+        // A step across the edge of a wrapping map is also detected.
+        if (sp->blockX < 0)
+            sp->travelDir = DIR_NONE;
+        else if (dy == 0 && (dx == 1 || dx == 1 - map->width))
+            sp->travelDir = DIR_EAST;
+        else if (dy == 0 && (dx == -1 || dx == map->width - 1))
+            sp->travelDir = DIR_WEST;
+        else if (dx == 0 && (dy == 1 || dy == 1 - map->height))
+            sp->travelDir = DIR_SOUTH;
+        else if (dx == 0 && (dy == -1 || dy == map->height - 1))
+            sp->travelDir = DIR_NORTH;
+        else
+            sp->travelDir = DIR_NONE;
+
         sp->blockX = center.x;
         sp->blockY = center.y;
 
         if ((map->flags & NO_LINE_OF_SIGHT) == 0) {
+            static int warnedMapId = -1;
             BlockingGroups* blocks = &sp->blockingGroups;
-            map->queryBlocking(blocks,
-                               center.x - view->columns / 2,
-                               center.y - view->rows / 2,
-                               view->columns, view->rows);
+            if (! map->queryBlocking(blocks,
+                                     center.x - view->columns / 2,
+                                     center.y - view->rows / 2,
+                                     view->columns, view->rows) &&
+                warnedMapId != map->id) {
+                warnedMapId = map->id;
+                fprintf(stderr, "Map %d view has more than %d occluders;"
+                        " some shadows are missing\n", map->id,
+                        BLOCKING_SHAPES_MAX);
+            }
             sp->blockingUpdate = blocks;
             //printf("KR groups %d,%d,%d\n",
             //       blocks->left, blocks->center, blocks->right);
@@ -607,6 +697,7 @@ void screenUpdateMap(TileView* view, const Map* map, const Coords& center) {
  */
 void screenUpdate(TileView *view, bool showmap, bool blackout) {
     ASSERT(c != NULL, "context has not yet been initialized");
+    PROF_ZONE("screenUpdate");
 
     if (blackout)
     {
@@ -627,31 +718,36 @@ void screenUpdate(TileView *view, bool showmap, bool blackout) {
         screenUpdateMap(view, c->location->map, c->location->coords);
 #else
         MapTile black = c->location->map->tileset->getByName(Tile::sym.black)->getId();
-        vector<MapTile> viewTiles[VIEWPORT_W][VIEWPORT_H];
-        uint8_t* blocked = xu4.screen->blockingGrid;
+        TileStack viewTiles[VIEWPORT_W][VIEWPORT_H];
+        uint32_t* blocked = xu4.screen->blockingRows;
+        uint32_t rowBits;
         bool focus;
         int focusX, focusY;
         int x, y;
 
         focusX = -1;
         for (y = 0; y < VIEWPORT_H; y++) {
+            rowBits = 0;
             for (x = 0; x < VIEWPORT_W; x++) {
-                viewTiles[x][y] = screenViewportTile(VIEWPORT_W, VIEWPORT_H,
-                                                     x, y, focus);
-                *blocked++ = viewTiles[x][y].front().getTileType()->isOpaque();
+                screenViewportTile(viewTiles[x][y], VIEWPORT_W, VIEWPORT_H,
+                                   x, y, focus);
+                if (viewTiles[x][y].front().getTileType()->isOpaque())
+                    rowBits |= 1u << x;
                 if (focus) {
                     focusX = x;
                     focusY = y;
                 }
             }
+            blocked[y] = rowBits;
         }
 
         screenFindLineOfSight();
 
-        const uint8_t* lineOfSight = xu4.screen->screenLos;
+        const uint32_t* lineOfSight = xu4.screen->losRows;
         for (y = 0; y < VIEWPORT_H; y++) {
+            rowBits = lineOfSight[y];
             for (x = 0; x < VIEWPORT_W; x++) {
-                if (*lineOfSight++)
+                if ((rowBits >> x) & 1)
                     view->drawTile(viewTiles[x][y], x, y);
                 else
                     view->drawTile(black, x, y);
@@ -671,15 +767,29 @@ void screenUpdate(TileView *view, bool showmap, bool blackout) {
 
 #ifdef USE_GL
 /**
- * Transfer the contents of the screenImage to the GPU.
+ * Transfer the changed regions of the screenImage to the GPU.
+ * If most of the image has changed then it is all sent at once.
  * This function will be removed after GPU rendering is fully implemented.
  */
 void screenUploadToGPU() {
-    gpu_blitTexture(gpu_screenTexture(xu4.gpu), 0, 0, xu4.screenImage);
+    Image* img = xu4.screenImage;
+    Image32Dirty* dirty = img->dirty;
+    uint32_t tex = gpu_screenTexture(xu4.gpu);
+
+    if (image32_dirtyArea(img) > img->w * img->h / 2) {
+        gpu_blitTexture(tex, 0, 0, img);
+    } else {
+        for (int i = 0; i < dirty->count; ++i) {
+            const uint16_t* r = dirty->rect[i];
+            gpu_blitTextureRect(tex, img, r[0], r[1], r[2] - r[0], r[3] - r[1]);
+        }
+    }
+    dirty->count = dirty->full = 0;
 }
 
 void screenRender() {
     static const float colorBlack[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+    PROF_ZONE("render");
     Screen* sp = xu4.screen;
     void* gpu = xu4.gpu;
     int offsetX = (sp->dispWidth  - sp->aspectW) / 2;
@@ -699,12 +809,14 @@ void screenRender() {
             gpu_setScissor(view->scissor);
 
         gpu_drawMap(gpu, view, sp->textureInfo->tileTexCoord,
-                    sp->blockingUpdate, sp->blockX, sp->blockY, view->scale);
+                    sp->blockingUpdate, sp->blockX, sp->blockY, view->scale,
+                    sp->travelDir);
         sp->blockingUpdate = NULL;
 
         gpu_drawTris(gpu, TRIS_MAP_OBJ);
 
-        anim_advance(&xu4.eventHandler->fxAnim, 1.0f / 24.0f);
+        anim_advance(&xu4.eventHandler->fxAnim,
+                     xu4.eventHandler->frameDelta());
         view->updateEffects((float) sp->blockX,
                             (float) sp->blockY,
                             sp->textureInfo->tileTexCoord);
@@ -720,6 +832,46 @@ void screenRender() {
 }
 #endif
 
+/**
+ * Show the timing of the last frame in the top border if the profile
+ * display is enabled.
+ */
+void screenShowProfile() {
+    char buf[64];
+
+    if (! xu4.screen->showProfile)
+        return;
+
+    prof_summary(buf, sizeof(buf));
+    screenTextAt(0, 0, "%-40.40s", buf);
+    screenUploadToGPU();
+}
+
+/**
+ * Turn the frame timing display on or off.  When turned off the top border
+ * is restored.
+ *
+ * \return true if the timing display is now shown.
+ */
+bool screenToggleProfile() {
+    Screen* scr = xu4.screen;
+
+    scr->showProfile = ! scr->showProfile;
+    prof_enable(scr->showProfile);
+
+    if (! scr->showProfile && c && c->location) {
+        ImageInfo* info = xu4.imageMgr->get(BKGD_BORDERS);
+        if (info) {
+            SCALED_VAR
+            info->image->drawSubRect(0, 0, 0, 0, info->image->width(),
+                                     SCALED(CHAR_HEIGHT));
+        }
+        screenUpdateMoons();
+        screenUploadToGPU();
+    }
+    return scr->showProfile;
+}
+
 void screenDrawImageInMapArea(Symbol name) {
     ImageInfo *info;
 
@@ -904,79 +1056,108 @@ void screenDetectDungeonTraps() {
 }
 
 #ifndef GPU_RENDER
-#define BLOCKING(x,y)   blocking[(y) * VIEWPORT_W + (x)]
-#define LOS(x,y)        lineOfSight[(y) * VIEWPORT_W + (x)]
+/*
+ * Line of sight is computed on bitboards with one word per viewport row.
+ * Bit x of a row word is set when the tile in column x is blocking (or is
+ * visible).
+ */
+#if VIEWPORT_W > 31
+#error "A viewport row must fit in a uint32_t"
+#endif
+
+#define LOS_ROW_MASK    ((1u << VIEWPORT_W) - 1)
+#define LOS_CENTER_BIT  (1u << (VIEWPORT_W / 2))
+
+/*
+ * Return the open cells reached by moving from the seeds toward bit 0.
+ * A cell is reached if it is open and is either a seed or its higher
+ * neighbor has been reached.
+ */
+static inline uint32_t losFillDown(uint32_t seed, uint32_t open) {
+    uint32_t gen = seed & open;
+    gen  |= open & (gen >> 1);
+    open &= open >> 1;
+    gen  |= open & (gen >> 2);
+    open &= open >> 2;
+    gen  |= open & (gen >> 4);
+    open &= open >> 4;
+    gen  |= open & (gen >> 8);
+    open &= open >> 8;
+    gen  |= open & (gen >> 16);
+    return gen;
+}
+
+/*
+ * Return the open cells reached by moving from the seeds toward the
+ * highest bit.
+ */
+static inline uint32_t losFillUp(uint32_t seed, uint32_t open) {
+    uint32_t gen = seed & open;
+    gen  |= open & (gen << 1);
+    open &= open << 1;
+    gen  |= open & (gen << 2);
+    open &= open << 2;
+    gen  |= open & (gen << 4);
+    open &= open << 4;
+    gen  |= open & (gen << 8);
+    open &= open << 8;
+    gen  |= open & (gen << 16);
+    return gen;
+}
+
+/*
+ * Return the visible cells of a row in the DOS algorithm.  Outside the
+ * center column a cell is visible if an open visible neighbor lies toward
+ * the center in the same row, or directly or diagonally toward the center
+ * in the previous row.
+ *
+ * \param pass     Visible and open cells of the previous row.
+ * \param center   LOS_CENTER_BIT if the center cell is visible.
+ * \param open     Open cells of this row.
+ */
+static uint32_t losRowDOS(uint32_t pass, uint32_t center, uint32_t open) {
+    const uint32_t left  = LOS_CENTER_BIT - 1;
+    const uint32_t right = LOS_ROW_MASK & ~(left | LOS_CENTER_BIT);
+    uint32_t seedL = ((pass | (pass >> 1)) & left)  | center;
+    uint32_t seedR = ((pass | (pass << 1)) & right) | center;
+
+    return ((seedL | (losFillDown(seedL, open) >> 1)) & (left | center)) |
+           ((seedR | (losFillUp(seedR, open) << 1)) & (right | center));
+}
 
 /**
  * Finds which tiles in the viewport are visible from the avatars
  * location in the middle. (original DOS algorithm)
+ *
+ * The center row & column are visible up to and including the first
+ * blocking tile.  The rows of each half are then visited moving away from
+ * the center, with each row depending on the one before it.
  */
-static void screenFindLineOfSightDOS(const uint8_t* blocking, uint8_t* lineOfSight) {
-    int x, y;
-    const int halfW = VIEWPORT_W / 2;
+static void screenFindLineOfSightDOS(const uint32_t* blocking,
+                                     uint32_t* lineOfSight) {
     const int halfH = VIEWPORT_H / 2;
+    uint32_t pass;
+    int y;
 
-    LOS(halfW, halfH) = 1;
-
-    for (x = halfW - 1; x >= 0; x--)
-        if (LOS(x + 1, halfH) && ! BLOCKING(x + 1, halfH))
-            LOS(x, halfH) = 1;
-
-    for (x = halfW + 1; x < VIEWPORT_W; x++)
-        if (LOS(x - 1, halfH) && ! BLOCKING(x - 1, halfH))
-            LOS(x, halfH) = 1;
-
-    for (y = halfH - 1; y >= 0; y--)
-        if (LOS(halfW, y + 1) && ! BLOCKING(halfW, y + 1))
-            LOS(halfW, y) = 1;
-
-    for (y = halfH + 1; y < VIEWPORT_H; y++)
-        if (LOS(halfW, y - 1) && ! BLOCKING(halfW, y - 1))
-            LOS(halfW, y) = 1;
+    lineOfSight[halfH] = losRowDOS(0, LOS_CENTER_BIT,
+                                   ~blocking[halfH] & LOS_ROW_MASK);
 
     for (y = halfH - 1; y >= 0; y--) {
-
-        for (x = halfW - 1; x >= 0; x--) {
-            if (LOS(x, y + 1) && ! BLOCKING(x, y + 1))
-                LOS(x, y) = 1;
-            else if (LOS(x + 1, y) && ! BLOCKING(x + 1, y))
-                LOS(x, y) = 1;
-            else if (LOS(x + 1, y + 1) && ! BLOCKING(x + 1, y + 1))
-                LOS(x, y) = 1;
-        }
-
-        for (x = halfW + 1; x < VIEWPORT_W; x++) {
-            if (LOS(x, y + 1) && ! BLOCKING(x, y + 1))
-                LOS(x, y) = 1;
-            else if (LOS(x - 1, y) && ! BLOCKING(x - 1, y))
-                LOS(x, y) = 1;
-            else if (LOS(x - 1, y + 1) && ! BLOCKING(x - 1, y + 1))
-                LOS(x, y) = 1;
-        }
+        pass = lineOfSight[y + 1] & ~blocking[y + 1];
+        lineOfSight[y] = losRowDOS(pass, pass & LOS_CENTER_BIT,
+                                   ~blocking[y] & LOS_ROW_MASK);
     }
 
     for (y = halfH + 1; y < VIEWPORT_H; y++) {
-
-        for (x = halfW - 1; x >= 0; x--) {
-            if (LOS(x, y - 1) && ! BLOCKING(x, y - 1))
-                LOS(x, y) = 1;
-            else if (LOS(x + 1, y) && ! BLOCKING(x + 1, y))
-                LOS(x, y) = 1;
-            else if (LOS(x + 1, y - 1) && ! BLOCKING(x + 1, y - 1))
-                LOS(x, y) = 1;
-        }
-
-        for (x = halfW + 1; x < VIEWPORT_W; x++) {
-            if (LOS(x, y - 1) && ! BLOCKING(x, y - 1))
-                LOS(x, y) = 1;
-            else if (LOS(x - 1, y) && ! BLOCKING(x - 1, y))
-                LOS(x, y) = 1;
-            else if (LOS(x - 1, y - 1) && ! BLOCKING(x - 1, y - 1))
-                LOS(x, y) = 1;
-        }
+        pass = lineOfSight[y - 1] & ~blocking[y - 1];
+        lineOfSight[y] = losRowDOS(pass, pass & LOS_CENTER_BIT,
+                                   ~blocking[y] & LOS_ROW_MASK);
     }
 }
 
+#define BLOCKING(x,y)   blocking[(y) * VIEWPORT_W + (x)]
+#define LOS(x,y)        lineOfSight[(y) * VIEWPORT_W + (x)]
+
 #if 1
 /*
  * bitmasks for LOS shadows
@@ -997,8 +1178,7 @@ static void screenFindLineOfSightDOS(const uint8_t* blocking, uint8_t* lineOfSig
 #define _NV__ 0x84
 
 /**
- * Finds which tiles in the viewport are visible from the avatars
- * location in the middle.
+ * Marks the shadows cast by the blocking tiles in the viewport.
  *
  * A new, more accurate LOS function
  *
@@ -1014,7 +1194,7 @@ static void screenFindLineOfSightDOS(const uint8_t* blocking, uint8_t* lineOfSig
  * viewport width and height are odd values and that the player
  * is always at the center of the screen.
  */
-static void screenFindLineOfSightEnhanced(const uint8_t* blocking, uint8_t* lineOfSight) {
+static void screenCastShadows(const uint8_t* blocking, uint8_t* lineOfSight) {
     /*
      * the shadow rasters for each viewport octant
      *
@@ -1061,8 +1241,7 @@ static void screenFindLineOfSightEnhanced(const uint8_t* blocking, uint8_t* line
 
     /*
      * As each viewport tile is processed, it will store the bitmask for the shadow it casts.
-     * Later, after processing all octants, the entire viewport will be marked visible except
-     * for those tiles that have the __VCH bitmask.
+     * A tile is hidden if all of the __VCH bits are set.
      */
     const int _OCTANTS = 8;
     const int _NUM_RASTERS_COLS = 4;
@@ -1173,17 +1352,88 @@ static void screenFindLineOfSightEnhanced(const uint8_t* blocking, uint8_t* line
             }  // currentRow
         }  // currentCol
     }  // octant
+}
 
-    // go through all tiles on the viewable area and set the appropriate visibility
-    uint8_t* end = lineOfSight + VIEWPORT_W * VIEWPORT_H;
-    while (lineOfSight != end) {
-        // if the shadow flags equal __VCH, hide it, otherwise it's fully visible
-        if ((*lineOfSight & __VCH) == __VCH)
-            *lineOfSight = 0;
-        else
-            *lineOfSight = 1;
-        ++lineOfSight;
+/*
+ * The shadows of each tile are independent, so the V, C & H shadow bits cast
+ * by a single blocking tile at every viewport position are kept as row
+ * masks.  These are generated from the shadow rasters on first use.
+ */
+static uint32_t losShadow[VIEWPORT_W * VIEWPORT_H][3][VIEWPORT_H];
+static uint32_t losCasters[VIEWPORT_H];     // Tiles which cast a shadow.
+static bool losShadowReady = false;
+
+static void screenMakeShadowMasks() {
+    uint8_t blocking[VIEWPORT_W * VIEWPORT_H];
+    uint8_t shadow[VIEWPORT_W * VIEWPORT_H];
+    int i, n, x, y;
+    int cast;
+
+    memset(losShadow, 0, sizeof(losShadow));
+    memset(losCasters, 0, sizeof(losCasters));
+    memset(blocking, 0, sizeof(blocking));
+
+    for (i = 0; i < VIEWPORT_W * VIEWPORT_H; i++) {
+        blocking[i] = 1;
+        memset(shadow, 0, sizeof(shadow));
+        screenCastShadows(blocking, shadow);
+        blocking[i] = 0;
+
+        cast = 0;
+        for (n = 0, y = 0; y < VIEWPORT_H; y++) {
+            for (x = 0; x < VIEWPORT_W; x++, n++) {
+                if (shadow[n] & __V__)
+                    losShadow[i][0][y] |= 1u << x;
+                if (shadow[n] & ___C_)
+                    losShadow[i][1][y] |= 1u << x;
+                if (shadow[n] & ____H)
+                    losShadow[i][2][y] |= 1u << x;
+                cast |= shadow[n];
+            }
+        }
+        if (cast)
+            losCasters[i / VIEWPORT_W] |= 1u << (i % VIEWPORT_W);
     }
+    losShadowReady = true;
+}
+
+/**
+ * Finds which tiles in the viewport are visible from the avatars
+ * location in the middle by merging the shadows of all blocking tiles.
+ */
+static void screenFindLineOfSightEnhanced(const uint32_t* blocking,
+                                          uint32_t* lineOfSight) {
+    uint32_t vert[VIEWPORT_H];
+    uint32_t cent[VIEWPORT_H];
+    uint32_t horz[VIEWPORT_H];
+    uint32_t bits;
+    int x, y, r;
+
+    if (! losShadowReady)
+        screenMakeShadowMasks();
+
+    memset(vert, 0, sizeof(vert));
+    memset(cent, 0, sizeof(cent));
+    memset(horz, 0, sizeof(horz));
+
+    for (y = 0; y < VIEWPORT_H; y++) {
+        bits = blocking[y] & losCasters[y];
+        for (x = 0; bits; x++, bits >>= 1) {
+            if (bits & 1) {
+                const uint32_t (*planes)[VIEWPORT_H] =
+                    losShadow[y * VIEWPORT_W + x];
+                for (r = 0; r < VIEWPORT_H; r++) {
+                    vert[r] |= planes[0][r];
+                    cent[r] |= planes[1][r];
+                    horz[r] |= planes[2][r];
+                }
+            }
+        }
+    }
+
+    // If the shadow flags equal __VCH hide it, otherwise it's fully visible.
+    for (r = 0; r < VIEWPORT_H; r++)
+        lineOfSight[r] = ~(vert[r] & cent[r] & horz[r]) & LOS_ROW_MASK;
 }
 #else
 
@@ -1200,9 +1450,19 @@ typedef struct {
 #define GSC_SET_LIGHT(g,x,y,ds) g->visible[VIEWPORT_W * y + x] = 1
 #include "support/gridShadowCast.c"
 
-static void screenFindLineOfSightEnhanced(const uint8_t* blocking, uint8_t* lineOfSight) {
+static void screenFindLineOfSightEnhanced(const uint32_t* blockingRows,
+                                          uint32_t* losRows) {
+    uint8_t blocking[VIEWPORT_W * VIEWPORT_H];
+    uint8_t lineOfSight[VIEWPORT_W * VIEWPORT_H];
     GridSC grid;
     int viewPos[2];
+    int x, y;
+
+    for (y = 0; y < VIEWPORT_H; y++) {
+        for (x = 0; x < VIEWPORT_W; x++)
+            BLOCKING(x, y) = (blockingRows[y] >> x) & 1;
+    }
+    memset(lineOfSight, 0, sizeof(lineOfSight));
 
     grid.blocking = blocking;
     grid.visible  = lineOfSight;
@@ -1223,6 +1483,14 @@ static void screenFindLineOfSightEnhanced(const uint8_t* blocking, uint8_t* line
         //printf( "KR los %d %f\n", i, grid.visible[i]);
     }
 #endif
+
+    for (y = 0; y < VIEWPORT_H; y++) {
+        losRows[y] = 0;
+        for (x = 0; x < VIEWPORT_W; x++) {
+            if (LOS(x, y))
+                losRows[y] |= 1u << x;
+        }
+    }
 }
 #endif
 
@@ -1232,23 +1500,22 @@ static void screenFindLineOfSightEnhanced(const uint8_t* blocking, uint8_t* line
 /**
  * Finds which tiles in the viewport are visible from the avatars
  * location in the middle.
- * Uses Screen blockingGrid to build screenLos.
+ * Uses Screen blockingRows to build losRows.
  */
 static void screenFindLineOfSight() {
     if (c->location->map->flags & NO_LINE_OF_SIGHT) {
         // The map has the no line of sight flag, all is visible
-        memset(xu4.screen->screenLos, 1, VIEWPORT_W * VIEWPORT_H);
+        for (int y = 0; y < VIEWPORT_H; y++)
+            xu4.screen->losRows[y] = LOS_ROW_MASK;
     } else {
         // otherwise calculate it from the map data
-        memset(xu4.screen->screenLos, 0, VIEWPORT_W * VIEWPORT_H);
-
         CPU_START()
         if (xu4.settings->lineOfSight == 0)
-            screenFindLineOfSightDOS(xu4.screen->blockingGrid,
-                                     xu4.screen->screenLos);
+            screenFindLineOfSightDOS(xu4.screen->blockingRows,
+                                     xu4.screen->losRows);
         else
-            screenFindLineOfSightEnhanced(xu4.screen->blockingGrid,
-                                          xu4.screen->screenLos);
+            screenFindLineOfSightEnhanced(xu4.screen->blockingRows,
+                                          xu4.screen->losRows);
         CPU_END()
     }
 }
@@ -1432,6 +1699,7 @@ static void screenShowGemTile(const Layout *layout, const Map *map,
 }
 
 void screenGemUpdate() {
+    TileStack tiles;
     MapTile tile;
     int x, y;
     const Layout* layout;
@@ -1449,48 +1717,51 @@ void screenGemUpdate() {
         //DO THE SPECIAL DUNGEON MAP TRAVERSAL
         layout = xu4.screen->dungeonGemLayout;
 
-        vector<vector<int> > drawnTiles(layout->viewport.width, vector<int>(layout->viewport.height, 0));
-        vector<std::pair<int,int> > coordStack;
-        vector<MapTile> tiles;
+        // The traversal buffers are kept between calls so that no memory
+        // is allocated once they are large enough.  A cell is marked when
+        // it is pushed so the stack never holds more than every cell.
+        static vector<uint8_t> queued;
+        static vector<int> cellStack;       // Cell index (y * width + x).
+        const int vw = layout->viewport.width;
+        const int vh = layout->viewport.height;
         const Coords& coords = c->location->coords;
+        const TileId avatarTileId =
+            map->tileset->getByName(Tile::sym.avatar)->getId();
+        int cell, nx, ny;
+
+        queued.assign(vw * vh, 0);
+        cellStack.clear();
+        cellStack.reserve(vw * vh);
 
         //Put the avatar's position on the stack
-        int center_x = layout->viewport.width / 2 - 1;
-        int center_y = layout->viewport.height / 2 - 1;
+        int center_x = vw / 2 - 1;
+        int center_y = vh / 2 - 1;
         int avt_x = coords.x - 1;
         int avt_y = coords.y - 1;
 
-        coordStack.push_back(std::pair<int,int>(center_x, center_y));
+        if (center_x >= 0 && center_y >= 0) {
+            cell = center_y * vw + center_x;
+            queued[cell] = 1;
+            cellStack.push_back(cell);
+        }
         bool weAreDrawingTheAvatarTile = true;
 
         //And draw each tile on the growing stack until it is empty
-        while (coordStack.size() > 0) {
-            const std::pair<int,int>& currentXY = coordStack.back();
-            x = currentXY.first;
-            y = currentXY.second;
-            coordStack.pop_back();
-
-            if (x < 0 || x >= layout->viewport.width ||
-                y < 0 || y >= layout->viewport.height)
-                continue;   //Skip out of range tiles
-
-            if (drawnTiles[x][y])
-                continue;   //Skip already considered tiles
-
-            drawnTiles[x][y] = 1;
+        while (! cellStack.empty()) {
+            cell = cellStack.back();
+            cellStack.pop_back();
+            x = cell % vw;
+            y = cell / vw;
 
             // DRAW THE ACTUAL TILE
-            tiles = screenViewportTile(layout->viewport.width,
-                                       layout->viewport.height,
-                                       x - center_x + avt_x,
-                                       y - center_y + avt_y, focus);
+            screenViewportTile(tiles, vw, vh,
+                               x - center_x + avt_x,
+                               y - center_y + avt_y, focus);
             tile = tiles.front();
 
             if (! weAreDrawingTheAvatarTile) {
                 // Hack to avoid showing the avatar tile multiple times in
                 // repeating dungeon maps
-                TileId avatarTileId =
-                    map->tileset->getByName(Tile::sym.avatar)->getId();
                 if (tile.getId() == avatarTileId)
                     tile = map->getTileFromData(coords);
             }
@@ -1503,19 +1774,21 @@ void screenGemUpdate() {
                 // Continue the search so we can see through all walkable
                 // objects, non-opaque objects (like creatures) or the avatar
                 // position in those rare circumstances where he is stuck in a
-                // wall by adding all relative adjacency combinations to the
-                // stack for drawing
-
-                coordStack.push_back(std::pair<int,int>(x + 1,  y - 1));
-                coordStack.push_back(std::pair<int,int>(x + 1,  y    ));
-                coordStack.push_back(std::pair<int,int>(x + 1,  y + 1));
-
-                coordStack.push_back(std::pair<int,int>(x    ,  y - 1));
-                coordStack.push_back(std::pair<int,int>(x    ,  y + 1));
-
-                coordStack.push_back(std::pair<int,int>(x - 1,  y - 1));
-                coordStack.push_back(std::pair<int,int>(x - 1,  y    ));
-                coordStack.push_back(std::pair<int,int>(x - 1,  y + 1));
+                // wall by adding all adjacent tiles to the stack for drawing.
+
+                for (ny = y - 1; ny <= y + 1; ny++) {
+                    if (ny < 0 || ny >= vh)
+                        continue;   //Skip out of range tiles
+                    for (nx = x - 1; nx <= x + 1; nx++) {
+                        if (nx < 0 || nx >= vw)
+                            continue;
+                        cell = ny * vw + nx;
+                        if (! queued[cell]) {
+                            queued[cell] = 1;
+                            cellStack.push_back(cell);
+                        }
+                    }
+                }
 
                 // We only draw the avatar tile once, it is the first tile drawn
                 weAreDrawingTheAvatarTile = false;
@@ -1527,8 +1800,9 @@ void screenGemUpdate() {
 
         for (x = 0; x < layout->viewport.width; x++) {
             for (y = 0; y < layout->viewport.height; y++) {
-                tile = screenViewportTile(layout->viewport.width,
-                                          layout->viewport.height, x, y, focus).front();
+                screenViewportTile(tiles, layout->viewport.width,
+                                   layout->viewport.height, x, y, focus);
+                tile = tiles.front();
                 screenShowGemTile(layout, map, tile, focus, x, y);
             }
         }
@@ -1550,6 +1824,8 @@ void screenGemUpdate() {
  * resulting image.
  */
 Image *screenScale(Image *src, int scale, int n, int filter) {
+    // NOTE: This is called by the ImageMgr worker threads so it must not
+    // use the profiler or modify any shared state.
     Image *dest = NULL;
 
     if (n == 0)
@@ -106,6 +106,9 @@ void screenUploadToGPU();
 #endif
 
 void screenIconify(void);
+int  screenFrameSync(void);
+void screenShowProfile();
+bool screenToggleProfile();
 
 const std::vector<std::string> &screenGetGemLayoutNames();
 const char** screenGetFilterNames();
@@ -131,12 +134,13 @@ bool screenTileUpdate(TileView *view, const Coords &coords);
 #ifdef GPU_RENDER
 void screenDisableMap();
 void screenUpdateMap(TileView* view, const Map* map, const Coords& center);
+void screenMapTileChanged(const Map* map, const Coords& pos);
 #endif
 void screenUpdate(TileView *view, bool showmap, bool blackout);
 void screenUpdateCursor(void);
 void screenUpdateMoons(void);
 void screenUpdateWind(void);
-std::vector<MapTile> screenViewportTile(unsigned int width, unsigned int height, int x, int y, bool &focus);
+void screenViewportTile(TileStack& tiles, unsigned int width, unsigned int height, int x, int y, bool &focus);
 
 void screenShowCursor(void);
 void screenHideCursor(void);
@@ -123,6 +123,18 @@ void screenInit_sys(const Settings* settings, int* dim, int reset) {
     int dw = 320 * settings->scale;
     int dh = 200 * settings->scale;
 
+    if (xu4.headless) {
+        if (! reset) {
+            xu4.screenSys = sa = new ScreenAllegro;
+            memset(sa, 0, sizeof(ScreenAllegro));
+        }
+        dim[0] = dim[2] = dw;
+        dim[1] = dim[3] = dh;
+        SA->refreshRate = 1.0 / settings->screenAnimationFramesPerSecond;
+        SA->frameSync = settings->frameSync;
+        return;
+    }
+
     if (reset) {
         sa = SA;
 
@@ -162,6 +174,11 @@ void screenInit_sys(const Settings* settings, int* dim, int reset) {
 #ifdef USE_GL
     //al_set_new_display_option(ALLEGRO_ALPHA_SIZE, 8, ALLEGRO_REQUIRE);
 #endif
+    // The fixed rate scheduler leaves the swap interval to the driver.
+    if (settings->frameSync == FrameSync_VSync)
+        al_set_new_display_option(ALLEGRO_VSYNC, 1, ALLEGRO_SUGGEST);
+    else if (settings->frameSync == FrameSync_Uncapped)
+        al_set_new_display_option(ALLEGRO_VSYNC, 2, ALLEGRO_SUGGEST);
 
     sa->disp = al_create_display(dw, dh);
     if (! sa->disp) {
@@ -179,6 +196,16 @@ void screenInit_sys(const Settings* settings, int* dim, int reset) {
             goto fatal;
     }
 
+    // ALLEGRO_VSYNC is only a suggestion.  If the buffer swap will not wait
+    // then use the fixed rate scheduler so the main loop does not spin.
+    sa->frameSync = settings->frameSync;
+    if (sa->frameSync == FrameSync_VSync &&
+        al_get_display_option(sa->disp, ALLEGRO_VSYNC) != 1) {
+        if (verbose)
+            printf("vsync unavailable, using fixed frame rate\n");
+        sa->frameSync = FrameSync_Fixed;
+    }
+
 #if defined(_WIN32) && defined(USE_GL)
     {
     uint32_t ver = al_get_opengl_version();
@@ -272,7 +299,8 @@ void screenInit_sys(const Settings* settings, int* dim, int reset) {
     // as the context is lost when mucking with bitmaps.
     al_set_current_opengl_context(sa->disp);
 
-    gpuError = gpu_init(&sa->gpu, dw, dh, settings->scale, settings->filter);
+    gpuError = gpu_init(&sa->gpu, dw, dh, settings->scale, settings->filter,
+                        settings->mapCacheChunks);
     if (gpuError)
         errorFatal("Unable to obtain OpenGL resource (%s)", gpuError);
 #endif
@@ -292,6 +320,12 @@ fatal:
 void screenDelete_sys() {
     ScreenAllegro* sa = SA;
 
+    if (xu4.headless) {
+        delete sa;
+        xu4.screenSys = NULL;
+        return;
+    }
+
 #ifdef USE_GL
     gpu_free(&sa->gpu);
 #endif
@@ -316,6 +350,13 @@ void screenIconify() {
     //SDL_WM_IconifyWindow();
 }
 
+/**
+ * Return the FrameSync mode the display actually supports.
+ */
+int screenFrameSync() {
+    return SA->frameSync;
+}
+
 //extern uint32_t getTicks();
 
 //#define CPU_TEST
@@ -396,6 +437,9 @@ extern void screenRender();
 extern void musicUpdate();
 
 void screenSwapBuffers() {
+    if (xu4.headless)
+        return;
+
     musicUpdate();
 
 #ifdef USE_GL
@@ -423,6 +467,9 @@ void screenWait(int numberOfAnimationFrames) {
 
     assert(numberOfAnimationFrames >= 0);
 
+    if (xu4.headless)
+        return;
+
     screenSwapBuffers();
     al_rest(SA->refreshRate * numberOfAnimationFrames);
 }
@@ -440,6 +487,8 @@ void screenSetMouseCursor(MouseCursor cursor) {
 }
 
 void screenShowMouseCursor(bool visible) {
+    if (xu4.headless)
+        return;
     if (visible)
         al_show_mouse_cursor(SA->disp);
     else
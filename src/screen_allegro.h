@@ -10,6 +10,7 @@ struct ScreenAllegro {
     ALLEGRO_MOUSE_CURSOR* cursors[5];
     double refreshRate;
     int currentCursor;
+    int frameSync;          // FrameSync mode in effect for the display.
 #ifdef USE_GL
     OpenGLResources gpu;
 #endif
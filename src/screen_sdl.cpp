@@ -54,6 +54,17 @@ void u4_SDL_QuitSubSystem(Uint32 flags) {
 void screenInit_sys(const Settings* settings, int* dim, int reset) {
     ScreenSDL* sd;
 
+    if (xu4.headless) {
+        if (! reset) {
+            xu4.screenSys = sd = new ScreenSDL;
+            memset(sd, 0, sizeof(ScreenSDL));
+        }
+        dim[0] = dim[2] = 320 * settings->scale;
+        dim[1] = dim[3] = 200 * settings->scale;
+        SD->frameDuration = 1000 / settings->screenAnimationFramesPerSecond;
+        return;
+    }
+
     if (! reset) {
         /* start SDL */
         if (u4_SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
@@ -128,6 +139,12 @@ void screenInit_sys(const Settings* settings, int* dim, int reset) {
 void screenDelete_sys() {
     ScreenSDL* sd = SD;
 
+    if (xu4.headless) {
+        delete sd;
+        xu4.screenSys = NULL;
+        return;
+    }
+
     SDL_FreeCursor(sd->cursors[1]);
     SDL_FreeCursor(sd->cursors[2]);
     SDL_FreeCursor(sd->cursors[3]);
@@ -146,6 +163,14 @@ void screenIconify() {
     SDL_WM_IconifyWindow();
 }
 
+/**
+ * Return the FrameSync mode the display actually supports.
+ * SDL 1.2 has no control over vsync so the fixed rate is always used.
+ */
+int screenFrameSync() {
+    return FrameSync_Fixed;
+}
+
 #if 0
 void screenDeinterlaceCga(unsigned char *data, int width, int height, int tiles, int fudge) {
     unsigned char *tmp;
@@ -302,12 +327,17 @@ static void updateDisplay( int x, int y, int w, int h ) {
 #include "support/cpuCounter.h"
 
 void screenSwapBuffers() {
+    if (xu4.headless)
+        return;
+
     CPU_START()
     updateDisplay(0, 0, 0, 0);
     CPU_END("ut:")
 }
 
 void screenWait(int numberOfAnimationFrames) {
+    if (xu4.headless)
+        return;
     SDL_Delay(numberOfAnimationFrames * SD->frameDuration);
 }
 
@@ -363,5 +393,7 @@ void screenSetMouseCursor(MouseCursor cursor) {
 }
 
 void screenShowMouseCursor(bool visible) {
+    if (xu4.headless)
+        return;
     SDL_ShowCursor(visible ? SDL_ENABLE : SDL_DISABLE);
 }
@@ -188,6 +188,9 @@ bool Settings::read() {
     shakeInterval         = DEFAULT_SHAKE_INTERVAL;
     titleSpeedRandom      = DEFAULT_TITLE_SPEED_RANDOM;
     titleSpeedOther       = DEFAULT_TITLE_SPEED_OTHER;
+    mapCacheChunks        = DEFAULT_MAP_CACHE_CHUNKS;
+    mapMemoryLimit        = DEFAULT_MAP_MEMORY_LIMIT;
+    frameSync             = DEFAULT_FRAME_SYNC;
 
 #if 0
     pauseForEachMovement  = DEFAULT_PAUSE_FOR_EACH_MOVEMENT;
@@ -204,6 +207,7 @@ bool Settings::read() {
     enhancementsOptions.c64chestTraps    = true;
     enhancementsOptions.smartEnterKey    = true;
     enhancementsOptions.peerShowsObjects = false;
+    enhancementsOptions.smartPathing     = false;
     enhancementsOptions.u5combat         = false;
     enhancementsOptions.u4TileTransparencyHack = true;
     enhancementsOptions.u4TileTransparencyHackPixelShadowOpacity = DEFAULT_SHADOW_PIXEL_OPACITY;
@@ -287,6 +291,15 @@ bool Settings::read() {
             titleSpeedRandom = (int) strtoul(buffer + strlen("titleSpeedRandom="), NULL, 0);
         else if (strstr(buffer, "titleSpeedOther=") == buffer)
             titleSpeedOther = (int) strtoul(buffer + strlen("titleSpeedOther="), NULL, 0);
+        else if (strstr(buffer, "mapMemoryLimit=") == buffer)
+            mapMemoryLimit = (int) strtoul(buffer + strlen("mapMemoryLimit="), NULL, 0);
+        else if (strstr(buffer, "frameSync=") == buffer)
+            frameSync = settingEnum(frameSyncStrings(),
+                                    buffer + strlen("frameSync="));
+#ifdef GPU_RENDER
+        else if (strstr(buffer, "mapCacheChunks=") == buffer)
+            mapCacheChunks = (int) strtoul(buffer + strlen("mapCacheChunks="), NULL, 0);
+#endif
 
         /* minor enhancement options */
         else if (strstr(buffer, "activePlayer=") == buffer)
@@ -309,6 +322,8 @@ bool Settings::read() {
         /* major enhancement options */
         else if (strstr(buffer, "peerShowsObjects=") == buffer)
             enhancementsOptions.peerShowsObjects = (int) strtoul(buffer + strlen("peerShowsObjects="), NULL, 0);
+        else if (strstr(buffer, "smartPathing=") == buffer)
+            enhancementsOptions.smartPathing = (int) strtoul(buffer + strlen("smartPathing="), NULL, 0);
         else if (strstr(buffer, "u5combat=") == buffer)
             enhancementsOptions.u5combat = (int) strtoul(buffer + strlen("u5combat="), NULL, 0);
         else if (strstr(buffer, "innAlwaysCombat=") == buffer)
@@ -399,7 +414,9 @@ bool Settings::write() {
             "shrineTime=%d\n"
             "shakeInterval=%d\n"
             "titleSpeedRandom=%d\n"
-            "titleSpeedOther=%d\n",
+            "titleSpeedOther=%d\n"
+            "mapMemoryLimit=%d\n"
+            "frameSync=%s\n",
             scale,
             fullscreen,
             screenGetFilterNames()[ filter ],
@@ -426,11 +443,16 @@ bool Settings::write() {
             shrineTime,
             shakeInterval,
             titleSpeedRandom,
-            titleSpeedOther);
+            titleSpeedOther,
+            mapMemoryLimit,
+            frameSyncStrings()[ frameSync ]);
 
 #ifndef USE_BORON
     fprintf(settingsFile, "validateXml=%d\n", validateXml);
 #endif
+#ifdef GPU_RENDER
+    fprintf(settingsFile, "mapCacheChunks=%d\n", mapCacheChunks);
+#endif
 
     // Enhancements Options
     fprintf(settingsFile,
@@ -443,6 +465,7 @@ bool Settings::write() {
             "c64chestTraps=%d\n"
             "smartEnterKey=%d\n"
             "peerShowsObjects=%d\n"
+            "smartPathing=%d\n"
             "u5combat=%d\n"
             "innAlwaysCombat=%d\n"
             "campingAlwaysCombat=%d\n"
@@ -461,6 +484,7 @@ bool Settings::write() {
             enhancementsOptions.c64chestTraps,
             enhancementsOptions.smartEnterKey,
             enhancementsOptions.peerShowsObjects,
+            enhancementsOptions.smartPathing,
             enhancementsOptions.u5combat,
             innAlwaysCombat,
             campingAlwaysCombat,
@@ -482,3 +506,8 @@ const char** Settings::battleDiffStrings() {
     static const char* difficulty[] = {"Normal", "Hard", "Expert", NULL};
     return difficulty;
 }
+
+const char** Settings::frameSyncStrings() {
+    static const char* sync[] = {"Fixed", "VSync", "Uncapped", NULL};
+    return sync;
+}
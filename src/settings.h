@@ -68,6 +68,9 @@
 #define DEFAULT_CAMP_TIME               10
 #define DEFAULT_INN_TIME                8
 #define DEFAULT_SHRINE_TIME             16
+#define DEFAULT_MAP_CACHE_CHUNKS        16
+#define DEFAULT_MAP_MEMORY_LIMIT        2048
+#define DEFAULT_FRAME_SYNC              FrameSync_Fixed
 #define DEFAULT_SHAKE_INTERVAL          100
 #define DEFAULT_BATTLE_DIFFICULTY       BattleDiff_Normal
 #define DEFAULT_LOGGING                 ""
@@ -87,6 +90,12 @@ enum BattleDifficulty {
     BattleDiff_Expert
 };
 
+enum FrameSync {
+    FrameSync_Fixed,        // Sleep until the next animation frame is due.
+    FrameSync_VSync,        // Present on each display refresh.
+    FrameSync_Uncapped      // Present as fast as possible.
+};
+
 struct SettingsEnhancementOptions {
     bool activePlayer;
     bool u5spellMixing;
@@ -98,6 +107,7 @@ struct SettingsEnhancementOptions {
     bool c64chestTraps;
     bool smartEnterKey;
     bool peerShowsObjects;
+    bool smartPathing;
     bool u4TileTransparencyHack;
     int  u4TileTransparencyHackPixelShadowOpacity;
     int  u4TrileTransparencyHackShadowBreadth;
@@ -143,9 +153,12 @@ public:
     bool                volumeFades;
     int                 titleSpeedRandom;
     int                 titleSpeedOther;
+    int                 mapCacheChunks; // Map chunk geometry kept on the GPU.
+    int                 mapMemoryLimit; // Kilobytes of loaded maps; 0 = no limit.
     uint8_t             battleDiff;     // Used by Creature
     uint8_t             filter;         // Defined by screen
     uint8_t             lineOfSight;    // Defined by screen
+    uint8_t             frameSync;
 
 #if 0
     //Settings that aren't in file yet
@@ -175,6 +188,7 @@ class Settings : public SettingsData {
 public:
     static uint8_t settingEnum(const char** names, const char* value);
     static const char** battleDiffStrings();
+    static const char** frameSyncStrings();
 
     void init(const char* profileName);
     void setData(const SettingsData &data);
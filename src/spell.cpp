@@ -460,18 +460,16 @@ static int spellDispel(int dir) {
      * annotation to fill in the gap :)
      */
     AnnotationList& annot = loc->map->annotations;
-    AnnotationList a = annot.allAt(fpos);
-    if (a.size() > 0) {
-        AnnotationList::iterator i;
-        for (i = a.begin(); i != a.end(); i++) {
-            tile = i->tile.getTileType();
-            if (tile->canDispel()) {
-                // get a replacement tile for the field
-                MapTile newTile(loc->getReplacementTile(fpos, tile));
-                annot.remove(*i);
-                annot.add(fpos, newTile, false, true);
-                return 1;
-            }
+    Annotation a[ANNOTATIONS_AT_MAX];
+    int count = annot.allAt(fpos, a, ANNOTATIONS_AT_MAX);
+    for (int i = 0; i < count; i++) {
+        tile = a[i].tile.getTileType();
+        if (tile->canDispel()) {
+            // get a replacement tile for the field
+            MapTile newTile(loc->getReplacementTile(fpos, tile));
+            annot.remove(a[i]);
+            annot.add(fpos, newTile, false, true);
+            return 1;
         }
     }
 
@@ -524,13 +522,12 @@ static int spellEField(int param) {
         if (!tile->isWalkable()) return 0;
 
         /* Get rid of old field, if any */
-        AnnotationList a = c->location->map->annotations.allAt(coords);
-        if (a.size() > 0) {
-            AnnotationList::iterator i;
-            for (i = a.begin(); i != a.end(); i++) {
-                if (i->tile.getTileType()->canDispel())
-                    c->location->map->annotations.remove(*i);
-            }
+        Annotation a[ANNOTATIONS_AT_MAX];
+        int count = c->location->map->annotations.allAt(coords, a,
+                                                        ANNOTATIONS_AT_MAX);
+        for (int i = 0; i < count; i++) {
+            if (a[i].tile.getTileType()->canDispel())
+                c->location->map->annotations.remove(a[i]);
         }
 
         MapTile fieldTile;
@@ -3,8 +3,20 @@
 */
 
 #include <stdlib.h>
+#include <string.h>
 #include "cdi.h"
 
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#define HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #if defined(__APPLE__)
 #include <libkern/OSByteOrder.h>
 #define bswap_16(x) OSSwapInt16(x)
@@ -169,3 +181,280 @@ const CDIEntry* cdi_findFormat(const CDIEntry* toc, size_t count, uint32_t cdi)
     }
     return NULL;
 }
+
+/*
+  Read an entire package into a malloc'd buffer.
+*/
+static int cdi_readPak(CDIPak* pak, const char* filename)
+{
+    long size;
+    FILE* fp = fopen(filename, "rb");
+    if (! fp)
+        return 0;
+    if (fseek(fp, 0, SEEK_END) == 0 && (size = ftell(fp)) > 0) {
+        pak->base = (uint8_t*) malloc(size);
+        if (pak->base) {
+            rewind(fp);
+            if (fread(pak->base, 1, size, fp) == (size_t) size) {
+                pak->size = size;
+                pak->mapped = 0;
+                fclose(fp);
+                return 1;
+            }
+            free(pak->base);
+            pak->base = NULL;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/*
+  Make the contents of a CDI package available in memory and read the header.
+
+  The file is memory mapped where the platform supports it so that chunks
+  can be used in place without being copied.  Pages are copy-on-write, so
+  any changes made to chunks are private to the process.  If the file cannot
+  be mapped it is read into memory with stdio.
+
+  \param pak       Return struct for package contents.
+  \param filename  Path to CDI package file.
+  \param phead     Return struct for package header.
+
+  \return Non-zero if successful, in which case the caller must call
+          cdi_unmapPak().  Zero is returned if the file cannot be read or
+          the header is invalid.
+*/
+int cdi_mapPak(CDIPak* pak, const char* filename, CDIEntry* phead)
+{
+    pak->base = NULL;
+    pak->size = 0;
+    pak->mapped = 0;
+
+#if defined(_WIN32)
+    {
+    HANDLE fh, mh;
+    LARGE_INTEGER fsize;
+
+    fh = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                     OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fh != INVALID_HANDLE_VALUE) {
+        if (GetFileSizeEx(fh, &fsize) && fsize.QuadPart > 0) {
+            mh = CreateFileMappingA(fh, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+            if (mh) {
+                pak->base = (uint8_t*) MapViewOfFile(mh, FILE_MAP_COPY,
+                                                     0, 0, 0);
+                CloseHandle(mh);
+                if (pak->base) {
+                    pak->size = (size_t) fsize.QuadPart;
+                    pak->mapped = 1;
+                }
+            }
+        }
+        CloseHandle(fh);
+    }
+    }
+#elif defined(HAVE_MMAP)
+    {
+    struct stat st;
+    void* addr;
+    int fd = open(filename, O_RDONLY);
+    if (fd >= 0) {
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            addr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                        fd, 0);
+            if (addr != MAP_FAILED) {
+                pak->base = (uint8_t*) addr;
+                pak->size = st.st_size;
+                pak->mapped = 1;
+            }
+        }
+        close(fd);
+    }
+    }
+#endif
+
+    if (! pak->base && ! cdi_readPak(pak, filename))
+        return 0;
+
+    if (pak->size < sizeof(CDIEntry))
+        goto fatal;
+    memcpy(phead, pak->base, sizeof(CDIEntry));
+    if (phead->cdi != DA7A_CONTAINER_CDI_PAK)
+        goto fatal;
+#ifdef __BIG_ENDIAN__
+    phead->offset = bswap_32(phead->offset);
+    phead->bytes  = bswap_32(phead->bytes);
+#endif
+    return 1;
+
+fatal:
+    cdi_unmapPak(pak);
+    return 0;
+}
+
+void cdi_unmapPak(CDIPak* pak)
+{
+    if (pak->base) {
+        if (pak->mapped) {
+#if defined(_WIN32)
+            UnmapViewOfFile(pak->base);
+#elif defined(HAVE_MMAP)
+            munmap(pak->base, pak->size);
+#endif
+        } else {
+            free(pak->base);
+        }
+        pak->base = NULL;
+        pak->size = 0;
+    }
+}
+
+/*
+  Get the Table of Contents of a package opened with cdi_mapPak().
+
+  On big endian archetectures the CDIEntry offset and bytes values are
+  swapped in place.
+
+  \return Pointer to CDIEntry array inside the package, or NULL if the
+          table does not lie within the package.
+*/
+CDIEntry* cdi_mapPakTOC(CDIPak* pak, const CDIEntry* header)
+{
+    CDIEntry* toc = (CDIEntry*) cdi_pakChunk(pak, header);
+#ifdef __BIG_ENDIAN__
+    if (toc) {
+        CDIEntry* it  = toc;
+        CDIEntry* end = toc + CDI_TOC_SIZE(header);
+        for (; it != end; ++it) {
+            it->offset = bswap_32(it->offset);
+            it->bytes  = bswap_32(it->bytes);
+        }
+    }
+#endif
+    return toc;
+}
+
+/*
+  \return Pointer to the chunk data inside the package, or NULL if the
+          entry does not lie within the package.
+*/
+uint8_t* cdi_pakChunk(const CDIPak* pak, const CDIEntry* ent)
+{
+    if (ent->offset > pak->size || ent->bytes > pak->size - ent->offset)
+        return NULL;
+    return pak->base + ent->offset;
+}
+
+/*
+  Create a CDI package file.  The chunks are added with cdi_writeChunk()
+  and the table of contents is written by cdi_endPak().
+
+  \param pw         Writer state.
+  \param filename   Path to CDI package file.
+  \param appId      Package application identifier.
+
+  \return Non-zero if successful, in which case the caller must call
+          cdi_endPak().
+*/
+int cdi_beginPak(CDIWriter* pw, const char* filename, uint32_t appId)
+{
+    CDIEntry head;
+
+    pw->toc = NULL;
+    pw->count = pw->avail = 0;
+    pw->offset = sizeof(CDIEntry);
+    pw->failed = 0;
+    pw->fp = fopen(filename, "wb");
+    if (! pw->fp)
+        return 0;
+
+    /* The TOC offset & size are filled in by cdi_endPak(). */
+    head.cdi    = DA7A_CONTAINER_CDI_PAK;
+    head.appId  = appId;
+    head.offset = head.bytes = 0;
+    if (fwrite(&head, sizeof(CDIEntry), 1, pw->fp) != 1) {
+        fclose(pw->fp);
+        pw->fp = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+/*
+  Append a chunk to a package opened with cdi_beginPak().
+  If this fails the package is incomplete and cdi_endPak() will also fail.
+
+  \return Non-zero if successful.
+*/
+int cdi_writeChunk(CDIWriter* pw, uint32_t cdi, uint32_t appId,
+                   const void* data, uint32_t bytes)
+{
+    CDIEntry* ent;
+
+    if (pw->count == pw->avail) {
+        uint32_t avail = pw->avail ? pw->avail * 2 : 32;
+        ent = (CDIEntry*) realloc(pw->toc, avail * sizeof(CDIEntry));
+        if (! ent)
+            goto fail;
+        pw->toc = ent;
+        pw->avail = avail;
+    }
+
+    if (bytes && fwrite(data, 1, bytes, pw->fp) != bytes)
+        goto fail;
+
+    ent = pw->toc + pw->count++;
+    ent->cdi    = cdi;
+    ent->appId  = appId;
+    ent->offset = pw->offset;
+    ent->bytes  = bytes;
+    pw->offset += bytes;
+    return 1;
+
+fail:
+    pw->failed = 1;
+    return 0;
+}
+
+/*
+  Write the table of contents and close a package opened with
+  cdi_beginPak().
+
+  \return Non-zero if the entire package was written successfully.
+*/
+int cdi_endPak(CDIWriter* pw)
+{
+    uint32_t loc[2];
+    uint32_t tocBytes = pw->count * sizeof(CDIEntry);
+    int ok = ! pw->failed;
+
+#ifdef __BIG_ENDIAN__
+    {
+    CDIEntry* it  = pw->toc;
+    CDIEntry* end = pw->toc + pw->count;
+    for (; it != end; ++it) {
+        it->offset = bswap_32(it->offset);
+        it->bytes  = bswap_32(it->bytes);
+    }
+    }
+#endif
+    if (tocBytes && fwrite(pw->toc, 1, tocBytes, pw->fp) != tocBytes)
+        ok = 0;
+
+    loc[0] = pw->offset;
+    loc[1] = tocBytes;
+#ifdef __BIG_ENDIAN__
+    cdi_swap32(loc, 2);
+#endif
+    if (fseek(pw->fp, 8, SEEK_SET) != 0 ||
+        fwrite(loc, sizeof(uint32_t), 2, pw->fp) != 2)
+        ok = 0;
+
+    if (fclose(pw->fp) != 0)
+        ok = 0;
+    pw->fp = NULL;
+    free(pw->toc);
+    pw->toc = NULL;
+    return ok;
+}
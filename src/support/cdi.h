@@ -93,6 +93,23 @@ typedef struct {
     const char* strings;
 } CDIStringTable;
 
+/* CDI package contents held in memory */
+typedef struct {
+    uint8_t* base;
+    size_t size;
+    int mapped;     /* Non-zero if base is a memory mapping of the file. */
+} CDIPak;
+
+/* CDI package being written */
+typedef struct {
+    FILE* fp;
+    CDIEntry* toc;
+    uint32_t count;
+    uint32_t avail;
+    uint32_t offset;    /* File position of the next chunk. */
+    int failed;         /* Set if any cdi_writeChunk() failed. */
+} CDIWriter;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -104,6 +121,16 @@ const CDIEntry* cdi_findAppId(const CDIEntry* toc, size_t count, uint32_t id);
 const CDIEntry* cdi_findFormat(const CDIEntry* toc, size_t count, uint32_t cdi);
 CDIStringTable* cdi_initStringTable(CDIStringTable* table, const uint8_t* buf);
 
+int             cdi_mapPak(CDIPak* pak, const char* filename, CDIEntry* header);
+void            cdi_unmapPak(CDIPak* pak);
+CDIEntry*       cdi_mapPakTOC(CDIPak* pak, const CDIEntry* header);
+uint8_t*        cdi_pakChunk(const CDIPak* pak, const CDIEntry* ent);
+
+int             cdi_beginPak(CDIWriter* pw, const char* filename, uint32_t appId);
+int             cdi_writeChunk(CDIWriter* pw, uint32_t cdi, uint32_t appId,
+                               const void* data, uint32_t bytes);
+int             cdi_endPak(CDIWriter* pw);
+
 void cdi_swap16(uint16_t* vars, size_t count);
 void cdi_swap32(uint32_t* vars, size_t count);
 
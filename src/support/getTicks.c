@@ -7,7 +7,6 @@
 #include <sys/timeb.h>
 #include <windows.h>
 #else
-#include <sys/time.h>
 #include <time.h>
 #endif
 
@@ -24,9 +23,9 @@ uint32_t getTicks()
     now = (uint32_t) (tb.time*1000 + tb.millitm);
 #else
     // Android, Linux, iOS, macOS.
-    struct timeval ts;
-    gettimeofday(&ts, NULL);
-    now = (uint32_t) (ts.tv_sec*1000 + ts.tv_usec/1000);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (uint32_t) (ts.tv_sec*1000 + ts.tv_nsec/1000000);
 #endif
 
     if (getTicks_start)
@@ -35,6 +34,24 @@ uint32_t getTicks()
     return 0;
 }
 
+// Return microseconds elapsed since an arbitrary point in time.
+uint64_t getMicroTicks()
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (uint64_t) (count.QuadPart / freq.QuadPart * 1000000 +
+                       count.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+    // Use the monotonic clock so that frame pacing is unaffected by changes
+    // to the wall clock.
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
 void msecSleep(uint32_t ms)
 {
 #ifdef _WIN32
@@ -46,3 +63,15 @@ void msecSleep(uint32_t ms)
    nanosleep(&stime, 0);
 #endif
 }
+
+void usecSleep(uint32_t usec)
+{
+#ifdef _WIN32
+    Sleep(usec / 1000);
+#else
+   struct timespec stime;
+   stime.tv_sec  = usec / 1000000;
+   stime.tv_nsec = (usec - stime.tv_sec*1000000) * 1000;
+   nanosleep(&stime, 0);
+#endif
+}
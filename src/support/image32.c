@@ -22,6 +22,7 @@
 void image32_init(Image32* img) {
     img->pixels = NULL;
     img->w = img->h = 0;
+    img->dirty = NULL;
 }
 
 /**
@@ -36,6 +37,7 @@ void image32_init(Image32* img) {
 int image32_allocPixels(Image32* img, uint16_t w, uint16_t h)
 {
     int size = w * h * sizeof(uint32_t);
+    img->dirty = NULL;
     img->pixels = (uint32_t*) malloc(size);
     if (img->pixels) {
         img->w = w;
@@ -85,6 +87,9 @@ void image32_fill(Image32* img, const RGBA* color)
 
     while (dp != dend)
         *dp++ = icol;
+
+    if (img->dirty)
+        img->dirty->full = 1;
 }
 
 /**
@@ -110,6 +115,8 @@ void image32_fillRect(Image32* img, int x, int y, int rw, int rh,
     if (rh < 1)
         return;
 
+    image32_markDirty(img, x, y, rw, rh);
+
     while (rh--) {
         dp = drow;
         dend = dp + rw;
@@ -162,6 +169,7 @@ void image32_blit(Image32* dest, int dx, int dy, const Image32* src, int blend)
         return;
 
     drow = dest->pixels + dest->w * dy + dx;
+    image32_markDirty(dest, dx, dy, blitW, blitH);
 
     if (blend) {
         uint8_t* dp;
@@ -241,6 +249,7 @@ void image32_blitRect(Image32* dest, int dx, int dy,
 
     srow = src->pixels + src->w * sy + sx;
     drow = dest->pixels + dest->w * dy + dx;
+    image32_markDirty(dest, dx, dy, sw, sh);
 
     if (blend) {
         uint8_t* dp;
@@ -282,6 +291,103 @@ void image32_blitRect(Image32* dest, int dx, int dy,
     }
 }
 
+#define RECT_AREA(r)    ((r[2] - r[0]) * (r[3] - r[1]))
+
+static void unionRect(uint16_t* a, const uint16_t* b)
+{
+    if (a[0] > b[0]) a[0] = b[0];
+    if (a[1] > b[1]) a[1] = b[1];
+    if (a[2] < b[2]) a[2] = b[2];
+    if (a[3] < b[3]) a[3] = b[3];
+}
+
+/**
+ * Add a rectangle to the changed region of an image.  This does nothing if
+ * the image dirty member is NULL.
+ *
+ * Rectangles which overlap or touch are merged.  When IMAGE32_DIRTY_MAX
+ * rectangles are in use the new one is merged with the rectangle whose area
+ * grows the least.
+ */
+void image32_dirtyRect(Image32* img, int x, int y, int rw, int rh)
+{
+    Image32Dirty* dirty = img->dirty;
+    uint16_t nr[4];
+    uint16_t* it;
+    int i, n;
+
+    if (! dirty || dirty->full)
+        return;
+
+    if (x < 0) { rw += x; x = 0; }
+    if (y < 0) { rh += y; y = 0; }
+    if (x + rw > img->w) rw = img->w - x;
+    if (y + rh > img->h) rh = img->h - y;
+    if (rw < 1 || rh < 1)
+        return;
+
+    nr[0] = x;
+    nr[1] = y;
+    nr[2] = x + rw;
+    nr[3] = y + rh;
+
+merge:
+    n = dirty->count;
+    for (i = 0; i < n; ++i) {
+        it = dirty->rect[i];
+        if (nr[0] <= it[2] && nr[2] >= it[0] &&
+            nr[1] <= it[3] && nr[3] >= it[1]) {
+            // Remove the touching rect and try again with the union.
+            unionRect(nr, it);
+            memcpy(it, dirty->rect[n - 1], sizeof(nr));
+            --dirty->count;
+            goto merge;
+        }
+    }
+
+    if (n == IMAGE32_DIRTY_MAX) {
+        uint16_t tr[4];
+        int growth, least = 0x7fffffff;
+        int best = 0;
+        for (i = 0; i < n; ++i) {
+            it = dirty->rect[i];
+            memcpy(tr, it, sizeof(tr));
+            unionRect(tr, nr);
+            growth = RECT_AREA(tr) - RECT_AREA(it);
+            if (growth < least) {
+                least = growth;
+                best = i;
+            }
+        }
+        unionRect(nr, dirty->rect[best]);
+        memcpy(dirty->rect[best], dirty->rect[n - 1], sizeof(nr));
+        --dirty->count;
+        goto merge;
+    }
+
+    memcpy(dirty->rect[n], nr, sizeof(nr));
+    dirty->count = n + 1;
+}
+
+/**
+ * Return the number of changed pixels tracked by the image dirty region.
+ */
+int image32_dirtyArea(const Image32* img)
+{
+    const Image32Dirty* dirty = img->dirty;
+    int i, area;
+
+    if (! dirty)
+        return 0;
+    if (dirty->full)
+        return img->w * img->h;
+
+    area = 0;
+    for (i = 0; i < dirty->count; ++i)
+        area += RECT_AREA(dirty->rect[i]);
+    return area;
+}
+
 #if 0
 /**
  * Load an image from a PPM file.
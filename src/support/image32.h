@@ -16,11 +16,23 @@ struct RGBA {
 #define rgba_set(S,R,G,B,A)     S.r = R; S.g = G; S.b = B; S.a = A
 #define rgba_setp(S,R,G,B,A)    S->r = R; S->g = G; S->b = B; S->a = A
 
+#define IMAGE32_DIRTY_MAX   8
+
+typedef struct {
+    uint16_t count;                         // Number of rect used.
+    uint16_t full;                          // Entire image is changed.
+    uint16_t rect[IMAGE32_DIRTY_MAX][4];    // x, y, x2, y2 (exclusive).
+} Image32Dirty;
+
 typedef struct {
     uint32_t* pixels;
     uint16_t w, h;
+    Image32Dirty* dirty;    // Changed region tracking (NULL if unused).
 } Image32;
 
+#define image32_markDirty(img,x,y,rw,rh) \
+    do { if ((img)->dirty) image32_dirtyRect(img,x,y,rw,rh); } while (0)
+
 #ifdef __cplusplus
 //extern "C" {
 #endif
@@ -37,6 +49,8 @@ void     image32_blit(Image32* dest, int dx, int dy,
 void     image32_blitRect(Image32* dest, int dx, int dy,
                           const Image32* src, int sx, int sy, int sw, int sh,
                           int blend);
+void     image32_dirtyRect(Image32*, int x, int y, int rw, int rh);
+int      image32_dirtyArea(const Image32*);
 //void     image32_loadPPM(Image32*, const char *filename);
 void     image32_savePPM(const Image32*, const char *filename);
 
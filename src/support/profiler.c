@@ -0,0 +1,312 @@
+/*
+ * profiler.c
+ * Scoped zone timing which keeps the most recent zones in a ring buffer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "profiler.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#define ZONE_RING   8192        // Must be a power of two.
+#define ZONE_MASK   (ZONE_RING - 1)
+#define ZONE_ID_MASK 0x7fffffff // Zone ids are the zoneCount kept positive.
+#define SUMMARY_MAX 6
+
+typedef struct {
+    const char* name;
+    uint64_t start;             // Nanoseconds.
+    uint64_t end;               // Zero while the zone is open.
+    uint32_t frame;
+    uint32_t depth;
+} ProfZone;
+
+typedef struct {
+    ProfZone zones[ZONE_RING];
+    uint32_t zoneCount;         // Total zones begun; indexes the ring.
+    uint32_t frame;
+    uint32_t allocs;            // Heap allocations in the current frame.
+    uint32_t frameAllocs;       // Heap allocations in the last frame.
+    int countAllocs;            // Set once prof_countAlloc() is called.
+    int depth;
+    int enabled;
+    char* traceFile;
+} Profiler;
+
+static Profiler* prof = NULL;
+
+static uint64_t prof_now(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceCounter(&count);
+    QueryPerformanceFrequency(&freq);
+    return (uint64_t) (count.QuadPart / freq.QuadPart * 1000000000 +
+                count.QuadPart % freq.QuadPart * 1000000000 / freq.QuadPart);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static int prof_alloc(void)
+{
+    if (! prof) {
+        prof = (Profiler*) calloc(1, sizeof(Profiler));
+        if (! prof)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Enable the profiler and have prof_free() write a Chrome trace file.
+ */
+void prof_init(const char* traceFile)
+{
+    if (prof_alloc()) {
+        prof->enabled = 1;
+        if (traceFile) {
+            prof->traceFile = (char*) malloc(strlen(traceFile) + 1);
+            if (prof->traceFile)
+                strcpy(prof->traceFile, traceFile);
+        }
+    }
+}
+
+void prof_free(void)
+{
+    if (prof) {
+        if (prof->traceFile) {
+            if (! prof_writeTrace(prof->traceFile))
+                fprintf(stderr, "Cannot write trace %s\n", prof->traceFile);
+            free(prof->traceFile);
+        }
+        free(prof);
+        prof = NULL;
+    }
+}
+
+/*
+ * Start or stop collecting zones.  A trace file requested by prof_init()
+ * keeps collection enabled.
+ */
+void prof_enable(int on)
+{
+    if (on) {
+        if (prof_alloc())
+            prof->enabled = 1;
+    } else if (prof && ! prof->traceFile) {
+        prof->enabled = 0;
+    }
+}
+
+int prof_enabled(void)
+{
+    return prof && prof->enabled;
+}
+
+/*
+ * Begin timing a zone.  Zones may be nested.
+ *
+ * Return zone identifier to pass to prof_end() or -1 if disabled.
+ * The identifier is the zone count rather than the ring slot so that
+ * prof_end() can tell if the slot has since been reused.
+ */
+int prof_begin(const char* name)
+{
+    ProfZone* zone;
+    int id;
+
+    if (! prof || ! prof->enabled)
+        return -1;
+
+    id = prof->zoneCount++ & ZONE_ID_MASK;
+    zone = prof->zones + (id & ZONE_MASK);
+    zone->name  = name;
+    zone->end   = 0;
+    zone->frame = prof->frame;
+    zone->depth = prof->depth++;
+    zone->start = prof_now();
+    return id;
+}
+
+/*
+ * End a zone.  A zone begun more than ZONE_RING zones ago has been
+ * overwritten and is not updated.
+ */
+void prof_end(int id)
+{
+    if (id >= 0 && prof) {
+        uint32_t age = (prof->zoneCount - (uint32_t) id) & ZONE_ID_MASK;
+        if (age && age <= ZONE_RING)
+            prof->zones[id & ZONE_MASK].end = prof_now();
+        if (prof->depth > 0)
+            --prof->depth;
+    }
+}
+
+/*
+ * Mark the end of a display frame.
+ */
+void prof_frame(void)
+{
+    if (prof && prof->enabled) {
+        ++prof->frame;
+        prof->frameAllocs = prof->allocs;
+        prof->allocs = 0;
+    }
+}
+
+/*
+ * Note a heap allocation.  This is called by the operator new replacement
+ * when built with PROF_ALLOCS defined.
+ */
+void prof_countAlloc(void)
+{
+    if (prof) {
+        ++prof->allocs;
+        prof->countAllocs = 1;
+    }
+}
+
+/*
+ * Return the number of heap allocations made during the last frame or -1
+ * if allocations are not being counted.
+ */
+int prof_frameAllocs(void)
+{
+    if (prof && prof->countAllocs)
+        return (int) prof->frameAllocs;
+    return -1;
+}
+
+/*
+ * Print the time of the outermost zones in the last completed frame
+ * followed by the zones directly inside them.  Repeated zones are added
+ * together.
+ *
+ * Return length of string in buf.
+ */
+int prof_summary(char* buf, size_t len)
+{
+    const char* name[SUMMARY_MAX];
+    uint64_t total[SUMMARY_MAX];
+    uint64_t top = 0;
+    const ProfZone* zone;
+    uint32_t frame, i, n, first;
+    uint32_t minDepth = 0xffffffff;
+    int count = 0;
+    int pos;
+
+    buf[0] = '\0';
+    if (! prof || ! prof->frame)
+        return 0;
+
+    // Find the zones of the frame, which are contiguous in the ring.
+    frame = prof->frame - 1;
+    n = (prof->zoneCount < ZONE_RING) ? prof->zoneCount : ZONE_RING;
+    first = prof->zoneCount;
+    for (i = 1; i <= n; ++i) {
+        zone = prof->zones + ((prof->zoneCount - i) & ZONE_MASK);
+        if (zone->frame > frame)
+            continue;
+        if (zone->frame < frame)
+            break;
+        first = prof->zoneCount - i;
+        if (zone->depth < minDepth)
+            minDepth = zone->depth;
+    }
+
+    for (i = first; i != prof->zoneCount; ++i) {
+        zone = prof->zones + (i & ZONE_MASK);
+        if (zone->frame != frame)
+            break;
+        if (! zone->end)
+            continue;
+
+        if (zone->depth == minDepth) {
+            top += zone->end - zone->start;
+        } else if (zone->depth == minDepth + 1) {
+            int j;
+            for (j = 0; j < count; ++j) {
+                if (name[j] == zone->name)
+                    break;
+            }
+            if (j == count) {
+                if (count == SUMMARY_MAX)
+                    continue;
+                name[j] = zone->name;
+                total[j] = 0;
+                ++count;
+            }
+            total[j] += zone->end - zone->start;
+        }
+    }
+
+    pos = snprintf(buf, len, "%.2f", (double) top * 1e-6);
+    for (i = 0; i < (uint32_t) count; ++i) {
+        if (pos < 0 || (size_t) pos >= len)
+            break;
+        pos += snprintf(buf + pos, len - pos, " %s:%.2f", name[i],
+                        (double) total[i] * 1e-6);
+    }
+    if (prof->countAllocs && pos >= 0 && (size_t) pos < len)
+        pos += snprintf(buf + pos, len - pos, " new:%u", prof->frameAllocs);
+    if (pos < 0)
+        pos = 0;
+    else if ((size_t) pos >= len)
+        pos = len - 1;
+    return pos;
+}
+
+/*
+ * Save the zones in the ring buffer as a Chrome trace event JSON file
+ * (viewable with chrome://tracing or Perfetto).
+ *
+ * Return non-zero if successful.
+ */
+int prof_writeTrace(const char* file)
+{
+    const ProfZone* zone;
+    uint32_t i, n, first;
+    uint64_t base;
+    FILE* fp;
+    int sep = 0;
+
+    if (! prof)
+        return 0;
+
+    fp = fopen(file, "w");
+    if (! fp)
+        return 0;
+
+    n = (prof->zoneCount < ZONE_RING) ? prof->zoneCount : ZONE_RING;
+    first = prof->zoneCount - n;
+    base = n ? prof->zones[first & ZONE_MASK].start : 0;
+
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for (i = 0; i < n; ++i) {
+        zone = prof->zones + ((first + i) & ZONE_MASK);
+        if (! zone->end)
+            continue;
+        fprintf(fp, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,"
+                    "\"dur\":%.3f,\"pid\":1,\"tid\":1,"
+                    "\"args\":{\"frame\":%u}}",
+                sep ? ",\n" : "", zone->name,
+                (double) (zone->start - base) * 1e-3,
+                (double) (zone->end - zone->start) * 1e-3,
+                zone->frame);
+        sep = 1;
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(fp);
+    return 1;
+}
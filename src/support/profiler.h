@@ -0,0 +1,42 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+/*
+ * profiler.h
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void prof_init(const char* traceFile);
+void prof_free(void);
+void prof_enable(int on);
+int  prof_enabled(void);
+int  prof_begin(const char* name);
+void prof_end(int zone);
+void prof_frame(void);
+int  prof_summary(char* buf, size_t len);
+void prof_countAlloc(void);
+int  prof_frameAllocs(void);
+int  prof_writeTrace(const char* file);
+
+#ifdef __cplusplus
+}
+
+/*
+ * Times the enclosing scope.  The name must be a string literal (or other
+ * pointer which outlives the profiler).
+ */
+struct ProfileScope {
+    ProfileScope(const char* name) : zone(prof_begin(name)) {}
+    ~ProfileScope() { prof_end(zone); }
+    int zone;
+};
+
+#define PROF_ZONE(name)     ProfileScope profZone_(name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,30 @@
+/*
+ * thread.h
+ * Minimal threading primitives implemented by the platform API.
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+struct Thread;
+struct Mutex;
+struct Cond;
+
+typedef void (*ThreadFunc)(void* arg);
+
+Thread* threadCreate(ThreadFunc func, void* arg);
+void    threadJoin(Thread*);
+
+Mutex*  mutexCreate();
+void    mutexFree(Mutex*);
+void    mutexLock(Mutex*);
+void    mutexUnlock(Mutex*);
+
+Cond*   condCreate();
+void    condFree(Cond*);
+void    condWait(Cond*, Mutex*);
+void    condBroadcast(Cond*);
+
+int     cpuCount();
+
+#endif /* THREAD_H */
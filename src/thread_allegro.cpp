@@ -0,0 +1,80 @@
+/*
+ * thread_allegro.cpp
+ */
+
+#include <allegro5/allegro5.h>
+#include "thread.h"
+
+struct Thread {
+    ALLEGRO_THREAD* thread;
+    ThreadFunc func;
+    void* arg;
+};
+
+static void* threadMain(ALLEGRO_THREAD*, void* arg) {
+    Thread* th = (Thread*) arg;
+    th->func(th->arg);
+    return NULL;
+}
+
+/*
+ * Start a thread running func.  Return NULL if the thread is not created.
+ */
+Thread* threadCreate(ThreadFunc func, void* arg) {
+    Thread* th = new Thread;
+    th->func = func;
+    th->arg  = arg;
+    th->thread = al_create_thread(threadMain, th);
+    if (! th->thread) {
+        delete th;
+        return NULL;
+    }
+    al_start_thread(th->thread);
+    return th;
+}
+
+/*
+ * Wait for the thread function to return and free the thread.
+ */
+void threadJoin(Thread* th) {
+    al_join_thread(th->thread, NULL);
+    al_destroy_thread(th->thread);
+    delete th;
+}
+
+Mutex* mutexCreate() {
+    return (Mutex*) al_create_mutex();
+}
+
+void mutexFree(Mutex* mutex) {
+    al_destroy_mutex((ALLEGRO_MUTEX*) mutex);
+}
+
+void mutexLock(Mutex* mutex) {
+    al_lock_mutex((ALLEGRO_MUTEX*) mutex);
+}
+
+void mutexUnlock(Mutex* mutex) {
+    al_unlock_mutex((ALLEGRO_MUTEX*) mutex);
+}
+
+Cond* condCreate() {
+    return (Cond*) al_create_cond();
+}
+
+void condFree(Cond* cond) {
+    al_destroy_cond((ALLEGRO_COND*) cond);
+}
+
+void condWait(Cond* cond, Mutex* mutex) {
+    al_wait_cond((ALLEGRO_COND*) cond, (ALLEGRO_MUTEX*) mutex);
+}
+
+void condBroadcast(Cond* cond) {
+    al_broadcast_cond((ALLEGRO_COND*) cond);
+}
+
+int cpuCount() {
+    int n = al_get_cpu_count();
+    return (n > 0) ? n : 1;
+}
@@ -0,0 +1,92 @@
+/*
+ * thread_sdl.cpp
+ */
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include "thread.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+struct Thread {
+    SDL_Thread* thread;
+    ThreadFunc func;
+    void* arg;
+};
+
+static int SDLCALL threadMain(void* arg) {
+    Thread* th = (Thread*) arg;
+    th->func(th->arg);
+    return 0;
+}
+
+/*
+ * Start a thread running func.  Return NULL if the thread is not created.
+ */
+Thread* threadCreate(ThreadFunc func, void* arg) {
+    Thread* th = new Thread;
+    th->func = func;
+    th->arg  = arg;
+    th->thread = SDL_CreateThread(threadMain, th);
+    if (! th->thread) {
+        delete th;
+        return NULL;
+    }
+    return th;
+}
+
+/*
+ * Wait for the thread function to return and free the thread.
+ */
+void threadJoin(Thread* th) {
+    SDL_WaitThread(th->thread, NULL);
+    delete th;
+}
+
+Mutex* mutexCreate() {
+    return (Mutex*) SDL_CreateMutex();
+}
+
+void mutexFree(Mutex* mutex) {
+    SDL_DestroyMutex((SDL_mutex*) mutex);
+}
+
+void mutexLock(Mutex* mutex) {
+    SDL_mutexP((SDL_mutex*) mutex);
+}
+
+void mutexUnlock(Mutex* mutex) {
+    SDL_mutexV((SDL_mutex*) mutex);
+}
+
+Cond* condCreate() {
+    return (Cond*) SDL_CreateCond();
+}
+
+void condFree(Cond* cond) {
+    SDL_DestroyCond((SDL_cond*) cond);
+}
+
+void condWait(Cond* cond, Mutex* mutex) {
+    SDL_CondWait((SDL_cond*) cond, (SDL_mutex*) mutex);
+}
+
+void condBroadcast(Cond* cond) {
+    SDL_CondBroadcast((SDL_cond*) cond);
+}
+
+// SDL 1.2 has no CPU count query.
+int cpuCount() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int) n : 1;
+#endif
+}
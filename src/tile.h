@@ -44,6 +44,16 @@ class TileAnim;
 #define MASK_UNFLYABLE          0x0004
 #define MASK_CREATURE_UNWALKABLE 0x0008
 
+/* passability masks (see Tileset::computePassability) */
+#define PASS_WALKON(dir)        (0x0001 << ((dir) - DIR_WEST))
+#define PASS_WALKOFF(dir)       (0x0010 << ((dir) - DIR_WEST))
+#define PASS_WALKABLE           0x0100
+#define PASS_CREATURE_WALKABLE  0x0200
+#define PASS_SWIMABLE           0x0400
+#define PASS_SAILABLE           0x0800
+#define PASS_FLYABLE            0x1000
+#define PASS_SHIP               0x2000
+
 /**
  * TileRule struct
  */
@@ -2,6 +2,7 @@
  * tileset.cpp
  */
 
+#include <algorithm>
 #include <cstring>
 #include "tileset.h"
 
@@ -66,7 +67,18 @@ void Tileset::loadImages() {
 #else
         Tile* it  = ts->tiles;
         Tile* end = it + ts->tileCount;
-        for (; it != end; ++it)
+
+        // Decode all the tile images in parallel first.
+        std::vector<Symbol> names;
+        for (; it != end; ++it) {
+            if (std::find(names.begin(), names.end(), it->imageName) ==
+                names.end())
+                names.push_back(it->imageName);
+        }
+        if (! names.empty())
+            xu4.imageMgr->preload(&names.front(), names.size());
+
+        for (it = ts->tiles; it != end; ++it)
             it->loadImage();
 #endif
     }
@@ -101,12 +113,49 @@ const Tile* Tileset::findTileById(TileId id) {
 Tileset::Tileset(int count) : tileCount(0) {
     tiles  = new Tile[count];
     render = new TileRenderData[count];
+    passMask = new uint16_t[count];
     memset(tiles, 0, sizeof(Tile) * count);
+    memset(passMask, 0, sizeof(uint16_t) * count);
 }
 
 Tileset::~Tileset() {
     delete[] tiles;
     delete[] render;
+    delete[] passMask;
+}
+
+/**
+ * Fills in the passability mask of each tile from its rule.  This must be
+ * called once all the tiles have been loaded.
+ */
+void Tileset::computePassability() {
+    const Tile* tile;
+    uint16_t mask;
+    int d;
+
+    for (uint32_t i = 0; i < tileCount; ++i) {
+        tile = tiles + i;
+        mask = 0;
+        for (d = DIR_WEST; d <= DIR_SOUTH; ++d) {
+            if (tile->canWalkOn((Direction) d))
+                mask |= PASS_WALKON(d);
+            if (tile->canWalkOff((Direction) d))
+                mask |= PASS_WALKOFF(d);
+        }
+        if (tile->isWalkable())
+            mask |= PASS_WALKABLE;
+        if (tile->isCreatureWalkable())
+            mask |= PASS_CREATURE_WALKABLE;
+        if (tile->isSwimable())
+            mask |= PASS_SWIMABLE;
+        if (tile->isSailable())
+            mask |= PASS_SAILABLE;
+        if (tile->isFlyable())
+            mask |= PASS_FLYABLE;
+        if (tile->isShip())
+            mask |= PASS_SHIP;
+        passMask[i] = mask;
+    }
 }
 
 /**
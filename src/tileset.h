@@ -25,9 +25,14 @@ public:
 
     const Tile* get(TileId id) const;
     const Tile* getByName(Symbol name) const;
+    void computePassability();
+    uint16_t passability(TileId id) const {
+        return (id < tileCount) ? passMask[id] : 0;
+    }
 
     Tile* tiles;
     TileRenderData* render;
+    uint16_t* passMask;     // PASS_* bits for each TileId.
     uint32_t tileCount;
     TileNameMap nameMap;
 };
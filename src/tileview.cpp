@@ -105,17 +105,15 @@ void TileView::drawTile(const MapTile &mapTile, int x, int y) {
     }
 }
 
-void TileView::drawTile(vector<MapTile> &tiles, int x, int y) {
+void TileView::drawTile(const TileStack &tiles, int x, int y) {
     ASSERT(x < columns, "x value of %d out of range", x);
     ASSERT(y < rows, "y value of %d out of range", y);
     int layer = 0;
     SCALED_VAR
 
-    for (vector<MapTile>::reverse_iterator t = tiles.rbegin();
-            t != tiles.rend();
-            ++t, ++layer)
+    for (int t = tiles.size() - 1; t >= 0; --t, ++layer)
     {
-        const MapTile& frontTile = *t;
+        const MapTile& frontTile = tiles[t];
         const Tile *frontTileType = tileset->get(frontTile.id);
 
         if (!frontTileType)
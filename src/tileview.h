@@ -48,7 +48,7 @@ public:
 
     void reinit();
     void drawTile(const MapTile &mapTile, int x, int y);
-    void drawTile(std::vector<MapTile> &tiles, int x, int y);
+    void drawTile(const TileStack &tiles, int x, int y);
     void drawFocus(int x, int y);
     void loadTile(const MapTile &mapTile);
 
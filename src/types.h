@@ -97,4 +97,34 @@ public:
     bool freezeAnimation;
 };
 
+// Maximum number of annotations queried at a single map position.
+#define ANNOTATIONS_AT_MAX  8
+
+/**
+ * The stack of tiles drawn at a map position with the top tile first.
+ * The capacity is fixed so that gathering tiles never allocates memory.
+ */
+class TileStack {
+public:
+    // Annotations plus the avatar, object, ship, base and replacement tiles.
+    enum { MAX_TILES = ANNOTATIONS_AT_MAX + 8 };
+
+    TileStack() : count(0) {}
+
+    void clear()                        { count = 0; }
+    bool empty() const                  { return count == 0; }
+    int size() const                    { return count; }
+    const MapTile& front() const        { return tiles[0]; }
+    const MapTile& operator[](int i) const { return tiles[i]; }
+
+    void push_back(const MapTile& tile) {
+        if (count < MAX_TILES)
+            tiles[count++] = tile;
+    }
+
+private:
+    MapTile tiles[MAX_TILES];
+    int count;
+};
+
 #endif
@@ -9,6 +9,7 @@
 #include "u4file.h"
 #include "unzip.h"
 #include "debug.h"
+#include "thread.h"
 
 using std::map;
 using std::string;
@@ -33,13 +34,43 @@ private:
     FILE *file;
 };
 
+/**
+ * A specialization of U4FILE that reads from a buffer already in memory.
+ * The buffer is not copied and must outlive the U4FILE.
+ */
+class U4FILE_mem : public U4FILE {
+public:
+    static U4FILE *open(const void* data, size_t size);
+
+    virtual void close();
+    virtual int seek(long offset, int whence);
+    virtual long tell();
+    virtual size_t read(void *ptr, size_t size, size_t nmemb);
+    virtual int getc();
+    virtual int putc(int c);
+    virtual long length();
+    virtual const void* contents();
+
+private:
+    const uint8_t* data;
+    long size;
+    long pos;
+};
+
+struct U4ZipArchive;
+
+// Entries up to this size are inflated once and kept in memory.
+#define ZIP_CACHE_LIMIT     (256 * 1024)
+#define ZIP_BUF_SIZE        (16 * 1024)
+
 /**
  * A specialization of U4FILE that reads files out of zip archives
- * automatically.
+ * automatically.  Small entries are returned as a U4FILE_mem of the cached
+ * data; larger ones are inflated through a buffer.
  */
 class U4FILE_zip : public U4FILE {
 public:
-    static U4FILE *open(const string &fname, const U4ZipPackage *package);
+    static U4FILE *open(U4ZipArchive *archive, unz_file_pos pos);
 
     virtual void close();
     virtual int seek(long offset, int whence);
@@ -50,7 +81,26 @@ public:
     virtual long length();
 
 private:
+    bool fill();
+
+    U4ZipArchive *archive;
     unzFile zfile;
+    uint8_t *buf;
+    long bufPos;                /**< entry offset of buf[0] */
+    int bufLen;
+    int bufIdx;
+    long size;
+};
+
+/**
+ * A zip package which is kept open along with an index of its entries.
+ */
+struct U4ZipArchive {
+    U4ZipPackage *package;
+    unzFile zfile;              /**< handle shared by readers */
+    bool busy;                  /**< zfile has an entry open */
+    std::map<string, unz_file_pos> entries; /**< lowercase name to directory position */
+    std::map<uLong, vector<uint8_t> > data; /**< inflated small entries by file number */
 };
 
 /**
@@ -60,11 +110,14 @@ struct U4ZipPackageMgr {
     U4ZipPackageMgr();
     ~U4ZipPackageMgr();
 
-    void add(U4ZipPackage *package) {
-        packages.push_back(package);
-    }
+    U4ZipArchive *add(U4ZipPackage *package);
+    U4ZipArchive *find(const U4ZipPackage *package) const;
+    const unz_file_pos *entry(const string &fname,
+                              const U4ZipArchive *archive) const;
+    U4FILE *open(const string &fname, U4ZipArchive *archive) const;
 
-    std::vector<U4ZipPackage *> packages;
+    std::vector<U4ZipArchive *> archives;
+    std::map<string, string> dosPaths;  /**< u4fopen name to found pathname */
 };
 
 extern bool verbose;
@@ -256,6 +309,13 @@ const string &U4ZipPackage::translate(const string &name) const {
         return name;
 }
 
+static string lowercase(const string &str) {
+    string low(str);
+    for (string::iterator it = low.begin(); it != low.end(); ++it)
+        *it = tolower(*it);
+    return low;
+}
+
 static const char* u4ZipFilenames[] = {
     // Check for the upgraded package which is unlikely to be renamed.
     "ultima4-1.01.zip",
@@ -279,8 +339,6 @@ static const char* u4ZipFilenames[] = {
 };
 
 U4ZipPackageMgr::U4ZipPackageMgr() {
-    unzFile f;
-
     string upg_pathname(u4find_path("u4upgrad.zip", &u4Path.u4ZipPaths));
     if (!upg_pathname.empty()) {
         /* upgrade zip is present */
@@ -312,7 +370,8 @@ U4ZipPackageMgr::U4ZipPackageMgr() {
         upgrade->addTranslation("ultima.com", "ultima.old"); // not actually used
         upgrade->addTranslation("valor.ega", "valor.old");
         upgrade->addTranslation("yew.tlk", "yew.old");
-        add(upgrade);
+        if (! add(upgrade))
+            delete upgrade;
     }
 
     // Check for the default zip packages
@@ -324,37 +383,113 @@ U4ZipPackageMgr::U4ZipPackageMgr() {
             break;
     }
     if (*zipFile) {
-        f = unzOpen(pathname.c_str());
-        if (!f)
+        // Entry names are indexed in lowercase.
+        static const char* internalPaths[] = {
+            "", "ultima4/", "u4/", NULL
+        };
+        U4ZipPackage *package = new U4ZipPackage(pathname, "", false);
+        U4ZipArchive *archive = add(package);
+        if (! archive) {
+            delete package;
             return;
+        }
 
         //Now we detect the folder structure inside the zipfile.
-        if (unzLocateFile(f, "charset.ega", 2) == UNZ_OK) {
-            add(new U4ZipPackage(pathname, "", false));
-
-        } else if (unzLocateFile(f, "ultima4/charset.ega", 2) == UNZ_OK) {
-            add(new U4ZipPackage(pathname, "ultima4/", false));
+        const char** it;
+        for (it = internalPaths; *it; ++it) {
+            string cname = string(*it) + "charset.ega";
+            if (archive->entries.find(cname) != archive->entries.end()) {
+                *package = U4ZipPackage(pathname, *it, false);
+                return;
+            }
+        }
 
-        } else if (unzLocateFile(f, "Ultima4/charset.ega", 2) == UNZ_OK) {
-            add(new U4ZipPackage(pathname, "Ultima4/", false));
+        // No game data found; drop the package.
+        unzClose(archive->zfile);
+        delete archive;
+        delete package;
+        archives.pop_back();
+    }
+}
 
-        } else if (unzLocateFile(f, "ULTIMA4/charset.ega", 2) == UNZ_OK) {
-            add(new U4ZipPackage(pathname, "ULTIMA4/", false));
+/**
+ * Open a zip package and index all the entries in its central directory.
+ * This is the only time the directory is read.
+ *
+ * \return Archive pointer or NULL if the package could not be opened.
+ */
+U4ZipArchive *U4ZipPackageMgr::add(U4ZipPackage *package) {
+    unzFile f = unzOpen(package->getFilename().c_str());
+    if (! f)
+        return NULL;
 
-        } else if (unzLocateFile(f, "u4/charset.ega", 2) == UNZ_OK) {
-            add(new U4ZipPackage(pathname, "u4/", false));
+    U4ZipArchive *archive = new U4ZipArchive;
+    archive->package = package;
+    archive->zfile = f;
+    archive->busy = false;
+
+    char name[256];
+    unz_file_info info;
+    unz_file_pos pos;
+    int err = unzGoToFirstFile(f);
+    while (err == UNZ_OK) {
+        // Names too long for the buffer are not terminated; no resource
+        // has such a name so these entries are skipped.
+        if (unzGetCurrentFileInfo(f, &info, name, sizeof(name),
+                                  NULL, 0, NULL, 0) == UNZ_OK &&
+            info.size_filename < sizeof(name)) {
+            unzGetFilePos(f, &pos);
+            archive->entries[ lowercase(name) ] = pos;
+        }
+        err = unzGoToNextFile(f);
+    }
 
-        } else if (unzLocateFile(f, "U4/charset.ega", 2) == UNZ_OK) {
-            add(new U4ZipPackage(pathname, "U4/", false));
+    archives.push_back(archive);
+    return archive;
+}
 
-        }
-        unzClose(f);
+U4ZipArchive *U4ZipPackageMgr::find(const U4ZipPackage *package) const {
+    std::vector<U4ZipArchive *>::const_iterator it;
+    for (it = archives.begin(); it != archives.end(); ++it) {
+        if ((*it)->package == package)
+            return *it;
     }
+    return NULL;
+}
+
+/**
+ * Find the directory position of a resource in an archive.  Zip entry names
+ * are matched without regard to case, as unzLocateFile did before.
+ */
+const unz_file_pos *U4ZipPackageMgr::entry(const string &fname,
+                                           const U4ZipArchive *archive) const {
+    const U4ZipPackage *package = archive->package;
+    std::map<string, unz_file_pos>::const_iterator it;
+
+    it = archive->entries.find(
+            lowercase(package->getInternalPath() + package->translate(fname)));
+    if (it == archive->entries.end())
+        return NULL;
+    return &it->second;
+}
+
+/**
+ * Open a resource from an archive.
+ */
+U4FILE *U4ZipPackageMgr::open(const string &fname,
+                              U4ZipArchive *archive) const {
+    const unz_file_pos *pos = entry(fname, archive);
+    if (! pos)
+        return NULL;
+    return U4FILE_zip::open(archive, *pos);
 }
 
 U4ZipPackageMgr::~U4ZipPackageMgr() {
-    for (std::vector<U4ZipPackage *>::iterator i = packages.begin(); i != packages.end(); i++)
+    for (std::vector<U4ZipArchive *>::iterator i = archives.begin(); i != archives.end(); i++) {
+        unzClose((*i)->zfile);
+        delete (*i)->package;
         delete *i;
+    }
 }
 
 int U4FILE::getshort() {
@@ -407,79 +542,207 @@ long U4FILE_stdio::length() {
     return len;
 }
 
+U4FILE *U4FILE_mem::open(const void* data, size_t size) {
+    U4FILE_mem *u4f = new U4FILE_mem;
+    u4f->data = (const uint8_t*) data;
+    u4f->size = size;
+    u4f->pos  = 0;
+    return u4f;
+}
+
+void U4FILE_mem::close() {
+}
+
+int U4FILE_mem::seek(long offset, int whence) {
+    if (whence == SEEK_CUR)
+        offset += pos;
+    else if (whence == SEEK_END)
+        offset += size;
+    if (offset < 0 || offset > size)
+        return -1;
+    pos = offset;
+    return 0;
+}
+
+long U4FILE_mem::tell() {
+    return pos;
+}
+
+size_t U4FILE_mem::read(void *ptr, size_t size, size_t nmemb) {
+    if (! size)
+        return 0;
+    size_t avail = (this->size - pos) / size;
+    if (nmemb > avail)
+        nmemb = avail;
+    memcpy(ptr, data + pos, size * nmemb);
+    pos += size * nmemb;
+    return nmemb;
+}
+
+int U4FILE_mem::getc() {
+    if (pos >= size)
+        return EOF;
+    return data[pos++];
+}
+
+int U4FILE_mem::putc(int) {
+    return EOF;
+}
+
+long U4FILE_mem::length() {
+    return size;
+}
+
+const void* U4FILE_mem::contents() {
+    return data;
+}
+
+/*
+ * Get a handle to read an entry from.  The shared archive handle is used if
+ * no other entry has it open, otherwise a private handle is opened.
+ * Neither case searches the central directory.
+ */
+static unzFile zipAcquire(U4ZipArchive *archive) {
+    if (archive->busy)
+        return unzOpen(archive->package->getFilename().c_str());
+    archive->busy = true;
+    return archive->zfile;
+}
+
+static void zipRelease(U4ZipArchive *archive, unzFile f) {
+    if (f == archive->zfile) {
+        unzCloseCurrentFile(f);
+        archive->busy = false;
+    } else {
+        unzClose(f);
+    }
+}
+
 /**
- * Opens a file from within a zip archive.
+ * Opens an indexed entry of a zip archive.
  */
-U4FILE *U4FILE_zip::open(const string &fname, const U4ZipPackage *package) {
+U4FILE *U4FILE_zip::open(U4ZipArchive *archive, unz_file_pos pos) {
     U4FILE_zip *u4f;
+    unz_file_info info;
     unzFile f;
 
-    f = unzOpen(package->getFilename().c_str());
+    std::map<uLong, vector<uint8_t> >::iterator cached;
+    cached = archive->data.find(pos.num_of_file);
+    if (cached != archive->data.end()) {
+        const vector<uint8_t> &data = cached->second;
+        return U4FILE_mem::open(data.empty() ? NULL : &data[0], data.size());
+    }
+
+    f = zipAcquire(archive);
     if (!f)
         return NULL;
 
-    string pathname = package->getInternalPath() + package->translate(fname);
-
-    if (unzLocateFile(f, pathname.c_str(), 2) == UNZ_END_OF_LIST_OF_FILE) {
-        unzClose(f);
+    if (unzGoToFilePos(f, &pos) != UNZ_OK ||
+        unzGetCurrentFileInfo(f, &info, NULL, 0, NULL, 0, NULL, 0) != UNZ_OK ||
+        unzOpenCurrentFile(f) != UNZ_OK) {
+        zipRelease(archive, f);
         return NULL;
     }
-    unzOpenCurrentFile(f);
+
+    if (info.uncompressed_size <= ZIP_CACHE_LIMIT) {
+        vector<uint8_t> &data = archive->data[pos.num_of_file];
+        int len = 0;
+        data.resize(info.uncompressed_size);
+        if (! data.empty())
+            len = unzReadCurrentFile(f, &data[0], data.size());
+        bool ok = (len == (int) data.size()) &&
+                  (unzCloseCurrentFile(f) == UNZ_OK);
+        zipRelease(archive, f);
+        if (! ok) {
+            archive->data.erase(pos.num_of_file);
+            return NULL;
+        }
+        return U4FILE_mem::open(data.empty() ? NULL : &data[0], data.size());
+    }
 
     u4f = new U4FILE_zip;
+    u4f->archive = archive;
     u4f->zfile = f;
+    u4f->buf = new uint8_t[ZIP_BUF_SIZE];
+    u4f->bufPos = 0;
+    u4f->bufLen = u4f->bufIdx = 0;
+    u4f->size = info.uncompressed_size;
 
     return u4f;
 }
 
 void U4FILE_zip::close() {
-    unzClose(zfile);
+    delete[] buf;
+    zipRelease(archive, zfile);
 }
 
-int U4FILE_zip::seek(long offset, int whence) {
-    char *buf;
-    long pos;
+/*
+ * Inflate the next block of the entry into the buffer.
+ * Return false at the end of the entry.
+ */
+bool U4FILE_zip::fill() {
+    bufPos += bufLen;
+    bufIdx = 0;
+    bufLen = unzReadCurrentFile(zfile, buf, ZIP_BUF_SIZE);
+    if (bufLen < 0)
+        bufLen = 0;
+    return bufLen > 0;
+}
 
-    ASSERT(whence != SEEK_END, "seeking with whence == SEEK_END not allowed with zipfiles");
-    pos = unztell(zfile);
+/*
+ * Seeks within the buffered block are free.  Forward seeks inflate through
+ * the buffer and only seeks back before the block restart the inflater.
+ */
+int U4FILE_zip::seek(long offset, int whence) {
     if (whence == SEEK_CUR)
-        offset = pos + offset;
-    if (offset == pos)
-        return 0;
-    if (offset < pos) {
+        offset += bufPos + bufIdx;
+    else if (whence == SEEK_END)
+        offset += size;
+    if (offset < 0 || offset > size)
+        return -1;
+
+    if (offset < bufPos) {
         unzCloseCurrentFile(zfile);
         unzOpenCurrentFile(zfile);
-        pos = 0;
+        bufPos = 0;
+        bufLen = bufIdx = 0;
+    }
+    while (offset > bufPos + bufLen) {
+        if (! fill())
+            return -1;
     }
-    ASSERT(offset - pos > 0, "error in U4FILE_zip::seek");
-    buf = new char[offset - pos];
-    unzReadCurrentFile(zfile, buf, offset - pos);
-    delete [] buf;
+    bufIdx = offset - bufPos;
     return 0;
 }
 
 long U4FILE_zip::tell() {
-    return unztell(zfile);
+    return bufPos + bufIdx;
 }
 
 size_t U4FILE_zip::read(void *ptr, size_t size, size_t nmemb) {
-    size_t retval = unzReadCurrentFile(zfile, ptr, size * nmemb);
-    if (retval > 0)
-        retval = retval / size;
+    uint8_t *dst = (uint8_t *) ptr;
+    size_t want, avail, count = 0;
 
-    return retval;
+    if (! size)
+        return 0;
+    want = size * nmemb;
+    while (count < want) {
+        if (bufIdx >= bufLen && ! fill())
+            break;
+        avail = bufLen - bufIdx;
+        if (avail > want - count)
+            avail = want - count;
+        memcpy(dst + count, buf + bufIdx, avail);
+        bufIdx += avail;
+        count += avail;
+    }
+    return count / size;
 }
 
 int U4FILE_zip::getc() {
-    int retval;
-    unsigned char c;
-
-    if (unzReadCurrentFile(zfile, &c, 1) > 0)
-        retval = c;
-    else
-        retval = EOF;
-
-    return retval;
+    if (bufIdx >= bufLen && ! fill())
+        return EOF;
+    return buf[bufIdx++];
 }
 
 int U4FILE_zip::putc(int c) {
@@ -488,13 +751,44 @@ int U4FILE_zip::putc(int c) {
 }
 
 long U4FILE_zip::length() {
-    unz_file_info fileinfo;
+    return size;
+}
+
+/*
+ * Find an unzipped file of the Ultima 4 for DOS installation.  This tries
+ * filename, Filename and FILENAME in the installation paths.  The path found
+ * (or not found) for each name is remembered so the search is only done once.
+ *
+ * \return Pathname or an empty string if the file does not exist.
+ */
+static const string &u4fdosPath(const string &fname) {
+    map<string, string>::iterator found = u4zip_instance->dosPaths.find(fname);
+    if (found != u4zip_instance->dosPaths.end())
+        return found->second;
+
+    string fname_copy(fname);
+    unsigned int i;
 
-    unzGetCurrentFileInfo(zfile, &fileinfo,
-                          NULL, 0,
-                          NULL, 0,
-                          NULL, 0);
-    return fileinfo.uncompressed_size;
+    string pathname = u4find_path(fname_copy.c_str(), &u4Path.u4ForDOSPaths);
+    if (pathname.empty()) {
+        using namespace std;
+        if (islower(fname_copy[0])) {
+            fname_copy[0] = toupper(fname_copy[0]);
+            pathname = u4find_path(fname_copy.c_str(), &u4Path.u4ForDOSPaths);
+        }
+
+        if (pathname.empty()) {
+            for (i = 0; fname_copy[i] != '\0'; i++) {
+                if (islower(fname_copy[i]))
+                    fname_copy[i] = toupper(fname_copy[i]);
+            }
+            pathname = u4find_path(fname_copy.c_str(), &u4Path.u4ForDOSPaths);
+        }
+    }
+
+    string &entry = u4zip_instance->dosPaths[fname];
+    entry = pathname;
+    return entry;
 }
 
 /**
@@ -503,15 +797,11 @@ long U4FILE_zip::length() {
  * maps the filenames to uppercase if necessary.  The files are always
  * opened for reading only.
  *
- * First, it looks in the zipfiles.  Next, it tries FILENAME, Filename
- * and filename in up to four paths, meaning up to twelve or more
- * opens per file.  Seems to be ok for performance, but could be
- * getting excessive.  The presence of the zipfiles should probably be
- * cached.
+ * First, it looks in the zipfile indexes and then for an unzipped file
+ * (see u4fdosPath).
  */
 U4FILE *u4fopen(const string &fname) {
     U4FILE *u4f = NULL;
-    unsigned int i;
 
     if (verbose)
         printf("looking for %s\n", fname.c_str());
@@ -519,13 +809,13 @@ U4FILE *u4fopen(const string &fname) {
     /**
      * search for file within zipfiles (ultima4.zip, u4upgrad.zip, etc.)
      */
-    const vector<U4ZipPackage *> &packages = u4zip_instance->packages;
-    for (std::vector<U4ZipPackage *>::const_reverse_iterator j = packages.rbegin(); j != packages.rend(); j++) {
-        u4f = U4FILE_zip::open(fname, *j);
+    const vector<U4ZipArchive *> &archives = u4zip_instance->archives;
+    for (std::vector<U4ZipArchive *>::const_reverse_iterator j = archives.rbegin(); j != archives.rend(); j++) {
+        u4f = u4zip_instance->open(fname, *j);
         if (u4f) {
             if (verbose) {
                 printf("%s found in %s\n", fname.c_str(),
-                       (*j)->getFilename().c_str());
+                       (*j)->package->getFilename().c_str());
             }
             return u4f; /* file was found, return it! */
         }
@@ -534,25 +824,7 @@ U4FILE *u4fopen(const string &fname) {
     /*
      * file not in a zipfile; check if it has been unzipped
      */
-    string fname_copy(fname);
-
-    string pathname = u4find_path(fname_copy.c_str(), &u4Path.u4ForDOSPaths);
-    if (pathname.empty()) {
-        using namespace std;
-        if (islower(fname_copy[0])) {
-            fname_copy[0] = toupper(fname_copy[0]);
-            pathname = u4find_path(fname_copy.c_str(), &u4Path.u4ForDOSPaths);
-        }
-
-        if (pathname.empty()) {
-            for (i = 0; fname_copy[i] != '\0'; i++) {
-                if (islower(fname_copy[i]))
-                    fname_copy[i] = toupper(fname_copy[i]);
-            }
-            pathname = u4find_path(fname_copy.c_str(), &u4Path.u4ForDOSPaths);
-        }
-    }
-
+    const string &pathname = u4fdosPath(fname);
     if (!pathname.empty()) {
         u4f = U4FILE_stdio::open(pathname.c_str());
         if (verbose && u4f != NULL)
@@ -570,11 +842,180 @@ U4FILE *u4fopen_stdio(const char* fname) {
     return U4FILE_stdio::open(fname);
 }
 
+/**
+ * Wraps a read-only buffer in a U4FILE.
+ */
+U4FILE *u4fopen_mem(const void* data, size_t size) {
+    return U4FILE_mem::open(data, size);
+}
+
 /**
  * Opens a file from a zipfile and wraps it in a U4FILE.
  */
 U4FILE *u4fopen_zip(const string &fname, U4ZipPackage *package) {
-    return U4FILE_zip::open(fname, package);
+    U4ZipArchive *archive = u4zip_instance->find(package);
+    if (! archive)
+        return NULL;
+    return u4zip_instance->open(fname, archive);
+}
+
+/**
+ * A file which is read into memory by a worker thread.
+ */
+struct U4Fetch {
+    Thread *thread;
+    Mutex *mutex;
+    U4ZipArchive *archive;      /**< NULL for an unzipped file */
+    unz_file_pos pos;
+    string path;                /**< zip package or unzipped file pathname */
+    vector<uint8_t> data;
+    bool done;
+    bool ok;
+};
+
+/*
+ * Inflate the entry with a private handle so the shared archive handle
+ * is never touched by the worker.
+ */
+static bool fetchZip(U4Fetch *fetch) {
+    unz_file_info info;
+    bool ok = false;
+    unzFile f = unzOpen(fetch->path.c_str());
+    if (! f)
+        return false;
+
+    if (unzGoToFilePos(f, &fetch->pos) == UNZ_OK &&
+        unzGetCurrentFileInfo(f, &info, NULL, 0, NULL, 0, NULL, 0) == UNZ_OK &&
+        unzOpenCurrentFile(f) == UNZ_OK) {
+        int len = 0;
+        fetch->data.resize(info.uncompressed_size);
+        if (! fetch->data.empty())
+            len = unzReadCurrentFile(f, &fetch->data[0], fetch->data.size());
+        ok = (len == (int) fetch->data.size()) &&
+             (unzCloseCurrentFile(f) == UNZ_OK);
+    }
+    unzClose(f);
+    return ok;
+}
+
+static bool fetchStdio(U4Fetch *fetch) {
+    long len;
+    bool ok = false;
+    FILE *fp = fopen(fetch->path.c_str(), "rb");
+    if (! fp)
+        return false;
+
+    if (fseek(fp, 0, SEEK_END) == 0 && (len = ftell(fp)) >= 0) {
+        fseek(fp, 0, SEEK_SET);
+        fetch->data.resize(len);
+        ok = (len == 0) || (fread(&fetch->data[0], 1, len, fp) == (size_t) len);
+    }
+    fclose(fp);
+    return ok;
+}
+
+static void fetchWorker(void *arg) {
+    U4Fetch *fetch = (U4Fetch *) arg;
+    bool ok = fetch->archive ? fetchZip(fetch) : fetchStdio(fetch);
+
+    mutexLock(fetch->mutex);
+    fetch->ok = ok;
+    fetch->done = true;
+    mutexUnlock(fetch->mutex);
+}
+
+static U4Fetch *fetchStart(U4Fetch *fetch) {
+    fetch->mutex = mutexCreate();
+    fetch->done = fetch->ok = false;
+    fetch->thread = threadCreate(fetchWorker, fetch);
+    if (! fetch->thread)
+        fetchWorker(fetch);
+    return fetch;
+}
+
+/**
+ * Start reading a data file on a worker thread.  The file is found on the
+ * calling thread just as u4fopen() does; only the read (and inflate) is
+ * done by the worker.
+ *
+ * \return Fetch handle or NULL if the file does not exist.
+ */
+U4Fetch *u4fetch(const string &fname) {
+    U4Fetch *fetch;
+
+    const vector<U4ZipArchive *> &archives = u4zip_instance->archives;
+    for (std::vector<U4ZipArchive *>::const_reverse_iterator j = archives.rbegin(); j != archives.rend(); j++) {
+        const unz_file_pos *pos = u4zip_instance->entry(fname, *j);
+        if (pos) {
+            fetch = new U4Fetch;
+            fetch->archive = *j;
+            fetch->pos = *pos;
+            fetch->path = (*j)->package->getFilename();
+            if ((*j)->data.count(pos->num_of_file)) {
+                // Already inflated; u4fetchOpen() will use the cache.
+                fetch->thread = NULL;
+                fetch->mutex = mutexCreate();
+                fetch->done = fetch->ok = true;
+                return fetch;
+            }
+            return fetchStart(fetch);
+        }
+    }
+
+    const string &pathname = u4fdosPath(fname);
+    if (pathname.empty())
+        return NULL;
+    fetch = new U4Fetch;
+    fetch->archive = NULL;
+    fetch->path = pathname;
+    return fetchStart(fetch);
+}
+
+/**
+ * Return true if the worker has finished reading the file.
+ */
+bool u4fetchDone(U4Fetch *fetch) {
+    bool done;
+    mutexLock(fetch->mutex);
+    done = fetch->done;
+    mutexUnlock(fetch->mutex);
+    return done;
+}
+
+/**
+ * Open the file contents read by u4fetch(), waiting for the worker if it
+ * has not yet finished.  The U4FILE must be closed before u4fetchFree().
+ * Small zip entries are moved into the archive cache as u4fopen() would
+ * have kept them.
+ *
+ * \return File or NULL if the read failed.
+ */
+U4FILE *u4fetchOpen(U4Fetch *fetch) {
+    if (fetch->thread) {
+        threadJoin(fetch->thread);
+        fetch->thread = NULL;
+    }
+    if (! fetch->ok)
+        return NULL;
+
+    U4ZipArchive *archive = fetch->archive;
+    if (archive) {
+        if (archive->data.count(fetch->pos.num_of_file))
+            return U4FILE_zip::open(archive, fetch->pos);
+        if (fetch->data.size() <= ZIP_CACHE_LIMIT) {
+            archive->data[fetch->pos.num_of_file].swap(fetch->data);
+            return U4FILE_zip::open(archive, fetch->pos);
+        }
+    }
+    return U4FILE_mem::open(fetch->data.empty() ? NULL : &fetch->data[0],
+                            fetch->data.size());
+}
+
+void u4fetchFree(U4Fetch *fetch) {
+    if (fetch->thread)
+        threadJoin(fetch->thread);
+    mutexFree(fetch->mutex);
+    delete fetch;
 }
 
 /**
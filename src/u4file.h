@@ -51,6 +51,8 @@ public:
     virtual int getc() = 0;
     virtual int putc(int c) = 0;
     virtual long length() = 0;
+    // Return the entire file contents if they are already in memory.
+    virtual const void* contents() { return NULL; }
 
     int getshort();
 };
@@ -84,8 +86,16 @@ bool u4isUpgradeAvailable();
 bool u4isUpgradeInstalled();
 U4FILE *u4fopen(const std::string &fname);
 U4FILE *u4fopen_stdio(const char* fname);
+U4FILE *u4fopen_mem(const void* data, size_t size);
 U4FILE *u4fopen_zip(const std::string &fname, U4ZipPackage *package);
 void u4fclose(U4FILE *f);
+
+struct U4Fetch;
+U4Fetch *u4fetch(const std::string &fname);
+bool u4fetchDone(U4Fetch *fetch);
+U4FILE *u4fetchOpen(U4Fetch *fetch);
+void u4fetchFree(U4Fetch *fetch);
+
 int u4fseek(U4FILE *f, long offset, int whence);
 long u4ftell(U4FILE *f);
 size_t u4fread(void *ptr, size_t size, size_t nmemb, U4FILE *f);
@@ -111,6 +111,13 @@ typedef struct unz_file_info_s
     tm_unz tmu_date;
 } unz_file_info;
 
+/* unz_file_pos records the position of a file in the central dir */
+typedef struct unz_file_pos_s
+{
+    uLong pos_in_zip_directory;   /* offset in zip file directory */
+    uLong num_of_file;            /* # of file */
+} unz_file_pos;
+
 extern int ZEXPORT unzStringFileNameCompare OF ((const char* fileName1,
                                                  const char* fileName2,
                                                  int iCaseSensitivity));
@@ -188,6 +195,22 @@ extern int ZEXPORT unzLocateFile OF((unzFile file,
   UNZ_END_OF_LIST_OF_FILE if the file is not found
 */
 
+extern int ZEXPORT unzGetFilePos OF((unzFile file,
+                     unz_file_pos* file_pos));
+/*
+  Store the position of the current file so that it can be made current
+  again with unzGoToFilePos without searching the central dir.
+  return UNZ_OK if there is no problem
+*/
+
+extern int ZEXPORT unzGoToFilePos OF((unzFile file,
+                     unz_file_pos* file_pos));
+/*
+  Set the current file to one previously recorded by unzGetFilePos.
+  The position is valid for any handle opened on the same zipfile.
+  return UNZ_OK if there is no problem
+*/
+
 
 extern int ZEXPORT unzGetCurrentFileInfo OF((unzFile file,
                          unz_file_info *pfile_info,
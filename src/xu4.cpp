@@ -22,6 +22,28 @@
 #include "settings.h"
 #include "sound.h"
 #include "utils.h"
+#include "support/profiler.h"
+
+#ifdef PROF_ALLOCS
+#include <cstdlib>
+#include <new>
+
+/*
+ * Count heap allocations so that the profiler can show how many are made
+ * each frame.
+ */
+void* operator new(size_t size) {
+    prof_countAlloc();
+    void* ptr = malloc(size ? size : 1);
+    if (! ptr)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr) throw() {
+    free(ptr);
+}
+#endif
 
 #if defined(MACOSX)
 #include "macosx/osxinit.h"
@@ -29,6 +51,11 @@
 
 #ifdef DEBUG
 extern int gameSave(const char*);
+extern void mapBenchmark(int rounds);
+extern void scalerBenchmark(int rounds);
+extern void objectBenchmark(int rounds);
+extern void moveBenchmark(int rounds);
+extern void decodeBenchmark(int rounds);
 #endif
 
 bool verbose = false;
@@ -41,7 +68,13 @@ enum OptionsFlag {
     OPT_VERBOSE    = 8,
     OPT_RECORD     = 0x10,
     OPT_REPLAY     = 0x20,
-    OPT_TEST_SAVE  = 0x80
+    OPT_HEADLESS   = 0x40,
+    OPT_TEST_SAVE  = 0x80,
+    OPT_BENCH_MAPS = 0x100,
+    OPT_BENCH_SCALERS = 0x200,
+    OPT_BENCH_OBJECTS = 0x400,
+    OPT_BENCH_MOVES = 0x800,
+    OPT_BENCH_DECODE = 0x1000
 };
 
 struct Options {
@@ -52,6 +85,7 @@ struct Options {
     const char* module;
     const char* profile;
     const char* recordFile;
+    const char* traceFile;
 };
 
 #define strEqual(A,B)       (strcmp(A,B) == 0)
@@ -126,11 +160,22 @@ int parseOptions(Options* opt, int argc, char** argv) {
             "  -q, --quiet             Disable audio.\n"
             "  -s, --scale <int>       Specify scaling factor (1-5).\n"
             "  -v, --verbose           Enable verbose console output.\n"
-#ifdef DEBUG
-            "\nDEBUG Options:\n"
             "  -c, --capture <file>    Record user input.\n"
             "  -r, --replay <file>     Play using recorded input.\n"
+#ifndef USE_GL
+            "      --replay-headless <file>\n"
+            "                          Play recorded input as fast as possible\n"
+            "                          without display or audio & print timing.\n"
+#endif
+            "      --trace <file>      Save frame timing as a Chrome trace.\n"
+#ifdef DEBUG
+            "\nDEBUG Options:\n"
             "      --test-save         Save to /tmp/xu4/ and quit.\n"
+            "      --bench-maps        Print the load time of each map and quit.\n"
+            "      --bench-scalers     Print the time of each scaler and quit.\n"
+            "      --bench-objects     Print the time of map object lookups and quit.\n"
+            "      --bench-moves       Print the time of creature move checks and quit.\n"
+            "      --bench-decode      Print the decode time of RLE & LZW images and quit.\n"
 #endif
 #ifdef USE_GL
             "\nFilters: point, HQX, xBR-lv2\n"
@@ -141,7 +186,6 @@ int parseOptions(Options* opt, int argc, char** argv) {
 
             return 0;
         }
-#ifdef DEBUG
         else if (strEqualAlt(argv[i], "-c", "--capture"))
         {
             if (++i >= argc)
@@ -158,10 +202,47 @@ int parseOptions(Options* opt, int argc, char** argv) {
             opt->flags |= OPT_REPLAY;
             opt->used  |= OPT_REPLAY;
         }
+#ifndef USE_GL
+        else if (strEqual(argv[i], "--replay-headless"))
+        {
+            if (++i >= argc)
+                goto missing_value;
+            opt->recordFile = argv[i];
+            opt->flags |= OPT_REPLAY | OPT_HEADLESS | OPT_NO_AUDIO;
+            opt->used  |= OPT_REPLAY | OPT_HEADLESS | OPT_NO_AUDIO;
+        }
+#endif
+        else if (strEqual(argv[i], "--trace"))
+        {
+            if (++i >= argc)
+                goto missing_value;
+            opt->traceFile = argv[i];
+        }
+#ifdef DEBUG
         else if (strEqual(argv[i], "--test-save"))
         {
             opt->flags |= OPT_TEST_SAVE;
         }
+        else if (strEqual(argv[i], "--bench-maps"))
+        {
+            opt->flags |= OPT_BENCH_MAPS;
+        }
+        else if (strEqual(argv[i], "--bench-scalers"))
+        {
+            opt->flags |= OPT_BENCH_SCALERS;
+        }
+        else if (strEqual(argv[i], "--bench-objects"))
+        {
+            opt->flags |= OPT_BENCH_OBJECTS;
+        }
+        else if (strEqual(argv[i], "--bench-moves"))
+        {
+            opt->flags |= OPT_BENCH_MOVES;
+        }
+        else if (strEqual(argv[i], "--bench-decode"))
+        {
+            opt->flags |= OPT_BENCH_DECODE;
+        }
 #endif
         else {
             errorFatal("Unrecognized argument: %s\n\n"
@@ -177,9 +258,7 @@ missing_value:
 }
 
 
-#ifdef DEBUG
 void servicesFree(XU4GameServices*);
-#endif
 
 void servicesInit(XU4GameServices* gs, Options* opt) {
     if (opt->flags & OPT_VERBOSE)
@@ -196,6 +275,9 @@ void servicesInit(XU4GameServices* gs, Options* opt) {
     /* Setup the message bus early to make it available to other services. */
     notify_init(&gs->notifyBus, 8);
 
+    if (opt->traceFile)
+        prof_init(opt->traceFile);
+
     /* initialize the settings */
     gs->settings = new Settings;
     gs->settings->init(opt->profile);
@@ -207,6 +289,12 @@ void servicesInit(XU4GameServices* gs, Options* opt) {
         gs->settings->scale = opt->scale;
     if (opt->filter)
         gs->settings->filter = opt->filter;
+    if (opt->flags & OPT_HEADLESS) {
+        gs->headless = true;
+        gs->settings->fullscreen = false;
+        gs->settings->scale = 1;
+        gs->settings->mouseOptions.enabled = false;
+    }
 
     Debug::initGlobal("debug/global.txt");
 
@@ -218,9 +306,9 @@ void servicesInit(XU4GameServices* gs, Options* opt) {
         soundInit();
 
     gs->eventHandler = new EventHandler(1000/gs->settings->gameCyclesPerSecond,
-                            1000/gs->settings->screenAnimationFramesPerSecond);
+                            1000/gs->settings->screenAnimationFramesPerSecond,
+                            screenFrameSync());
 
-#ifdef DEBUG
     if (opt->flags & OPT_REPLAY) {
         uint32_t seed = gs->eventHandler->replay(opt->recordFile);
         if (! seed) {
@@ -236,7 +324,6 @@ void servicesInit(XU4GameServices* gs, Options* opt) {
         }
         xu4_srandom(seed);
     } else
-#endif
         xu4_srandom(time(NULL));
 
     gs->stage = (opt->flags & OPT_NO_INTRO) ? StagePlay : StageIntro;
@@ -252,6 +339,7 @@ void servicesFree(XU4GameServices* gs) {
     configFree(gs->config);
     delete gs->settings;
     notify_free(&gs->notifyBus);
+    prof_free();
     u4fcleanup();
 }
 
@@ -290,6 +378,43 @@ int main(int argc, char *argv[]) {
         servicesFree(&xu4);
         return status;
     }
+    if (opt.flags & OPT_BENCH_MAPS) {
+        mapBenchmark(20);
+        xu4.stage = StageExitGame;
+        servicesFree(&xu4);
+        return 0;
+    }
+    if (opt.flags & OPT_BENCH_SCALERS) {
+        scalerBenchmark(20);
+        xu4.stage = StageExitGame;
+        servicesFree(&xu4);
+        return 0;
+    }
+    if (opt.flags & OPT_BENCH_OBJECTS) {
+        objectBenchmark(20);
+        xu4.stage = StageExitGame;
+        servicesFree(&xu4);
+        return 0;
+    }
+    if (opt.flags & OPT_BENCH_DECODE) {
+        decodeBenchmark(20);
+        xu4.stage = StageExitGame;
+        servicesFree(&xu4);
+        return 0;
+    }
+    if (opt.flags & OPT_BENCH_MOVES) {
+        int status = 0;
+        xu4.game = new GameController();
+        if (xu4.game->initContext()) {
+            moveBenchmark(20);
+        } else {
+            printf("initContext failed!\n");
+            status = 1;
+        }
+        xu4.stage = StageExitGame;
+        servicesFree(&xu4);
+        return status;
+    }
 #endif
     }
 
@@ -44,6 +44,7 @@ struct XU4GameServices {
     GameController* game;
     const char* errorMessage;
     int stage;
+    bool headless;      // No display, audio, or frame delays.
 };
 
 extern XU4GameServices xu4;